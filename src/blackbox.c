@@ -0,0 +1,476 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+#include <string.h>
+
+// Flight data recorder. While armed, every blackbox_rate loops a frame of the main loop state is logged to the
+// M25P16 flash or streamed out of a serial port, see blackbox_device. Most frames are 'P' frames carrying each
+// field as the difference to the previous frame, every BLACKBOX_KEYFRAME_INTERVAL frames (and after a dropped
+// frame) an 'I' frame carries absolute values so a decoder can resync. Values are zigzag encoded variable length
+// integers, 7 bits per byte, low bits first.
+//
+// Nothing here ever waits on the hardware. A frame that doesn't fit in the flash staging pages or the serial TX
+// buffer is dropped and counted, and the next frame is a keyframe.
+//
+// Fields, in order: gyroADC[3] accSmooth[3] rcCommand[4] axisPID[3] motor[motorCount] angle[2] vbat cycleTime.
+// With blackbox_raw the raw set follows, what a SITL replay of the flight needs (see sitl_replay.c):
+//   gyroAt gyro[3] acc[3] magAt mag[3] baroAt baroPressure baroTemperature rcData[8]
+// the readings as the drivers handed them over and the micros() they were taken at, see sensorRaw_t.
+//
+// Flash log layout, sessions back to back from address 0:
+//   'H' version fieldCount motorCount rate looptime fieldSets  session header, all varints
+//   'I' iteration field...                                     absolute values
+//   'P' field...                                               deltas to the previous frame
+//   0xFF...                                                    padding to the next page at the end of a session
+// A page starting with 8 bytes of 0xFF can't be part of a frame, the first one marks the end of the log.
+//
+// Frames are staged in two RAM pages. The loop only ever fills RAM, a full page is handed to the background
+// task which programs it by DMA while the loop fills the other one. The DMA channels are shared with USART1 and
+// only taken at boot if blackbox_device is the flash and blackbox_rate is set, logging switched on later without
+// a reboot programs the pages polled from the background task instead.
+//
+// Serial stream, one packet per frame:
+//   0xA5 0x5A sequence length payload checksum
+// sequence counts every frame including dropped ones so the receiver can spot gaps, checksum is the XOR of
+// sequence, length and payload. The payload is a frame as above, keyframes repeat the 'H' header in front so a
+// receiver can join at any time. The port is handed back to MSP once disarmed and the buffer has drained.
+
+#ifdef BLACKBOX
+
+#define BLACKBOX_VERSION                2
+#define BLACKBOX_KEYFRAME_INTERVAL      32
+#define BLACKBOX_FIXED_FIELDS           17      // gyro[3], acc[3], rcCommand[4], axisPID[3], angle[2], vbat, cycleTime
+#define BLACKBOX_RAW_FIELDS             22      // gyroAt, gyro[3], acc[3], magAt, mag[3], baroAt, baro[2], rcData[8]
+#define BLACKBOX_FIELDS_RAW             (1 << 0)    // fieldSets bit
+#define BLACKBOX_MAX_FIELDS             (BLACKBOX_FIXED_FIELDS + BLACKBOX_RAW_FIELDS + MAX_MOTORS)
+#define BLACKBOX_MAX_HEADER             (1 + 6 * 5)
+#define BLACKBOX_MAX_FRAME              (BLACKBOX_MAX_HEADER + 6 + BLACKBOX_MAX_FIELDS * 5)  // header, marker, iteration, fields
+#define BLACKBOX_PACKET_HEAD            4
+#define BLACKBOX_SYNC1                  0xA5
+#define BLACKBOX_SYNC2                  0x5A
+#define BLACKBOX_ERASED_CHECK           8
+
+static uint8_t pages[2][M25P16_PAGE_SIZE];
+static volatile bool pageFull[2];
+static uint8_t fillPage;                        // page the loop is writing frames into
+static uint16_t fillPos;
+static uint8_t commitPage;                      // next page to program, pages are committed in order
+
+// frame being built, with room for the serial packet head in front and checksum behind
+static uint8_t frame[BLACKBOX_PACKET_HEAD + BLACKBOX_MAX_FRAME + 1];
+static uint16_t framePos;
+
+static bool present = false;                    // flash chip found
+static bool logging = false;
+static bool erasing = false;
+static uint8_t device;                          // blackbox_device latched for the session
+static serialPort_t *port;                      // serial port taken from MSP while streaming
+static uint32_t writeAddress;                   // where the next page goes in flash
+static uint32_t fieldCount;
+static uint8_t motorCount;
+static uint8_t rate;                            // blackbox_rate latched for the session
+static uint8_t fieldSets;                       // optional field sets logged this session
+static uint32_t iteration;
+static uint32_t framesSinceKeyframe;
+static uint8_t sequence;
+static uint32_t frameCount;
+static uint32_t droppedFrames;
+static bool needKeyframe;
+static bool needHeader;
+static int32_t previous[BLACKBOX_MAX_FIELDS];
+
+static void blackboxWriteByte(uint8_t value)
+{
+    frame[framePos++] = value;
+}
+
+static void blackboxWriteUnsigned(uint32_t value)
+{
+    while (value > 0x7F) {
+        blackboxWriteByte(value | 0x80);
+        value >>= 7;
+    }
+    blackboxWriteByte(value);
+}
+
+static void blackboxWriteSigned(int32_t value)
+{
+    // zigzag, small negative and positive values both end up in one byte
+    blackboxWriteUnsigned((uint32_t)(value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static void blackboxWriteHeader(void)
+{
+    blackboxWriteByte('H');
+    blackboxWriteUnsigned(BLACKBOX_VERSION);
+    blackboxWriteUnsigned(fieldCount);
+    blackboxWriteUnsigned(motorCount);
+    blackboxWriteUnsigned(rate);
+    blackboxWriteUnsigned(mcfg.looptime);
+    blackboxWriteUnsigned(fieldSets);
+}
+
+static uint32_t blackboxFlashFree(void)
+{
+    uint32_t free = 0, queued = writeAddress + fillPos;
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        if (pageFull[i])
+            queued += M25P16_PAGE_SIZE;
+        else
+            free += M25P16_PAGE_SIZE;
+    }
+    if (!pageFull[fillPage])
+        free -= fillPos;
+
+    // whatever is staged has to fit in the chip as well
+    if (queued >= M25P16_SIZE)
+        return 0;
+    return min(free, M25P16_SIZE - queued);
+}
+
+static void blackboxFlashWriteByte(uint8_t value)
+{
+    pages[fillPage][fillPos++] = value;
+    if (fillPos == M25P16_PAGE_SIZE) {
+        pageFull[fillPage] = true;
+        fillPage ^= 1;
+        fillPos = 0;
+    }
+}
+
+static bool blackboxFlashWrite(const uint8_t *data, uint32_t len)
+{
+    if (blackboxFlashFree() < len)
+        return false;
+    while (len--)
+        blackboxFlashWriteByte(*data++);
+    return true;
+}
+
+static bool blackboxSerialWrite(uint32_t len)
+{
+    uint8_t checksum;
+    uint32_t i;
+
+    // only a keyframe with the header and the raw set can get this long
+    if (len > 255)
+        return false;
+
+    frame[0] = BLACKBOX_SYNC1;
+    frame[1] = BLACKBOX_SYNC2;
+    frame[2] = sequence++;
+    frame[3] = len;
+    checksum = frame[2] ^ frame[3];
+    for (i = 0; i < len; i++)
+        checksum ^= frame[BLACKBOX_PACKET_HEAD + i];
+    frame[BLACKBOX_PACKET_HEAD + len] = checksum;
+
+    // all or nothing against the free TX space, which leaves out what DMA is still sending, so a packet never
+    // lands on top of one that is going out
+    return serialWriteBuf(port, frame, BLACKBOX_PACKET_HEAD + len + 1);
+}
+
+// hands the frame built after the packet head to the flash or serial port, false if there was no room
+static bool blackboxCommit(void)
+{
+    uint32_t len = framePos - BLACKBOX_PACKET_HEAD;
+
+    if (device == BLACKBOX_DEVICE_FLASH)
+        return blackboxFlashWrite(frame + BLACKBOX_PACKET_HEAD, len);
+    return blackboxSerialWrite(len);
+}
+
+static uint32_t blackboxGetFields(int32_t *values)
+{
+    uint32_t n = 0;
+    int i;
+
+    for (i = 0; i < 3; i++)
+        values[n++] = gyroADC[i];
+    for (i = 0; i < 3; i++)
+        values[n++] = accSmooth[i];
+    for (i = 0; i < 4; i++)
+        values[n++] = rcCommand[i];
+    for (i = 0; i < 3; i++)
+        values[n++] = axisPID[i];
+    for (i = 0; i < motorCount; i++)
+        values[n++] = motor[i];
+    values[n++] = angle[ROLL];
+    values[n++] = angle[PITCH];
+    values[n++] = vbat;
+    values[n++] = cycleTime;
+
+    if (fieldSets & BLACKBOX_FIELDS_RAW) {
+        values[n++] = sensorRaw.gyroAt;
+        for (i = 0; i < 3; i++)
+            values[n++] = sensorRaw.gyro[i];
+        for (i = 0; i < 3; i++)
+            values[n++] = sensorRaw.acc[i];
+        values[n++] = sensorRaw.magAt;
+        for (i = 0; i < 3; i++)
+            values[n++] = sensorRaw.mag[i];
+        values[n++] = sensorRaw.baroAt;
+        values[n++] = baroPressure;
+        values[n++] = baroTemperature;
+        for (i = 0; i < 8; i++)
+            values[n++] = rcData[i];
+    }
+    return n;
+}
+
+static serialPort_t *blackboxSerialPort(void)
+{
+    serialPort_t *serial = NULL;
+
+    if (mcfg.blackbox_device == BLACKBOX_DEVICE_SERIAL_MAIN)
+        serial = core.mainport;
+    else if (mcfg.blackbox_device == BLACKBOX_DEVICE_SERIAL_FLEX)
+        serial = core.flexport;
+
+    // telemetry keeps its port, the two would interleave
+    if (serial && feature(FEATURE_TELEMETRY) && core.telemport == serial)
+        serial = NULL;
+    return serial;
+}
+
+static void blackboxStart(void)
+{
+    device = mcfg.blackbox_device;
+    if (device == BLACKBOX_DEVICE_FLASH) {
+        if (!present || erasing)
+            return;
+    } else if (!port) {
+        // a port still draining the previous session is simply picked up again
+        port = blackboxSerialPort();
+        if (!port)
+            return;
+        serialSetBaudRate(port, mcfg.blackbox_baudrate);
+    }
+
+    motorCount = mixerMotorCount();
+    fieldSets = mcfg.blackbox_raw ? BLACKBOX_FIELDS_RAW : 0;
+    fieldCount = BLACKBOX_FIXED_FIELDS + motorCount + (fieldSets & BLACKBOX_FIELDS_RAW ? BLACKBOX_RAW_FIELDS : 0);
+    rate = mcfg.blackbox_rate;
+    iteration = 0;
+    needKeyframe = true;
+    needHeader = true;
+    logging = true;
+}
+
+static void blackboxStop(void)
+{
+    logging = false;
+    // pad the page being filled so the end of a session always lands on a page boundary. With no room left
+    // there's nothing to pad, the session simply ends at the last page.
+    if (device == BLACKBOX_DEVICE_FLASH && !pageFull[fillPage]) {
+        while (fillPos != 0)
+            blackboxFlashWriteByte(0xFF);
+    }
+}
+
+void blackboxInit(void)
+{
+    uint8_t head[BLACKBOX_ERASED_CHECK];
+    uint32_t low = 0, high = M25P16_SIZE / M25P16_PAGE_SIZE, mid;
+    int i;
+
+    if (!m25p16Init())
+        return;
+    present = true;
+
+    // a bulk erase keeps going through a reset, the log is empty once it's done
+    if (m25p16Busy()) {
+        erasing = true;
+        return;
+    }
+
+    // sessions are written back to back from the start, binary search for the first erased page
+    while (low < high) {
+        mid = (low + high) / 2;
+        m25p16Read(mid * M25P16_PAGE_SIZE, head, sizeof(head));
+        for (i = 0; i < BLACKBOX_ERASED_CHECK; i++)
+            if (head[i] != 0xFF)
+                break;
+        if (i == BLACKBOX_ERASED_CHECK)
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    writeAddress = low * M25P16_PAGE_SIZE;
+}
+
+// called at the end of every loop after the motors were written
+void blackboxLog(void)
+{
+    int32_t values[BLACKBOX_MAX_FIELDS];
+    uint32_t i, n;
+    bool keyframe;
+
+    if (!f.ARMED) {
+        if (logging)
+            blackboxStop();
+        return;
+    }
+
+    if (!logging) {
+        if (!mcfg.blackbox_rate)
+            return;
+        blackboxStart();
+        if (!logging)
+            return;
+    }
+
+    if (iteration++ % rate)
+        return;
+
+    n = blackboxGetFields(values);
+    keyframe = needKeyframe || framesSinceKeyframe + 1 >= BLACKBOX_KEYFRAME_INTERVAL;
+
+    framePos = BLACKBOX_PACKET_HEAD;
+    if (keyframe) {
+        // a serial receiver may have missed the start, so the stream repeats the header with every keyframe
+        if (needHeader || device != BLACKBOX_DEVICE_FLASH)
+            blackboxWriteHeader();
+        blackboxWriteByte('I');
+        blackboxWriteUnsigned(iteration - 1);
+        for (i = 0; i < n; i++)
+            blackboxWriteSigned(values[i]);
+    } else {
+        blackboxWriteByte('P');
+        for (i = 0; i < n; i++)
+            blackboxWriteSigned((uint32_t)values[i] - (uint32_t)previous[i]);      // the sample times wrap
+    }
+
+    if (!blackboxCommit()) {
+        droppedFrames++;
+        needKeyframe = true;
+        return;
+    }
+
+    if (keyframe) {
+        framesSinceKeyframe = 0;
+        needKeyframe = false;
+        needHeader = false;
+    } else {
+        framesSinceKeyframe++;
+    }
+    memcpy(previous, values, n * sizeof(int32_t));
+    frameCount++;
+}
+
+static void blackboxPageWritten(void)
+{
+    pageFull[commitPage] = false;
+    commitPage ^= 1;
+}
+
+// background task, hands full pages to the flash one at a time and gives the serial port back to MSP
+void blackboxUpdate(void)
+{
+    if (port && !logging && isSerialTransmitBufferEmpty(port)) {
+        serialSetBaudRate(port, mcfg.serial_baudrate);
+        port = NULL;
+    }
+
+    if (!present)
+        return;
+
+    if (erasing) {
+        if (!m25p16Busy()) {
+            erasing = false;
+            writeAddress = 0;
+        }
+        return;
+    }
+
+    if (!pageFull[commitPage] || writeAddress >= M25P16_SIZE)
+        return;
+
+    if (m25p16ProgramPage(writeAddress, pages[commitPage], M25P16_PAGE_SIZE, blackboxPageWritten))
+        writeAddress += M25P16_PAGE_SIZE;
+}
+
+// true while the port carries the serial stream, MSP leaves it alone until it's handed back
+bool blackboxOwnsPort(serialPort_t *serial)
+{
+    return port && port == serial;
+}
+
+bool blackboxErase(void)
+{
+    if (!present || f.ARMED || (logging && device == BLACKBOX_DEVICE_FLASH) || pageFull[0] || pageFull[1])
+        return false;
+    if (!m25p16EraseAll())
+        return false;
+
+    erasing = true;
+    frameCount = 0;
+    droppedFrames = 0;
+    return true;
+}
+
+// reads back the log, returns false while the flash is busy so the caller can try again later
+bool blackboxRead(uint32_t address, uint8_t *data, int len)
+{
+    if (!present || (logging && device == BLACKBOX_DEVICE_FLASH) || erasing || address + len > M25P16_SIZE)
+        return false;
+    return m25p16Read(address, data, len);
+}
+
+void blackboxGetStatus(blackboxStatus_t *status)
+{
+    status->present = present;
+    status->logging = logging;
+    status->erasing = erasing;
+    status->streaming = port != NULL;
+    status->size = present ? M25P16_SIZE : 0;
+    status->used = writeAddress;
+    status->frames = frameCount;
+    status->dropped = droppedFrames;
+}
+
+#else
+
+void blackboxInit(void)
+{
+}
+
+void blackboxLog(void)
+{
+}
+
+void blackboxUpdate(void)
+{
+}
+
+bool blackboxOwnsPort(serialPort_t *serial)
+{
+    (void)serial;
+    return false;
+}
+
+bool blackboxErase(void)
+{
+    return false;
+}
+
+bool blackboxRead(uint32_t address, uint8_t *data, int len)
+{
+    (void)address;
+    (void)data;
+    (void)len;
+    return false;
+}
+
+void blackboxGetStatus(blackboxStatus_t *status)
+{
+    memset(status, 0, sizeof(*status));
+}
+
+#endif
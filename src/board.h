@@ -15,8 +15,13 @@
 #include <string.h>
 #include <stdio.h>
 
+#ifdef SITL
+// host build, stand-ins for the few chip definitions the flight core uses
+#include "sitl.h"
+#else
 #include "stm32f10x_conf.h"
 #include "core_cm3.h"
+#endif
 
 #ifndef __CC_ARM
 // only need this garbage on gcc
@@ -27,6 +32,7 @@
 #include "drv_system.h"         // timers, delays, etc
 #include "drv_gpio.h"
 #include "utils.h"
+#include "fastmath.h"
 
 #ifndef M_PI
 #define M_PI       3.14159265358979323846f
@@ -40,9 +46,22 @@
 #define abs(x) ((x) > 0 ? (x) : -(x))
 
 // Chip Unique ID on F103
+#ifdef SITL
+#define U_ID_0 (0x4C544953) // "SITL"
+#define U_ID_1 (0)
+#define U_ID_2 (0)
+#else
 #define U_ID_0 (*(uint32_t*)0x1FFFF7E8)
 #define U_ID_1 (*(uint32_t*)0x1FFFF7EC)
 #define U_ID_2 (*(uint32_t*)0x1FFFF7F0)
+#endif
+
+// RAM the startup code doesn't clear, its contents survive a soft reset
+#ifdef SITL
+#define NOINIT __attribute__((section("sitl_noinit")))     // carried over the reset by drv_sitl.c
+#else
+#define NOINIT __attribute__((section(".noinit")))
+#endif
 
 
 typedef enum HardwareRevision {
@@ -79,6 +98,21 @@ typedef enum CompassSensors {
     MAG_NONE = 3
 } CompassSensors;
 
+// Type of gyro/baro found, remembered by the sensor detection cache
+typedef enum GyroSensors {
+    GYRO_NONE = 0,
+    GYRO_MPU6050 = 1,
+    GYRO_MPU6500 = 2,
+    GYRO_L3G4200D = 3,
+    GYRO_MPU3050 = 4
+} GyroSensors;
+
+typedef enum BaroSensors {
+    BARO_NONE = 0,
+    BARO_BMP085 = 1,
+    BARO_MS5611 = 2
+} BaroSensors;
+
 typedef enum {
     FEATURE_PPM = 1 << 0,
     FEATURE_VBAT = 1 << 1,
@@ -137,6 +171,13 @@ typedef enum {
     TELEMETRY_PORT_MAX = TELEMETRY_PORT_SOFTSERIAL_2
 } TelemetryPort;
 
+typedef enum {
+    BLACKBOX_DEVICE_FLASH = 0,
+    BLACKBOX_DEVICE_SERIAL_MAIN, // USART1, MSP is unavailable on it while armed
+    BLACKBOX_DEVICE_SERIAL_FLEX, // USART3, NAZE32_SP only
+    BLACKBOX_DEVICE_MAX = BLACKBOX_DEVICE_SERIAL_FLEX
+} BlackboxDevice;
+
 typedef enum {
     X = 0,
     Y,
@@ -158,33 +199,51 @@ typedef enum {
 enum {
     GYRO_UPDATED = 1 << 0,
     ACC_UPDATED = 1 << 1,
-    MAG_UPDATED = 1 << 2,
-    TEMP_UPDATED = 1 << 3
+    MAG_UPDATED = 1 << 2
 };
 
 typedef struct sensor_data_t {
     int16_t gyro[3];
     int16_t acc[3];
     int16_t mag[3];
-    float temperature;
     int updated;
 } sensor_data_t;
 
 typedef void (*sensorInitFuncPtr)(sensor_align_e align);   // sensor init prototype
 typedef void (*sensorReadFuncPtr)(int16_t *data);          // sensor read and align prototype
+typedef void (*sensorReadAllFuncPtr)(sensor_data_t *data); // combined read, sets the updated flags for what it filled in
+typedef void (*sensorPrefetchFuncPtr)(void);               // start the next read on the bus, called from the data ready interrupt
 typedef void (*baroOpFuncPtr)(void);                       // baro start operation
 typedef void (*baroCalculateFuncPtr)(int32_t *pressure, int32_t *temperature);             // baro calculation (filled params are pressure and temperature)
-typedef void (*serialReceiveCallbackPtr)(uint16_t data);   // used by serial drivers to return frames to app
+typedef void (*serialReceiveCallbackPtr)(const uint8_t *data, uint16_t len); // used by serial drivers to return frames to app
 typedef uint16_t (*rcReadRawDataPtr)(uint8_t chan);        // used by receiver driver to return channel data
 typedef void (*pidControllerFuncPtr)(void);                // pid controller function prototype
 
 typedef struct sensor_t {
     sensorInitFuncPtr init;                                 // initialize function
     sensorReadFuncPtr read;                                 // read 3 axis data function
-    sensorReadFuncPtr temperature;                          // read temperature if available
+    sensorReadFuncPtr temperature;                          // read temperature if available, whole degrees C
+    sensorReadAllFuncPtr readAll;                           // acc, gyro and temperature in one transaction, if the chip has them
+    sensorPrefetchFuncPtr prefetch;                         // queue the readAll transaction ahead of the loop, if the bus can
     float scale;                                            // scalefactor (currently used for gyro only, todo for accel)
 } sensor_t;
 
+typedef struct gyroFifoStats_t {
+    uint32_t overflowCount;                                 // FIFO overflows, queued samples were lost
+    uint16_t samples;                                       // samples averaged into the last gyro read
+    uint16_t sampleRate;                                    // gyro samples per second reaching the loop
+} gyroFifoStats_t;
+
+// readings as the drivers handed them over, before calibration offsets and filters, and when they were taken
+typedef struct sensorRaw_t {
+    uint32_t gyroAt;                                        // micros() just before the gyro read, acc follows it
+    uint32_t magAt;
+    uint32_t baroAt;                                        // baroPressure and baroTemperature are raw already
+    int16_t gyro[3];
+    int16_t acc[3];
+    int16_t mag[3];
+} sensorRaw_t;
+
 typedef struct baro_t {
     uint16_t ut_delay;
     uint16_t up_delay;
@@ -218,6 +277,7 @@ typedef struct baro_t {
 #define GPS
 #define LEDRING
 #define SONAR
+#define BLACKBOX
 #define BUZZER
 #define LED0
 #define LED1
@@ -242,6 +302,7 @@ typedef struct baro_t {
 #include "drv_ak8975.h"
 #include "drv_i2c.h"
 #include "drv_spi.h"
+#include "drv_m25p16.h"
 #include "drv_ledring.h"
 #include "drv_mma845x.h"
 #include "drv_mpu3050.h"
@@ -321,6 +382,40 @@ typedef struct baro_t {
 #include "drv_serial.h"
 #include "drv_uart.h"
 
+#elif defined(SITL)
+// Software in the loop, the flight core built for a Linux host. Sensors are simulated chips on a rigid body
+// quad model (sitl_model.c), serial ports are TCP sockets and the clock is simulated (drv_sitl.c)
+
+#define GYRO
+#define ACC
+#define MAG
+#define BARO
+#define GPS
+#define BLACKBOX
+#define MOTOR_PWM_RATE 400
+
+#define SENSORS_SET (SENSOR_ACC | SENSOR_BARO | SENSOR_MAG)
+#define I2C_DEVICE (I2CDEV_2)
+
+#include "drv_adc.h"
+#include "drv_adxl345.h"
+#include "drv_bmp085.h"
+#include "drv_ms5611.h"
+#include "drv_hmc5883l.h"
+#include "drv_ak8975.h"
+#include "drv_i2c.h"
+#include "drv_spi.h"
+#include "drv_m25p16.h"
+#include "drv_mpu3050.h"
+#include "drv_mpu6050.h"
+#include "drv_mpu6500.h"
+#include "drv_l3g4200d.h"
+#include "drv_pwm.h"
+#include "drv_timer.h"
+#include "drv_serial.h"
+#include "drv_uart.h"
+#include "drv_softserial.h"
+
 #else
 #error TARGET NOT DEFINED!
 #endif /* all conditions */
@@ -331,9 +426,9 @@ typedef struct baro_t {
 #define LED0_OFF                 digitalHi(LED0_GPIO, LED0_PIN);
 #define LED0_ON                  digitalLo(LED0_GPIO, LED0_PIN);
 #else
-#define LED0_TOGGLE
-#define LED0_OFF
-#define LED0_ON
+#define LED0_TOGGLE              do {} while (0)
+#define LED0_OFF                 do {} while (0)
+#define LED0_ON                  do {} while (0)
 #endif
 
 #ifdef LED1
@@ -341,9 +436,9 @@ typedef struct baro_t {
 #define LED1_OFF                 digitalHi(LED1_GPIO, LED1_PIN);
 #define LED1_ON                  digitalLo(LED1_GPIO, LED1_PIN);
 #else
-#define LED1_TOGGLE
-#define LED1_OFF
-#define LED1_ON
+#define LED1_TOGGLE              do {} while (0)
+#define LED1_OFF                 do {} while (0)
+#define LED1_ON                  do {} while (0)
 #endif
 
 #ifdef BEEP_GPIO
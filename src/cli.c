@@ -21,6 +21,9 @@ static void cliHelp(char *cmdline);
 static void cliMap(char *cmdline);
 static void cliMixer(char *cmdline);
 static void cliMotor(char *cmdline);
+#ifdef PROFILING
+static void cliPerf(char *cmdline);
+#endif
 static void cliProfile(char *cmdline);
 static void cliSave(char *cmdline);
 static void cliSet(char *cmdline);
@@ -101,6 +104,9 @@ const clicmd_t cmdTable[] = {
     { "map", "mapping of rc channel order", cliMap },
     { "mixer", "mixer name or list", cliMixer },
     { "motor", "get/set motor output value", cliMotor },
+#ifdef PROFILING
+    { "perf", "show and reset loop profiler cycle counts", cliPerf },
+#endif
     { "profile", "index (0 to 2)", cliProfile },
     { "save", "save and reboot", cliSave },
     { "set", "name=value or blank or * for list", cliSet },
@@ -128,6 +134,8 @@ typedef struct {
 
 const clivalue_t valueTable[] = {
     { "looptime", VAR_UINT16, &mcfg.looptime, 0, 9000 },
+    { "gyro_sync", VAR_UINT8, &mcfg.gyro_sync, 0, 1 },
+    { "gyro_fifo", VAR_UINT8, &mcfg.gyro_fifo, 0, 1 },
     { "emf_avoidance", VAR_UINT8, &mcfg.emf_avoidance, 0, 1 },
     { "midrc", VAR_UINT16, &mcfg.midrc, 1200, 1700 },
     { "minthrottle", VAR_UINT16, &mcfg.minthrottle, 0, 2000 },
@@ -162,6 +170,10 @@ const clivalue_t valueTable[] = {
     { "telemetry_provider", VAR_UINT8, &mcfg.telemetry_provider, 0, TELEMETRY_PROVIDER_MAX },
     { "telemetry_port", VAR_UINT8, &mcfg.telemetry_port, 0, TELEMETRY_PORT_MAX },
     { "telemetry_switch", VAR_UINT8, &mcfg.telemetry_switch, 0, 1 },
+    { "blackbox_rate", VAR_UINT8, &mcfg.blackbox_rate, 0, 32 },
+    { "blackbox_device", VAR_UINT8, &mcfg.blackbox_device, 0, BLACKBOX_DEVICE_MAX },
+    { "blackbox_baudrate", VAR_UINT32, &mcfg.blackbox_baudrate, 9600, 1000000 },
+    { "blackbox_raw", VAR_UINT8, &mcfg.blackbox_raw, 0, 1 },
     { "vbatscale", VAR_UINT8, &mcfg.vbatscale, 10, 200 },
     { "currentscale", VAR_UINT16, &mcfg.currentscale, 1, 10000 },
     { "currentoffset", VAR_UINT16, &mcfg.currentoffset, 0, 1650 },
@@ -181,8 +193,17 @@ const clivalue_t valueTable[] = {
     { "max_angle_inclination", VAR_UINT16, &mcfg.max_angle_inclination, 100, 900 },
     { "moron_threshold", VAR_UINT8, &mcfg.moron_threshold, 0, 128 },
     { "gyro_lpf", VAR_UINT16, &mcfg.gyro_lpf, 0, 256 },
+    { "gyro_soft_lpf", VAR_UINT16, &mcfg.gyro_soft_lpf, 0, 500 },
+    { "gyro_notch1_hz", VAR_UINT16, &mcfg.gyro_notch1_hz, 0, 500 },
+    { "gyro_notch1_bw", VAR_UINT16, &mcfg.gyro_notch1_bw, 1, 500 },
+    { "gyro_notch2_hz", VAR_UINT16, &mcfg.gyro_notch2_hz, 0, 500 },
+    { "gyro_notch2_bw", VAR_UINT16, &mcfg.gyro_notch2_bw, 1, 500 },
     { "gyro_cmpf_factor", VAR_UINT16, &mcfg.gyro_cmpf_factor, 100, 1000 },
     { "gyro_cmpfm_factor", VAR_UINT16, &mcfg.gyro_cmpfm_factor, 100, 1000 },
+    { "acc_fusion_divider", VAR_UINT8, &mcfg.acc_fusion_divider, 1, 32 },
+    { "imu_algorithm", VAR_UINT8, &mcfg.imu_algorithm, 0, 1 },
+    { "imu_kp", VAR_UINT16, &mcfg.imu_kp, 0, 20000 },
+    { "imu_ki", VAR_UINT16, &mcfg.imu_ki, 0, 20000 },
     { "pid_controller", VAR_UINT8, &cfg.pidController, 0, 1 },
     { "deadband", VAR_UINT8, &cfg.deadband, 0, 32 },
     { "yawdeadband", VAR_UINT8, &cfg.yawdeadband, 0, 100 },
@@ -198,6 +219,9 @@ const clivalue_t valueTable[] = {
     { "yaw_rate", VAR_UINT8, &cfg.yawRate, 0, 100 },
     { "tpa_rate", VAR_UINT8, &cfg.dynThrPID, 0, 100},
     { "tpa_breakpoint", VAR_UINT16, &cfg.tpa_breakpoint, 1000, 2000},
+    { "dterm_lpf", VAR_UINT16, &cfg.dterm_lpf, 0, 500 },
+    { "dterm_notch_hz", VAR_UINT16, &cfg.dterm_notch_hz, 0, 500 },
+    { "dterm_notch_bw", VAR_UINT16, &cfg.dterm_notch_bw, 1, 500 },
     { "failsafe_delay", VAR_UINT8, &cfg.failsafe_delay, 0, 200 },
     { "failsafe_off_delay", VAR_UINT8, &cfg.failsafe_off_delay, 0, 200 },
     { "failsafe_throttle", VAR_UINT16, &cfg.failsafe_throttle, 1000, 2000 },
@@ -577,6 +601,7 @@ static void cliDefaults(char *cmdline)
     (void)cmdline;
     cliPrint("Resetting to defaults...\r\n");
     checkFirstTime(true);
+    configStoreFlush();
     cliPrint("Rebooting...");
     delay(10);
     systemReset(false);
@@ -852,6 +877,23 @@ static void cliMotor(char *cmdline)
     motor_disarmed[motor_index] = motor_value;
 }
 
+#ifdef PROFILING
+static void cliPerf(char *cmdline)
+{
+    (void)cmdline;
+    uint32_t i, len;
+
+    printf("Section        min      avg      max    count  (cycles @ %dMHz)\r\n", SystemCoreClock / 1000000);
+    for (i = 0; i < PERF_SECTION_COUNT; i++) {
+        printf("%s", perfSectionNames[i]);
+        for (len = strlen(perfSectionNames[i]); len < 10; len++)
+            cliWrite(' ');
+        printf("%8d %8d %8d %8d\r\n", perfSections[i].min, perfAverage(i), perfSections[i].max, perfSections[i].count);
+    }
+    perfReset();
+}
+#endif
+
 static void cliProfile(char *cmdline)
 {
     uint8_t len;
@@ -876,6 +918,7 @@ static void cliSave(char *cmdline)
     (void)cmdline;
     cliPrint("Saving...");
     writeEEPROM(0, true);
+    configStoreFlush();
     cliPrint("\r\nRebooting...");
     delay(10);
     systemReset(false);
@@ -1016,6 +1059,11 @@ static void cliStatus(char *cmdline)
     (void)cmdline;
     uint8_t i;
     uint32_t mask;
+    uint32_t len;
+    i2cStats_t i2c;
+#ifndef CJMCU
+    spiStats_t spi;
+#endif
 
     printf("System Uptime: %d seconds, Voltage: %d * 0.1V (%dS battery)\r\n",
         millis() / 1000, vbat, batteryCellCount);
@@ -1036,6 +1084,20 @@ static void cliStatus(char *cmdline)
     cliPrint("\r\n");
 
     printf("Cycle Time: %d, I2C Errors: %d, config size: %d\r\n", cycleTime, i2cGetErrorCounter(), sizeof(master_t));
+    i2cGetStats(&i2c);
+    printf("I2C: %u jobs, %d bus errors, %dus avg, queue %d/%d\r\n", i2c.transactions, i2c.busErrors, i2c.averageTime, i2c.queueDepth, i2c.maxQueueDepth);
+#ifndef CJMCU
+    spiGetStats(&spi);
+    printf("SPI: %u polled, %u DMA (%s), %u bytes, %d rejected\r\n", spi.transfers, spi.dmaTransfers, spiDmaActive() ? "on" : "off", spi.bytes, spi.dmaRejected);
+#endif
+
+    cliPrint("Task      rate/s avg/us max/us  late\r\n");
+    for (i = 0; i < TASK_COUNT; i++) {
+        printf("%s", tasks[i].name);
+        for (len = strlen(tasks[i].name); len < 10; len++)
+            cliWrite(' ');
+        printf("%6d %6d %6d %5d\r\n", schedulerTaskRate(&tasks[i]), tasks[i].averageExecutionTime >> 4, tasks[i].maxExecutionTime, tasks[i].lateCount);
+    }
 }
 
 static void cliVersion(char *cmdline)
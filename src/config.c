@@ -7,32 +7,17 @@
 #include "mw.h"
 #include <string.h>
 
-#define ASSERT_CONCAT_(a, b) a##b
-#define ASSERT_CONCAT(a, b) ASSERT_CONCAT_(a, b)
-#define ct_assert(e) enum { ASSERT_CONCAT(assert_line_, __LINE__) = 1/(!!(e)) }
-
-// define this symbol to increase or decrease flash size. not rely on flash_size_register.
-#ifndef FLASH_PAGE_COUNT
-#define FLASH_PAGE_COUNT 128
-#endif
-
-#define FLASH_PAGE_SIZE                 ((uint16_t)0x400)
-// if sizeof(mcfg) is over this number, compile-time error will occur. so, need to add another page to config data.
-#define CONFIG_SIZE                     (FLASH_PAGE_SIZE * 2)
-
 master_t mcfg;  // master config struct with data independent from profiles
 config_t cfg;   // profile config struct
 const char rcChannelLetters[] = "AERT1234";
 
-static const uint8_t EEPROM_CONF_VERSION = 69;
+static const uint8_t EEPROM_CONF_VERSION = 78;
 static uint32_t enabledSensors = 0;
 static void resetConf(void);
-static const uint32_t FLASH_WRITE_ADDR = 0x08000000 + (FLASH_PAGE_SIZE * (FLASH_PAGE_COUNT - (CONFIG_SIZE / 1024)));
 
 void initEEPROM(void)
 {
-    // make sure (at compile time) that config struct doesn't overflow allocated flash pages
-    ct_assert(sizeof(mcfg) < CONFIG_SIZE);
+    configStoreInit();
 }
 
 void parseRcChannels(const char *input)
@@ -48,10 +33,14 @@ void parseRcChannels(const char *input)
 
 static uint8_t validEEPROM(void)
 {
-    const master_t *temp = (const master_t *)FLASH_WRITE_ADDR;
+    const master_t *temp = &mcfg;
     const uint8_t *p;
     uint8_t chk = 0;
 
+    // replay the newest committed config from the store, mcfg is overwritten either way by the callers
+    if (!configStoreLoad(&mcfg))
+        return 0;
+
     // check version number
     if (EEPROM_CONF_VERSION != temp->version)
         return 0;
@@ -60,7 +49,7 @@ static uint8_t validEEPROM(void)
     if (temp->size != sizeof(master_t) || temp->magic_be != 0xBE || temp->magic_ef != 0xEF)
         return 0;
 
-    // verify integrity of temporary copy
+    // verify integrity of the replayed copy
     for (p = (const uint8_t *)temp; p < ((const uint8_t *)temp + sizeof(master_t)); p++)
         chk ^= *p;
 
@@ -74,12 +63,10 @@ static uint8_t validEEPROM(void)
 
 void readEEPROM(void)
 {
-    // Sanity check
-    if (!validEEPROM())
+    // Sanity check and read flash. a save still being written is newer than flash, and already in mcfg
+    if (!configStoreBusy() && !validEEPROM())
         failureMode(10);
 
-    // Read flash
-    memcpy(&mcfg, (char *)FLASH_WRITE_ADDR, sizeof(master_t));
     // Copy current profile
     if (mcfg.current_profile > 2) // sanity check
         mcfg.current_profile = 0;
@@ -104,6 +91,7 @@ void activateConfig(void)
     }
 
     setPIDController(cfg.pidController);
+    filterInit();
 #ifdef GPS
     gpsSetPIDs();
 #endif
@@ -117,16 +105,11 @@ void loadAndActivateConfig(void)
 
 void writeEEPROM(uint8_t b, uint8_t updateProfile)
 {
-    FLASH_Status status;
-    uint8_t chk = 0;
-    const uint8_t *p;
-
     // prepare checksum/version constants
     mcfg.version = EEPROM_CONF_VERSION;
     mcfg.size = sizeof(master_t);
     mcfg.magic_be = 0xBE;
     mcfg.magic_ef = 0xEF;
-    mcfg.chk = 0;
 
     // when updateProfile = true, we copy contents of cfg to global configuration. when false, only profile number is updated, and then that profile is loaded on readEEPROM()
     if (updateProfile) {
@@ -134,31 +117,10 @@ void writeEEPROM(uint8_t b, uint8_t updateProfile)
         memcpy(&mcfg.profile[mcfg.current_profile], &cfg, sizeof(config_t));
     }
 
-    // recalculate checksum before writing
-    for (p = (const uint8_t *)&mcfg; p < ((const uint8_t *)&mcfg + sizeof(master_t)); p++)
-        chk ^= *p;
-    mcfg.chk = chk;
-
-    // write it
-    FLASH_Unlock();
-    for (unsigned int tries = 3; tries; tries--) {
-        FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
-
-        FLASH_ErasePage(FLASH_WRITE_ADDR);
-        status = FLASH_ErasePage(FLASH_WRITE_ADDR + FLASH_PAGE_SIZE);
-        for (unsigned int i = 0; i < sizeof(master_t) && status == FLASH_COMPLETE; i += 4)
-            status = FLASH_ProgramWord(FLASH_WRITE_ADDR + i, *(uint32_t *)((char *)&mcfg + i));
-        if (status == FLASH_COMPLETE)
-            break;
-    }
-    FLASH_Lock();
-
-    // Flash write failed - just die now
-    if (status != FLASH_COMPLETE || !validEEPROM()) {
-        failureMode(10);
-    }
+    // write it. the background task computes the checksum and appends whatever changed to the config log
+    configStoreSave();
 
-    // re-read written data
+    // pick up the (possibly changed) profile
     loadAndActivateConfig();
     if (b)
         blinkLED(15, 20, 1);
@@ -197,7 +159,16 @@ static void resetConf(void)
     mcfg.current_profile = 0;       // default profile
     mcfg.gyro_cmpf_factor = 600;    // default MWC
     mcfg.gyro_cmpfm_factor = 250;   // default MWC
+    mcfg.acc_fusion_divider = 1;
+    mcfg.imu_algorithm = IMU_COMPLEMENTARY;
+    mcfg.imu_kp = 2500;
+    mcfg.imu_ki = 0;
     mcfg.gyro_lpf = 42;             // supported by all gyro drivers now. In case of ST gyro, will default to 32Hz instead
+    mcfg.gyro_soft_lpf = 0;
+    mcfg.gyro_notch1_hz = 0;
+    mcfg.gyro_notch1_bw = 40;
+    mcfg.gyro_notch2_hz = 0;
+    mcfg.gyro_notch2_bw = 40;
     mcfg.accZero[0] = 0;
     mcfg.accZero[1] = 0;
     mcfg.accZero[2] = 0;
@@ -222,6 +193,10 @@ static void resetConf(void)
     mcfg.telemetry_provider = TELEMETRY_PROVIDER_FRSKY;
     mcfg.telemetry_port = TELEMETRY_PORT_UART;
     mcfg.telemetry_switch = 0;
+    mcfg.blackbox_rate = 0;
+    mcfg.blackbox_device = BLACKBOX_DEVICE_FLASH;
+    mcfg.blackbox_baudrate = 250000;
+    mcfg.blackbox_raw = 0;
     mcfg.midrc = 1500;
     mcfg.mincheck = 1100;
     mcfg.maxcheck = 1900;
@@ -252,6 +227,8 @@ static void resetConf(void)
     mcfg.softserial_1_inverted = 0;
     mcfg.softserial_2_inverted = 0;
     mcfg.looptime = 3500;
+    mcfg.gyro_sync = 0;
+    mcfg.gyro_fifo = 0;
     mcfg.emf_avoidance = 0;
     mcfg.rssi_aux_channel = 0;
     mcfg.rssi_adc_max = 4095;
@@ -291,6 +268,9 @@ static void resetConf(void)
     cfg.yawRate = 0;
     cfg.dynThrPID = 0;
     cfg.tpa_breakpoint = 1500;
+    cfg.dterm_lpf = 0;
+    cfg.dterm_notch_hz = 0;
+    cfg.dterm_notch_bw = 40;
     cfg.thrMid8 = 50;
     cfg.thrExpo8 = 0;
     // for (i = 0; i < CHECKBOXITEMS; i++)
@@ -0,0 +1,481 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+#include <string.h>
+
+// Log-structured config storage. The reserved flash is split into two banks. The active bank starts with a
+// full snapshot of master_t, every save after that appends only the byte ranges that changed followed by a
+// commit record. When the active bank is full the config is compacted into the other bank as a new snapshot,
+// and the bank header is written last so a half written bank is never picked up.
+//
+// Records are programmed a few halfwords per run of the background task, straight out of mcfg: there is no RAM
+// for a second copy of it. mcfg can change while a save is being written, so a save is only committed once the
+// records written so far reproduce mcfg byte for byte, whatever changed in the meantime is appended first.
+// Erasing a page stalls the flash bus for ~20ms on this part whatever we do, so the erase needed for compaction
+// waits until the craft is disarmed.
+
+#define ASSERT_CONCAT_(a, b) a##b
+#define ASSERT_CONCAT(a, b) ASSERT_CONCAT_(a, b)
+#define ct_assert(e) enum { ASSERT_CONCAT(assert_line_, __LINE__) = 1/(!!(e)) }
+
+// define this symbol to increase or decrease flash size. not rely on flash_size_register.
+#ifndef FLASH_PAGE_COUNT
+#define FLASH_PAGE_COUNT 128
+#endif
+
+#define FLASH_PAGE_SIZE                 ((uint16_t)0x400)
+#define CONFIG_BANK_PAGES               2
+#define CONFIG_BANK_SIZE                (FLASH_PAGE_SIZE * CONFIG_BANK_PAGES)
+// two banks at the end of flash, the FLASH length in stm32_flash.ld must leave room for them
+#define CONFIG_SIZE                     (CONFIG_BANK_SIZE * 2)
+#define CONFIG_STORE_ADDR               (0x08000000 + FLASH_PAGE_SIZE * FLASH_PAGE_COUNT - CONFIG_SIZE)
+
+#define CONFIG_BANK_MAGIC               0xC0F5
+#define CONFIG_BANK_HEADER              8       // magic, sequence, size and crc halfwords
+#define CONFIG_RECORD_OVERHEAD          6       // offset, length and crc halfwords around the data
+#define CONFIG_RECORD_COMMIT            0xFFF0  // record offset marking the end of a save
+#define CONFIG_RECORD_MERGE_GAP         8       // changed ranges closer than this go into one record
+#define CONFIG_STORE_WRITES_PER_RUN     4       // halfwords programmed per background run, ~50us each
+#define CONFIG_STORE_MAX_FAILURES       3
+
+typedef struct configBank_t {
+    uintptr_t base;                     // flash address of the bank
+    uint16_t sequence;                  // generation, the valid bank with the newest one is active
+    uint16_t commitEnd;                 // end of the last commit record, what a load replays
+    uint16_t freeStart;                 // where the next record goes, CONFIG_BANK_SIZE when the tail is unusable
+    bool valid;
+} configBank_t;
+
+typedef enum {
+    STORE_IDLE = 0,
+    STORE_ERASE,                        // erasing the other bank before compacting into it
+    STORE_PROGRAM,                      // appending records
+} storeState_e;
+
+static configBank_t banks[2];
+static configBank_t *activeBank;
+
+static storeState_e storeState;
+static bool saveRequested;
+static bool forceCompact;
+static uint8_t storeFailures;
+
+// bytes of mcfg that differ from what the log gives
+static uint8_t dirty[(sizeof(master_t) + 7) / 8];
+static uint16_t diffPos;
+
+static configBank_t *writeBank;
+static uint16_t writePos;
+static uint16_t writeSequence;
+static uint8_t erasePage;
+static bool compacting;
+
+// record being programmed
+static uint16_t recOffset;
+static uint16_t recLength;
+static uint16_t recIndex;
+static uint16_t recCrc;
+
+static uint16_t crc16(uint16_t crc, const uint8_t *data, uint16_t length)
+{
+    int i;
+
+    // CRC-16/CCITT, bitwise to keep flash use down
+    while (length--) {
+        crc ^= (uint16_t)*data++ << 8;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+static uint16_t storeRead(const configBank_t *bank, uint16_t pos)
+{
+    return *(const uint16_t *)(bank->base + pos);
+}
+
+static void storeScan(configBank_t *bank)
+{
+    const uint8_t *flash = (const uint8_t *)bank->base;
+    uint16_t pos = CONFIG_BANK_HEADER;
+    uint16_t offset, length;
+
+    bank->valid = false;
+    bank->commitEnd = 0;
+    bank->freeStart = CONFIG_BANK_SIZE;
+
+    if (storeRead(bank, 0) != CONFIG_BANK_MAGIC || storeRead(bank, 4) != sizeof(master_t) || storeRead(bank, 6) != crc16(0xFFFF, flash, 6))
+        return;
+    bank->sequence = storeRead(bank, 2);
+
+    while (pos + CONFIG_RECORD_OVERHEAD <= CONFIG_BANK_SIZE) {
+        offset = storeRead(bank, pos);
+        length = storeRead(bank, pos + 2);
+        if (offset == 0xFFFF) {
+            // erased, end of the log. anything left uncommitted by a power loss forces a compaction
+            if (pos == bank->commitEnd)
+                bank->freeStart = pos;
+            break;
+        }
+
+        if (offset == CONFIG_RECORD_COMMIT) {
+            if (length != 0 || pos == CONFIG_BANK_HEADER)
+                break;
+        } else {
+            // the first record must be the full snapshot
+            if ((length & 1) || offset + length > sizeof(master_t) || pos + CONFIG_RECORD_OVERHEAD + length > CONFIG_BANK_SIZE)
+                break;
+            if (pos == CONFIG_BANK_HEADER && (offset != 0 || length != sizeof(master_t)))
+                break;
+        }
+
+        if (storeRead(bank, pos + 4 + length) != crc16(0xFFFF, flash + pos, 4 + length))
+            break;
+
+        pos += CONFIG_RECORD_OVERHEAD + length;
+        if (offset == CONFIG_RECORD_COMMIT)
+            bank->commitEnd = pos;
+    }
+
+    bank->valid = bank->commitEnd != 0;
+}
+
+// walks the records before end oldest first, either loading them into image or marking where image differs
+static void storeReplay(const configBank_t *bank, uint16_t end, uint8_t *image, bool diff)
+{
+    const uint8_t *data;
+    uint16_t pos = CONFIG_BANK_HEADER;
+    uint16_t offset, length, i;
+
+    while (pos < end) {
+        offset = storeRead(bank, pos);
+        length = storeRead(bank, pos + 2);
+        if (offset != CONFIG_RECORD_COMMIT) {
+            data = (const uint8_t *)(bank->base + pos + 4);
+            for (i = 0; i < length; i++) {
+                if (!diff)
+                    image[offset + i] = data[i];
+                else if (data[i] != image[offset + i])
+                    dirty[(offset + i) >> 3] |= 1 << ((offset + i) & 7);
+                else
+                    dirty[(offset + i) >> 3] &= ~(1 << ((offset + i) & 7));
+            }
+        }
+        pos += CONFIG_RECORD_OVERHEAD + length;
+    }
+}
+
+// marks the bytes of mcfg the records before end don't reproduce
+static void storeDiff(const configBank_t *bank, uint16_t end)
+{
+    memset(dirty, 0, sizeof(dirty));
+    storeReplay(bank, end, (uint8_t *)&mcfg, true);
+}
+
+static bool isDirty(uint16_t i)
+{
+    return dirty[i >> 3] & (1 << (i & 7));
+}
+
+// next range of changed bytes from diffPos, rounded out to halfwords
+static bool storeNextRun(uint16_t *offset, uint16_t *length)
+{
+    uint16_t i, last;
+
+    while (diffPos < sizeof(master_t) && !isDirty(diffPos))
+        diffPos++;
+    if (diffPos >= sizeof(master_t))
+        return false;
+
+    last = diffPos;
+    for (i = diffPos; i < sizeof(master_t) && i - last <= CONFIG_RECORD_MERGE_GAP; i++) {
+        if (isDirty(i))
+            last = i;
+    }
+
+    *offset = diffPos & ~1;
+    *length = ((last + 2) & ~1) - *offset;
+    diffPos = *offset + *length;
+    return true;
+}
+
+static void storeStartRecord(uint16_t offset, uint16_t length)
+{
+    recOffset = offset;
+    recLength = length;
+    recIndex = 0;
+    recCrc = 0xFFFF;
+}
+
+static uint16_t storeRecordWord(void)
+{
+    const uint8_t *image = (const uint8_t *)&mcfg;
+    uint16_t word;
+
+    if (recIndex == 0)
+        word = recOffset;
+    else if (recIndex == 1)
+        word = recLength;
+    else if (recIndex < 2 + recLength / 2)
+        word = image[recOffset + (recIndex - 2) * 2] | (image[recOffset + (recIndex - 2) * 2 + 1] << 8);
+    else
+        word = recCrc;
+
+    recCrc = crc16(recCrc, (const uint8_t *)&word, 2);
+    recIndex++;
+    return word;
+}
+
+static bool storeProgram(uint16_t pos, uint16_t word)
+{
+    FLASH_Status status;
+
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+    status = FLASH_ProgramHalfWord(writeBank->base + pos, word);
+    FLASH_Lock();
+
+    return status == FLASH_COMPLETE && storeRead(writeBank, pos) == word;
+}
+
+static void storeFail(void)
+{
+    // same 3 tries the old erase/program loop had, each retry rewrites the whole config into the other bank
+    if (++storeFailures >= CONFIG_STORE_MAX_FAILURES)
+        failureMode(10);
+
+    forceCompact = true;
+    saveRequested = true;
+    storeState = STORE_IDLE;
+}
+
+// the bank ran out of room for a save that kept changing, start over with a snapshot in the other bank
+static void storeRestart(void)
+{
+    forceCompact = true;
+    saveRequested = true;
+    storeState = STORE_IDLE;
+}
+
+// checksum is redone every time as mcfg may have changed since the save was asked for
+static void storeSeal(void)
+{
+    const uint8_t *p;
+    uint8_t chk = 0;
+
+    mcfg.chk = 0;
+    for (p = (const uint8_t *)&mcfg; p < ((const uint8_t *)&mcfg + sizeof(master_t)); p++)
+        chk ^= *p;
+    mcfg.chk = chk;
+}
+
+static void storeBegin(void)
+{
+    uint16_t offset, length, needed = CONFIG_RECORD_OVERHEAD;
+
+    storeSeal();
+
+    if (activeBank && !forceCompact) {
+        storeDiff(activeBank, activeBank->commitEnd);
+
+        diffPos = 0;
+        while (storeNextRun(&offset, &length))
+            needed += CONFIG_RECORD_OVERHEAD + length;
+        if (needed == CONFIG_RECORD_OVERHEAD)
+            return;
+
+        if (activeBank->freeStart + needed <= CONFIG_BANK_SIZE) {
+            writeBank = activeBank;
+            writePos = activeBank->freeStart;
+            compacting = false;
+            diffPos = 0;
+            storeNextRun(&offset, &length);
+            storeStartRecord(offset, length);
+            storeState = STORE_PROGRAM;
+            return;
+        }
+    }
+
+    // compact: a full snapshot into the other bank
+    writeBank = activeBank == &banks[0] ? &banks[1] : &banks[0];
+    writeSequence = activeBank ? activeBank->sequence + 1 : 0;
+    erasePage = 0;
+    compacting = true;
+    forceCompact = false;
+    storeState = STORE_ERASE;
+}
+
+static void storeFinish(void)
+{
+    uint16_t header[4];
+    int i;
+
+    if (compacting) {
+        header[0] = CONFIG_BANK_MAGIC;
+        header[1] = writeSequence;
+        header[2] = sizeof(master_t);
+        header[3] = crc16(0xFFFF, (const uint8_t *)header, 6);
+        // magic last, that is what makes the new bank valid
+        for (i = 3; i >= 0; i--) {
+            if (!storeProgram(i * 2, header[i])) {
+                storeFail();
+                return;
+            }
+        }
+        writeBank->sequence = writeSequence;
+        writeBank->valid = true;
+        activeBank = writeBank;
+    }
+
+    activeBank->commitEnd = writePos;
+    activeBank->freeStart = writePos;
+    storeFailures = 0;
+    storeState = STORE_IDLE;
+}
+
+// Commits the save if the records written so far give mcfg, or starts on what they don't. Checking and
+// writing the commit record happen in one go, nothing gets to change mcfg in between
+static void storeCommit(void)
+{
+    uint16_t offset, length;
+    int i;
+
+    storeSeal();
+    storeDiff(writeBank, writePos);
+    diffPos = 0;
+    if (storeNextRun(&offset, &length)) {
+        storeStartRecord(offset, length);
+        return;
+    }
+
+    storeStartRecord(CONFIG_RECORD_COMMIT, 0);
+    for (i = 0; i < CONFIG_RECORD_OVERHEAD / 2; i++) {
+        if (!storeProgram(writePos, storeRecordWord())) {
+            storeFail();
+            return;
+        }
+        writePos += 2;
+    }
+    storeFinish();
+}
+
+static void storeStep(void)
+{
+    uint16_t offset, length;
+
+    // the record and a commit behind it have to fit, only records of a save that kept changing can run out
+    if (recIndex == 0 && writePos + 2 * CONFIG_RECORD_OVERHEAD + recLength > CONFIG_BANK_SIZE) {
+        storeRestart();
+        return;
+    }
+
+    if (!storeProgram(writePos, storeRecordWord())) {
+        storeFail();
+        return;
+    }
+    writePos += 2;
+
+    if (recIndex < 3 + recLength / 2)
+        return;
+
+    if (storeNextRun(&offset, &length))
+        storeStartRecord(offset, length);
+    else
+        storeCommit();
+}
+
+static void storeRun(bool blocking)
+{
+    FLASH_Status status;
+    int i;
+
+    switch (storeState) {
+    case STORE_IDLE:
+        if (saveRequested) {
+            saveRequested = false;
+            storeBegin();
+        }
+        break;
+
+    case STORE_ERASE:
+        // the whole cpu stalls while a page erases, never do it in flight
+        if (f.ARMED && !blocking)
+            break;
+        FLASH_Unlock();
+        FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+        status = FLASH_ErasePage(writeBank->base + erasePage * FLASH_PAGE_SIZE);
+        FLASH_Lock();
+        if (status != FLASH_COMPLETE) {
+            storeFail();
+            break;
+        }
+        if (++erasePage == CONFIG_BANK_PAGES) {
+            writeBank->valid = false;
+            writePos = CONFIG_BANK_HEADER;
+            storeStartRecord(0, sizeof(master_t));
+            diffPos = sizeof(master_t);
+            storeState = STORE_PROGRAM;
+        }
+        break;
+
+    case STORE_PROGRAM:
+        for (i = 0; i < CONFIG_STORE_WRITES_PER_RUN && storeState == STORE_PROGRAM; i++)
+            storeStep();
+        break;
+    }
+}
+
+void configStoreInit(void)
+{
+    // make sure (at compile time) that a snapshot of the config struct and its commit fit in one bank
+    ct_assert(sizeof(master_t) % 2 == 0 && CONFIG_BANK_HEADER + 2 * CONFIG_RECORD_OVERHEAD + sizeof(master_t) <= CONFIG_BANK_SIZE);
+
+    storeState = STORE_IDLE;
+    saveRequested = false;
+    forceCompact = false;
+    storeFailures = 0;
+
+    banks[0].base = CONFIG_STORE_ADDR;
+    banks[1].base = CONFIG_STORE_ADDR + CONFIG_BANK_SIZE;
+    storeScan(&banks[0]);
+    storeScan(&banks[1]);
+
+    activeBank = NULL;
+    if (banks[0].valid)
+        activeBank = &banks[0];
+    if (banks[1].valid && (!activeBank || (int16_t)(banks[1].sequence - banks[0].sequence) > 0))
+        activeBank = &banks[1];
+}
+
+bool configStoreLoad(master_t *dst)
+{
+    if (!activeBank)
+        return false;
+
+    storeReplay(activeBank, activeBank->commitEnd, (uint8_t *)dst, false);
+    return true;
+}
+
+void configStoreSave(void)
+{
+    saveRequested = true;
+}
+
+bool configStoreBusy(void)
+{
+    return saveRequested || storeState != STORE_IDLE;
+}
+
+void configStoreUpdate(void)
+{
+    storeRun(false);
+}
+
+void configStoreFlush(void)
+{
+    while (configStoreBusy())
+        storeRun(true);
+}
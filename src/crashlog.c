@@ -0,0 +1,183 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+#include <string.h>
+
+// Crash recorder. While armed a snapshot of the flight state is taken every CRASHLOG_INTERVAL_US into a RAM
+// ring buffer holding the last couple of seconds. A failsafe disarm, a hard fault or a loop overrun freezes it,
+// and since the buffer lives in .noinit (not cleared by the startup code) a frozen log survives the soft reset
+// that follows and can be read out with MSP_CRASH_DUMP. A power cycle loses it, RAM doesn't keep its contents
+// without power.
+//
+// The log holds the first event of the latest flight: it stays frozen until the next arm, which starts recording
+// again. Events are counted until MSP_CRASH_CLEAR, failsafe disarms and faults that come after the first one of
+// a flight too, so a host that finds more crashes than it has read knows that some were flown over.
+//
+// RAM: 25 samples of 36 bytes and a 36 byte header, 936 bytes. The NAZE has 20K, the static data of the rest of
+// the firmware and the 1K minimum stack take about 15.6K of it, this stays under 5%. Samples keep the sticks and
+// motors at 4us and the time in 16 bits to fit.
+
+#define CRASHLOG_INTERVAL_US        80000
+#define CRASHLOG_MAGIC              0xC4A5B10C
+#define CRASHLOG_OVERRUN_MIN_US     10000   // loop overrun threshold, or 4 * looptime if that's longer
+
+#define CRASHLOG_PWM(us)            ((uint8_t)constrain(((us) - 1000) / 4, 0, 255))
+
+typedef struct crashLog_t {
+    uint32_t magic;
+    crashLogInfo_t info;
+    uint32_t check;                         // magic and crash count, and the rest of the header once frozen
+    uint8_t head;                           // next slot to write
+    crashSample_t samples[CRASHLOG_SAMPLES];
+} crashLog_t;
+
+static crashLog_t crashLog NOINIT;
+static uint32_t lastSampleAt;
+static bool ready = false;
+static bool flying = false;                 // armed since the last loop that wasn't
+
+static uint32_t crashLogCheck(void)
+{
+    const uint32_t *p = (const uint32_t *)&crashLog.info;
+    uint32_t check = crashLog.magic ^ crashLog.info.crashes;
+    uint32_t i;
+
+    if (crashLog.info.reason != CRASH_NONE) {
+        check ^= crashLog.head;
+        for (i = 0; i < sizeof(crashLogInfo_t) / sizeof(uint32_t); i++)
+            check ^= p[i];
+    }
+    return ~check;
+}
+
+static void crashLogSample(void)
+{
+    crashSample_t *sample = &crashLog.samples[crashLog.head];
+    int i;
+
+    sample->time = millis();
+    sample->angle[ROLL] = angle[ROLL];
+    sample->angle[PITCH] = angle[PITCH];
+    sample->heading = heading;
+    for (i = 0; i < 3; i++)
+        sample->gyro[i] = gyroADC[i];
+    for (i = 0; i < CRASHLOG_CHANNELS; i++)
+        sample->rcData[i] = CRASHLOG_PWM(rcData[i]);
+    for (i = 0; i < CRASHLOG_MOTORS; i++)
+        sample->motor[i] = CRASHLOG_PWM(motor[i]);
+    sample->cycleTime = cycleTime;
+    sample->i2cErrors = i2cGetErrorCounter();
+    sample->failsafeCnt = min(failsafeCnt, 255);
+    sample->flags = f.ARMED | f.ANGLE_MODE << 1 | f.HORIZON_MODE << 2 | f.BARO_MODE << 3 | f.MAG_MODE << 4 |
+                    (f.GPS_HOME_MODE || f.GPS_HOLD_MODE) << 5 | f.PASSTHRU_MODE << 6;
+
+    crashLog.head = (crashLog.head + 1) % CRASHLOG_SAMPLES;
+    if (crashLog.info.count < CRASHLOG_SAMPLES)
+        crashLog.info.count++;
+}
+
+// empty, recording, keeps the crash count
+static void crashLogRestart(void)
+{
+    uint16_t crashes = crashLog.info.crashes;
+
+    memset(&crashLog.info, 0, sizeof(crashLog.info));
+    crashLog.info.crashes = crashes;
+    crashLog.head = 0;
+    crashLog.check = crashLogCheck();
+}
+
+void crashLogClear(void)
+{
+    memset(&crashLog, 0, sizeof(crashLog));
+    crashLog.magic = CRASHLOG_MAGIC;
+    crashLog.check = crashLogCheck();
+}
+
+// first thing in main(), before anything can fault
+void crashLogInit(void)
+{
+    // after a power cycle this is noise, after a soft reset it is whatever was recorded
+    if (crashLog.magic != CRASHLOG_MAGIC || crashLog.check != crashLogCheck() ||
+        crashLog.head >= CRASHLOG_SAMPLES || crashLog.info.count > CRASHLOG_SAMPLES)
+        crashLogClear();
+    else if (crashLog.info.reason == CRASH_NONE)
+        crashLogRestart();      // a flight that ended without a crash, only the count is worth keeping
+    ready = true;
+}
+
+// called at the end of every loop, only a compare unless a sample is due
+void crashLogUpdate(void)
+{
+    uint32_t now;
+
+    if (!f.ARMED) {
+        flying = false;
+        return;
+    }
+    if (!flying) {
+        flying = true;
+        if (crashLog.info.reason != CRASH_NONE)
+            crashLogRestart();
+    }
+
+    // a stall overruns several loops in a row, only the first of a flight counts
+    if (crashLog.info.reason != CRASH_NONE)
+        return;
+    if (cycleTime > max(mcfg.looptime * 4, CRASHLOG_OVERRUN_MIN_US)) {
+        crashLogFreeze(CRASH_LOOP_OVERRUN);
+        return;
+    }
+
+    now = micros();
+    if (now - lastSampleAt < CRASHLOG_INTERVAL_US)
+        return;
+    lastSampleAt = now;
+    crashLogSample();
+}
+
+// counts every event, the first one of a flight freezes the log so its cause isn't overwritten
+void crashLogFreeze(uint8_t reason)
+{
+    if (!ready)
+        return;
+
+    if (crashLog.info.crashes < UINT16_MAX)
+        crashLog.info.crashes++;
+    if (crashLog.info.reason == CRASH_NONE) {
+        // one last sample with the state at the moment it happened
+        crashLogSample();
+        crashLog.info.reason = reason;
+        crashLog.info.frozenAt = millis();
+    }
+    crashLog.check = crashLogCheck();
+}
+
+// from the hard fault handler, with the PC and LR stacked by the exception entry
+void crashLogFault(uint32_t pc, uint32_t lr)
+{
+    if (ready && crashLog.info.reason == CRASH_NONE) {
+        crashLog.info.faultPC = pc;
+        crashLog.info.faultLR = lr;
+        crashLog.info.faultCFSR = SCB->CFSR;
+        crashLog.info.faultHFSR = SCB->HFSR;
+    }
+    crashLogFreeze(CRASH_HARDFAULT);
+}
+
+void crashLogGetInfo(crashLogInfo_t *info)
+{
+    *info = crashLog.info;
+}
+
+// index 0 is the oldest sample
+bool crashLogGetSample(uint8_t index, crashSample_t *sample)
+{
+    if (index >= crashLog.info.count)
+        return false;
+    *sample = crashLog.samples[(crashLog.head + CRASHLOG_SAMPLES - crashLog.info.count + index) % CRASHLOG_SAMPLES];
+    return true;
+}
@@ -12,12 +12,9 @@ static uint16_t convOverrun = 0;
 #define BARO_ON                  digitalHi(BARO_GPIO, BARO_PIN);
 
 // EXTI14 for BMP085 End of Conversion Interrupt
-void EXTI15_10_IRQHandler(void)
+static void bmp085EocCallback(void)
 {
-    if (EXTI_GetITStatus(EXTI_Line14) == SET) {
-        EXTI_ClearITPendingBit(EXTI_Line14);
-        convDone = true;
-    }
+    convDone = true;
 }
 
 typedef struct {
@@ -95,8 +92,6 @@ static void bmp085_calculate(int32_t *pressure, int32_t *temperature);
 bool bmp085Detect(baro_t *baro)
 {
     gpio_config_t gpio;
-    EXTI_InitTypeDef EXTI_InitStructure;
-    NVIC_InitTypeDef NVIC_InitStructure;
     uint8_t data;
 
     if (bmp085InitDone)
@@ -115,19 +110,7 @@ bool bmp085Detect(baro_t *baro)
 #endif
 
     // EXTI interrupt for barometer EOC
-    gpioExtiLineConfig(GPIO_PortSourceGPIOC, GPIO_PinSource14);
-    EXTI_InitStructure.EXTI_Line = EXTI_Line14;
-    EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
-    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
-    EXTI_InitStructure.EXTI_LineCmd = ENABLE;
-    EXTI_Init(&EXTI_InitStructure);
-
-    // Enable and set EXTI10-15 Interrupt to the lowest priority
-    NVIC_InitStructure.NVIC_IRQChannel = EXTI15_10_IRQn;
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0x0F;
-    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0x0F;
-    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
-    NVIC_Init(&NVIC_InitStructure);
+    gpioExtiConfig(GPIO_PortSourceGPIOC, GPIO_PinSource14, EXTI_Trigger_Rising, bmp085EocCallback);
 
     delay(20); // datasheet says 10ms, we'll be careful and do 20. this is after ms5611 driver kills us, so longer the better.
 
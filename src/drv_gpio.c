@@ -41,6 +41,50 @@ void gpioExtiLineConfig(uint8_t portsrc, uint8_t pinsrc)
     AFIO->EXTICR[pinsrc >> 0x02] |= (((uint32_t)portsrc) << (0x04 * (pinsrc & (uint8_t)0x03)));
 }
 
+// EXTI10..15 share a single interrupt vector (BMP085 EOC on PC14, MPU_INT on PC13), so the handler
+// dispatches to whichever drivers registered a callback for the pending line.
+static extiCallbackPtr extiCallbacks[6];
+
+void EXTI15_10_IRQHandler(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 6; i++) {
+        uint32_t line = EXTI_Line10 << i;
+        if (EXTI_GetITStatus(line) == SET) {
+            EXTI_ClearITPendingBit(line);
+            if (extiCallbacks[i])
+                extiCallbacks[i]();
+        }
+    }
+}
+
+void gpioExtiConfig(uint8_t portsrc, uint8_t pinsrc, EXTITrigger_TypeDef trigger, extiCallbackPtr callback)
+{
+    EXTI_InitTypeDef EXTI_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    // only lines 10..15 go through the shared handler above
+    if (pinsrc < 10 || pinsrc > 15)
+        return;
+
+    extiCallbacks[pinsrc - 10] = callback;
+
+    gpioExtiLineConfig(portsrc, pinsrc);
+    EXTI_ClearITPendingBit(EXTI_Line0 << pinsrc);
+    EXTI_InitStructure.EXTI_Line = EXTI_Line0 << pinsrc;
+    EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+    EXTI_InitStructure.EXTI_Trigger = trigger;
+    EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+    EXTI_Init(&EXTI_InitStructure);
+
+    NVIC_InitStructure.NVIC_IRQChannel = EXTI15_10_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0x0F;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 0x0F;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
 #define LSB_MASK                    ((uint16_t)0xFFFF)
 #define DBGAFR_POSITION_MASK        ((uint32_t)0x000F0000)
 #define DBGAFR_SWJCFG_MASK          ((uint32_t)0xF0FFFFFF)
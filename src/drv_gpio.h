@@ -49,5 +49,8 @@ typedef struct {
 #define digitalIn(p, i)     (p->IDR & i)
 
 void gpioInit(GPIO_TypeDef *gpio, gpio_config_t *config);
+typedef void (*extiCallbackPtr)(void);
+
 void gpioExtiLineConfig(uint8_t portsrc, uint8_t pinsrc);
+void gpioExtiConfig(uint8_t portsrc, uint8_t pinsrc, EXTITrigger_TypeDef trigger, extiCallbackPtr callback);
 void gpioPinRemapConfig(uint32_t remap, bool enable);
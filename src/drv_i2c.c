@@ -58,7 +58,12 @@ void I2C2_EV_IRQHandler(void)
 }
 
 #define I2C_DEFAULT_TIMEOUT 30000
+#define I2C_JOB_TIMEOUT     5000                                        // us a job may hold the bus before it is abandoned
+#define I2C_QUEUE_SIZE      8
+
 static volatile uint16_t i2cErrorCount = 0;
+static volatile i2cStats_t i2cStats;
+static volatile uint32_t averageJobTime;                                // us << 4
 
 static volatile bool error = false;
 static volatile bool busy;
@@ -70,88 +75,174 @@ static volatile uint8_t writing;
 static volatile uint8_t reading;
 static volatile uint8_t* write_p;
 static volatile uint8_t* read_p;
+static volatile uint8_t subaddress_sent;                                // flag to indicate if subaddess sent
+
+// Jobs waiting for the bus, the one at the head is on the wire whenever busy is set. The ISRs
+// advance the queue, so a caller only blocks if it asks to wait for its own job.
+static i2cJob_t *volatile i2cQueue[I2C_QUEUE_SIZE];
+static volatile uint8_t queueHead;
+static volatile uint8_t queueTail;
+static volatile uint32_t jobStartedAt;
+static volatile bool recovering;                                        // a timed out job is being abandoned
 
-static bool i2cHandleHardwareFailure(void)
+static void i2cJobStart(void);
+
+static void i2cHandleHardwareFailure(void)
 {
     i2cErrorCount++;
     // reinit peripheral + clock out garbage
     i2cInit(I2Cx_index);
-    return false;
 }
 
-bool i2cWriteBuffer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t *data)
+// Called from the ISRs (or the timeout check) when the job at the head is done, starts the next one
+static void i2cJobFinish(bool failed)
+{
+    i2cJob_t *job = i2cQueue[queueHead];
+    uint32_t elapsed = micros() - jobStartedAt;
+
+    // the head job was already finished, advancing again would drop the next one
+    if (!busy)
+        return;
+
+    busy = 0;
+    queueHead = (queueHead + 1) % I2C_QUEUE_SIZE;
+    i2cStats.queueDepth--;
+    i2cStats.transactions++;
+    averageJobTime += ((int32_t)(elapsed << 4) - (int32_t)averageJobTime) >> 4;
+    job->status = failed ? I2C_JOB_ERROR : I2C_JOB_DONE;
+
+    // next job goes out before the callback runs so a callback can queue more work
+    if (queueHead != queueTail)
+        i2cJobStart();
+    if (job->callback)
+        job->callback(job);
+}
+
+static void i2cJobStart(void)
 {
+    i2cJob_t *job = i2cQueue[queueHead];
     uint32_t timeout = I2C_DEFAULT_TIMEOUT;
 
-    addr = addr_ << 1;
-    reg = reg_;
-    writing = 1;
-    reading = 0;
-    write_p = data;
-    read_p = data;
-    bytes = len_;
+    addr = job->addr << 1;
+    reg = job->reg;
+    writing = !job->read;
+    reading = job->read;
+    write_p = job->buf;
+    read_p = job->buf;
+    bytes = job->len;
+    subaddress_sent = 0;
     busy = 1;
     error = false;
-    
-    if (!I2Cx)
-        return false;
+    job->status = I2C_JOB_BUSY;
+    jobStartedAt = micros();
 
     if (!(I2Cx->CR2 & I2C_IT_EVT)) {                                    // if we are restarting the driver
         if (!(I2Cx->CR1 & 0x0100)) {                                    // ensure sending a start
             while (I2Cx->CR1 & 0x0200 && --timeout > 0) { ; }           // wait for any stop to finish sending
-            if (timeout == 0)
-                return i2cHandleHardwareFailure();
+            if (timeout == 0) {
+                i2cHandleHardwareFailure();
+                i2cJobFinish(true);
+                return;
+            }
             I2C_GenerateSTART(I2Cx, ENABLE);                            // send the start for the new job
         }
         I2C_ITConfig(I2Cx, I2C_IT_EVT | I2C_IT_ERR, ENABLE);            // allow the interrupts to fire off again
     }
+}
 
-    timeout = I2C_DEFAULT_TIMEOUT;
-    while (busy && --timeout > 0) { ; }
-    if (timeout == 0)
-        return i2cHandleHardwareFailure();
+// A job that never completes means the interrupts stopped coming, reset the bus and move on.
+// The unstick delays need the systick running so the reset can't be done with interrupts off,
+// the I2C interrupts are shut off instead and nothing else may finish the job in the meantime.
+static void i2cCheckTimeout(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    i2cJob_t *job;
 
-    return !error;
+    __disable_irq();
+    if (!busy || recovering || micros() - jobStartedAt <= I2C_JOB_TIMEOUT) {
+        __set_PRIMASK(primask);
+        return;
+    }
+    job = i2cQueue[queueHead];
+    recovering = true;
+    I2C_ITConfig(I2Cx, I2C_IT_EVT | I2C_IT_ERR | I2C_IT_BUF, DISABLE);
+    NVIC_ClearPendingIRQ(i2cHardwareMap[I2Cx_index].ev_irq);
+    NVIC_ClearPendingIRQ(i2cHardwareMap[I2Cx_index].er_irq);
+    __set_PRIMASK(primask);
+
+    i2cHandleHardwareFailure();
+
+    __disable_irq();
+    if (busy && i2cQueue[queueHead] == job)
+        i2cJobFinish(true);
+    recovering = false;
+    __set_PRIMASK(primask);
 }
 
-bool i2cWrite(uint8_t addr_, uint8_t reg_, uint8_t data)
+// Without the timeout check, which may reset the bus and wait on the systick. For interrupt handlers,
+// job callbacks and callers that have interrupts off, a stuck job is abandoned by the next i2cJobWait().
+bool i2cQueueJobFromIsr(i2cJob_t *job)
 {
-    return i2cWriteBuffer(addr_, reg_, 1, &data);
+    uint32_t primask;
+    uint8_t next;
+
+    if (!I2Cx) {
+        job->status = I2C_JOB_ERROR;
+        return false;
+    }
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    next = (queueTail + 1) % I2C_QUEUE_SIZE;
+    if (next == queueHead) {
+        __set_PRIMASK(primask);
+        job->status = I2C_JOB_ERROR;
+        return false;
+    }
+    job->status = I2C_JOB_QUEUED;
+    i2cQueue[queueTail] = job;
+    queueTail = next;
+    if (++i2cStats.queueDepth > i2cStats.maxQueueDepth)
+        i2cStats.maxQueueDepth = i2cStats.queueDepth;
+    if (!busy)
+        i2cJobStart();
+    __set_PRIMASK(primask);
+
+    return true;
 }
 
-bool i2cRead(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t* buf)
+bool i2cQueueJob(i2cJob_t *job)
 {
-    uint32_t timeout = I2C_DEFAULT_TIMEOUT;
+    if (I2Cx)
+        i2cCheckTimeout();
+    return i2cQueueJobFromIsr(job);
+}
 
-    addr = addr_ << 1;
-    reg = reg_;
-    writing = 0;
-    reading = 1;
-    read_p = buf;
-    write_p = buf;
-    bytes = len;
-    busy = 1;
-    error = false;
+bool i2cJobWait(i2cJob_t *job)
+{
+    while (job->status == I2C_JOB_QUEUED || job->status == I2C_JOB_BUSY)
+        i2cCheckTimeout();
 
-    if (!I2Cx)
-        return false;
+    return job->status == I2C_JOB_DONE;
+}
 
-    if (!(I2Cx->CR2 & I2C_IT_EVT)) {                                    // if we are restarting the driver
-        if (!(I2Cx->CR1 & 0x0100)) {                                    // ensure sending a start
-            while (I2Cx->CR1 & 0x0200 && --timeout > 0) { ; }           // wait for any stop to finish sending
-            if (timeout == 0)
-                return i2cHandleHardwareFailure();
-            I2C_GenerateSTART(I2Cx, ENABLE);                            // send the start for the new job
-        }
-        I2C_ITConfig(I2Cx, I2C_IT_EVT | I2C_IT_ERR, ENABLE);            // allow the interrupts to fire off again
-    }
+bool i2cWriteBuffer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t *data)
+{
+    i2cJob_t job = { .addr = addr_, .reg = reg_, .len = len_, .read = false, .buf = data };
 
-    timeout = I2C_DEFAULT_TIMEOUT;
-    while (busy && --timeout > 0) { ; }
-    if (timeout == 0)
-        return i2cHandleHardwareFailure();
+    return i2cQueueJob(&job) && i2cJobWait(&job);
+}
 
-    return !error;
+bool i2cWrite(uint8_t addr_, uint8_t reg_, uint8_t data)
+{
+    return i2cWriteBuffer(addr_, reg_, 1, &data);
+}
+
+bool i2cRead(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t* buf)
+{
+    i2cJob_t job = { .addr = addr_, .reg = reg_, .len = len, .read = true, .buf = buf };
+
+    return i2cQueueJob(&job) && i2cJobWait(&job);
 }
 
 static void i2c_er_handler(void)
@@ -179,12 +270,15 @@ static void i2c_er_handler(void)
         }
     }
     I2Cx->SR1 &= ~0x0F00;                                               // reset all the error bits to clear the interrupt
-    busy = 0;
+    if (SR1Register & 0x0F00)
+        i2cStats.busErrors++;
+    if ((SR1Register & 0x0700) && busy)                                 // the job was abandoned above
+        i2cJobFinish(true);
 }
 
 void i2c_ev_handler(void)
 {
-    static uint8_t subaddress_sent, final_stop;                         // flag to indicate if subaddess sent, flag to indicate final bus condition
+    static uint8_t final_stop;                                          // flag to indicate final bus condition
     static int8_t index;                                                // index is signed -1 == send the subaddress
     uint8_t SReg_1 = I2Cx->SR1;                                         // read the status register here
 
@@ -278,7 +372,7 @@ void i2c_ev_handler(void)
         subaddress_sent = 0;                                            // reset this here
         if (final_stop)                                                 // If there is a final stop and no more jobs, bus is inactive, disable interrupts to prevent BTF
             I2C_ITConfig(I2Cx, I2C_IT_EVT | I2C_IT_ERR, DISABLE);       // Disable EVT and ERR interrupts while bus inactive
-        busy = 0;
+        i2cJobFinish(error);
     }
 }
 
@@ -329,6 +423,16 @@ uint16_t i2cGetErrorCounter(void)
     return i2cErrorCount;
 }
 
+void i2cGetStats(i2cStats_t *stats)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    *stats = i2cStats;
+    stats->averageTime = averageJobTime >> 4;
+    __set_PRIMASK(primask);
+}
+
 static void i2cUnstick(void)
 {
     GPIO_TypeDef *gpio;
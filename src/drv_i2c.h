@@ -10,8 +10,43 @@ typedef enum I2CDevice {
     I2CDEV_MAX = I2CDEV_2,
 } I2CDevice;
 
+typedef enum {
+    I2C_JOB_IDLE = 0,
+    I2C_JOB_QUEUED,
+    I2C_JOB_BUSY,
+    I2C_JOB_DONE,
+    I2C_JOB_ERROR,
+} i2cJobStatus_e;
+
+struct i2cJob_t;
+typedef void (*i2cJobCallbackPtr)(struct i2cJob_t *job);
+
+// Transaction descriptor for i2cQueueJob(). Must stay valid until the job is done, status can be polled
+// or the callback (run from the I2C interrupt) used to pick up the result.
+typedef struct i2cJob_t {
+    uint8_t addr;                       // 7bit device address
+    uint8_t reg;                        // register to write/read from, 0xFF to skip the subaddress
+    uint8_t len;
+    bool read;
+    uint8_t *buf;
+    i2cJobCallbackPtr callback;         // optional
+    volatile i2cJobStatus_e status;
+} i2cJob_t;
+
+typedef struct i2cStats_t {
+    uint32_t transactions;              // completed jobs, failed ones included
+    uint16_t busErrors;                 // NACK, bus error and arbitration lost events
+    uint16_t averageTime;               // us from START to the end of a job
+    uint8_t queueDepth;                 // jobs waiting or on the bus
+    uint8_t maxQueueDepth;
+} i2cStats_t;
+
 void i2cInit(I2CDevice index);
+bool i2cQueueJob(i2cJob_t *job);
+bool i2cQueueJobFromIsr(i2cJob_t *job);
+bool i2cJobWait(i2cJob_t *job);
 bool i2cWriteBuffer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t *data);
 bool i2cWrite(uint8_t addr_, uint8_t reg, uint8_t data);
 bool i2cRead(uint8_t addr_, uint8_t reg, uint8_t len, uint8_t* buf);
 uint16_t i2cGetErrorCounter(void);
+void i2cGetStats(i2cStats_t *stats);
@@ -39,6 +39,8 @@
 #error Need to define SOFT_I2C_PB1011 or SOFT_I2C_PB67 (see board.h)
 #endif
 
+static i2cStats_t i2cStats;
+
 static void I2C_delay(void)
 {
     volatile int i = 7;
@@ -229,10 +231,48 @@ bool i2cRead(uint8_t addr, uint8_t reg, uint8_t len, uint8_t *buf)
     return true;
 }
 
+// No interrupts to drive a queue here, jobs are bit banged right away and complete before returning
+bool i2cQueueJob(i2cJob_t *job)
+{
+    uint32_t start = micros();
+    bool ack;
+
+    if (job->read)
+        ack = i2cRead(job->addr, job->reg, job->len, job->buf);
+    else
+        ack = i2cWriteBuffer(job->addr, job->reg, job->len, job->buf);
+
+    i2cStats.transactions++;
+    i2cStats.averageTime += ((int32_t)(micros() - start) - (int32_t)i2cStats.averageTime) >> 4;
+    if (!ack)
+        i2cStats.busErrors++;
+    job->status = ack ? I2C_JOB_DONE : I2C_JOB_ERROR;
+    if (job->callback)
+        job->callback(job);
+
+    return true;
+}
+
+// nothing to time out, the same as above
+bool i2cQueueJobFromIsr(i2cJob_t *job)
+{
+    return i2cQueueJob(job);
+}
+
+bool i2cJobWait(i2cJob_t *job)
+{
+    return job->status == I2C_JOB_DONE;
+}
+
 uint16_t i2cGetErrorCounter(void)
 {
     // TODO maybe fix this, but since this is test code, doesn't matter.
     return 0;
 }
 
+void i2cGetStats(i2cStats_t *stats)
+{
+    *stats = i2cStats;
+}
+
 #endif
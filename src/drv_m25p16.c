@@ -0,0 +1,91 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+
+// M25P16 2MB serial flash on SPI2, found by spiInit() on boards without the SPI MPU
+
+#define M25P16_WRITE_ENABLE     0x06
+#define M25P16_READ_STATUS      0x05
+#define M25P16_READ_BYTES       0x03
+#define M25P16_PAGE_PROGRAM     0x02
+#define M25P16_BULK_ERASE       0xC7
+
+#define M25P16_STATUS_WIP       0x01    // write, program or erase in progress
+
+static bool flashPresent = false;
+
+static void m25p16Command(uint8_t command, uint32_t address)
+{
+    spiSelect(true);
+    spiTransferByte(command);
+    spiTransferByte(address >> 16);
+    spiTransferByte(address >> 8);
+    spiTransferByte(address);
+}
+
+static void m25p16WriteEnable(void)
+{
+    spiSelect(true);
+    spiTransferByte(M25P16_WRITE_ENABLE);
+    spiSelect(false);
+}
+
+bool m25p16Init(void)
+{
+    flashPresent = true;
+    return true;
+}
+
+// true while a page program DMA is running or the chip is still busy with a program/erase
+bool m25p16Busy(void)
+{
+    uint8_t status;
+
+    if (!flashPresent || spiTransferBusy())
+        return true;
+
+    spiSelect(true);
+    spiTransferByte(M25P16_READ_STATUS);
+    status = spiTransferByte(0xFF);
+    spiSelect(false);
+
+    return status & M25P16_STATUS_WIP;
+}
+
+// starts a bulk erase, which takes the chip up to 40s. Poll m25p16Busy() for completion.
+bool m25p16EraseAll(void)
+{
+    if (m25p16Busy())
+        return false;
+
+    m25p16WriteEnable();
+    spiSelect(true);
+    spiTransferByte(M25P16_BULK_ERASE);
+    spiSelect(false);
+    return true;
+}
+
+// Programs up to one page starting at address. The command is clocked out polled, the data by DMA,
+// so this returns right away and callback runs from the DMA interrupt. Must not cross a page boundary.
+bool m25p16ProgramPage(uint32_t address, uint8_t *data, int len, spiCallbackPtr callback)
+{
+    if (m25p16Busy())
+        return false;
+
+    m25p16WriteEnable();
+    m25p16Command(M25P16_PAGE_PROGRAM, address);
+    return spiTransferDMA(NULL, data, len, callback);
+}
+
+bool m25p16Read(uint32_t address, uint8_t *data, int len)
+{
+    if (m25p16Busy())
+        return false;
+
+    m25p16Command(M25P16_READ_BYTES, address);
+    spiTransfer(data, NULL, len);
+    spiSelect(false);
+    return true;
+}
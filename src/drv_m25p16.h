@@ -0,0 +1,11 @@
+#pragma once
+
+#define M25P16_PAGE_SIZE        256
+#define M25P16_SECTOR_SIZE      (64 * 1024)
+#define M25P16_SIZE             (2 * 1024 * 1024)
+
+bool m25p16Init(void);
+bool m25p16Busy(void);
+bool m25p16EraseAll(void);
+bool m25p16ProgramPage(uint32_t address, uint8_t *data, int len, spiCallbackPtr callback);
+bool m25p16Read(uint32_t address, uint8_t *data, int len);
@@ -103,6 +103,8 @@
 #define MPU_RA_WHO_AM_I         0x75
 
 #define MPU6050_SMPLRT_DIV      0       // 8000Hz
+#define MPU6050_FIFO_SIZE       1024
+#define MPU_FIFO_BURST          8       // gyro samples per FIFO read transaction
 
 enum lpf_e {
     INV_FILTER_256HZ_NOLPF2 = 0,
@@ -141,22 +143,41 @@ enum accel_fsr_e {
 static uint8_t mpuLowPassFilter = INV_FILTER_42HZ;
 static sensor_align_e gyroAlign = CW0_DEG;
 static sensor_align_e accAlign = CW0_DEG;
+static bool mpuFifo = false;
 
 static void mpu6050AccInit(sensor_align_e align);
 static void mpu6050AccRead(int16_t *accData);
 static void mpu6050GyroInit(sensor_align_e align);
 static void mpu6050GyroRead(int16_t *gyroData);
+static void mpu6050GyroFifoRead(int16_t *gyroData);
+static void mpu6050ReadAll(sensor_data_t *sensorData);
+static void mpu6050QueueReadAll(void);
+static void mpu6050ReadTemp(int16_t *tempData);
 
 extern uint16_t acc_1G;
+extern gyroFifoStats_t gyroFifoStats;
 static uint8_t mpuAccelHalf = 0;
 
-bool mpu6050Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf, uint8_t *scale)
+// The acc read is queued as soon as the gyro has been read, so it runs on the bus while the gyro data
+// is processed and mpu6050AccRead() normally only collects the result.
+static uint8_t accBuf[6];
+static i2cJob_t accJob = { .addr = MPU6050_ADDRESS, .reg = MPU_RA_ACCEL_XOUT_H, .len = 6, .read = true, .buf = accBuf };
+static bool accActive = false;     // this chip is the acc in use, not just the gyro
+
+// The combined read is queued by the data ready interrupt under gyro_sync, mpu6050ReadAll() then only waits
+// for whatever of it is still on the bus. The job is only requeued once its data has been used.
+static uint8_t allBuf[14];
+static i2cJob_t allJob = { .addr = MPU6050_ADDRESS, .reg = MPU_RA_ACCEL_XOUT_H, .len = 14, .read = true, .buf = allBuf };
+static int16_t tempRaw;            // left by the last combined read
+
+bool mpu6050Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf, bool fifo, uint8_t *scale)
 {
     bool ack;
     uint8_t sig, rev;
     uint8_t tmp[6];
 
-    delay(35);                  // datasheet page 13 says 30ms. other stuff could have been running meanwhile. but we'll be safe
+    // datasheet page 13 says 30ms from power up. uptime starts counting after that, so wait until it reads 35ms
+    while (millis() < 35);
 
     ack = i2cRead(MPU6050_ADDRESS, MPU_RA_WHO_AM_I, 1, &sig);
     if (!ack)
@@ -196,7 +217,15 @@ bool mpu6050Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf, uint8_t *scale)
     acc->init = mpu6050AccInit;
     acc->read = mpu6050AccRead;
     gyro->init = mpu6050GyroInit;
-    gyro->read = mpu6050GyroRead;
+    gyro->read = fifo ? mpu6050GyroFifoRead : mpu6050GyroRead;
+    // FIFO gyro data has to come from the FIFO, otherwise acc, temp and gyro are one burst
+    gyro->readAll = fifo ? NULL : mpu6050ReadAll;
+    gyro->temperature = fifo ? NULL : mpu6050ReadTemp;
+#ifndef SOFT_I2C
+    // soft i2c would bit bang the whole burst inside the interrupt
+    gyro->prefetch = fifo ? NULL : mpu6050QueueReadAll;
+#endif
+    mpuFifo = fifo;
 
     // 16.4 dps/lsb scalefactor
     gyro->scale = (4.0f / 16.4f) * (M_PI / 180.0f) * 0.000001f;
@@ -229,19 +258,31 @@ static void mpu6050AccInit(sensor_align_e align)
     else
         acc_1G = 512 * 8;
 
+    accActive = true;
+
     if (align > 0)
         accAlign = align;
 }
 
+static void mpu6050QueueAccRead(void)
+{
+    if (!accActive || accJob.status == I2C_JOB_QUEUED || accJob.status == I2C_JOB_BUSY)
+        return;
+    i2cQueueJob(&accJob);
+}
+
 static void mpu6050AccRead(int16_t *accData)
 {
-    uint8_t buf[6];
     int16_t data[3];
 
-    i2cRead(MPU6050_ADDRESS, MPU_RA_ACCEL_XOUT_H, 6, buf);
-    data[0] = (int16_t)((buf[0] << 8) | buf[1]);
-    data[1] = (int16_t)((buf[2] << 8) | buf[3]);
-    data[2] = (int16_t)((buf[4] << 8) | buf[5]);
+    // nothing in flight (calibration, first loop) or the queued read failed, read it directly
+    if (accJob.status == I2C_JOB_IDLE || !i2cJobWait(&accJob))
+        i2cRead(MPU6050_ADDRESS, MPU_RA_ACCEL_XOUT_H, 6, accBuf);
+    accJob.status = I2C_JOB_IDLE;
+
+    data[0] = (int16_t)((accBuf[0] << 8) | accBuf[1]);
+    data[1] = (int16_t)((accBuf[2] << 8) | accBuf[3]);
+    data[2] = (int16_t)((accBuf[4] << 8) | accBuf[5]);
 
     alignSensors(data, accData, accAlign);
 }
@@ -265,6 +306,14 @@ static void mpu6050GyroInit(sensor_align_e align)
     i2cWrite(MPU6050_ADDRESS, MPU_RA_INT_PIN_CFG, 0 << 7 | 0 << 6 | 0 << 5 | 0 << 4 | 0 << 3 | 0 << 2 | 1 << 1 | 0 << 0);  // INT_PIN_CFG   -- INT_LEVEL_HIGH, INT_OPEN_DIS, LATCH_INT_DIS, INT_RD_CLEAR_DIS, FSYNC_INT_LEVEL_HIGH, FSYNC_INT_DIS, I2C_BYPASS_EN, CLOCK_DIS
     i2cWrite(MPU6050_ADDRESS, MPU_RA_CONFIG, mpuLowPassFilter);  //CONFIG        -- EXT_SYNC_SET 0 (disable input pin for data sync) ; default DLPF_CFG = 0 => ACC bandwidth = 260Hz  GYRO bandwidth = 256Hz)
     i2cWrite(MPU6050_ADDRESS, MPU_RA_GYRO_CONFIG, INV_FSR_2000DPS << 3);
+    // data ready pulse on MPU_INT, used by gyro_sync on rev5 hardware
+    if (hw_revision >= NAZE32_REV5)
+        i2cWrite(MPU6050_ADDRESS, MPU_RA_INT_ENABLE, 0x01);     // INT_ENABLE    -- DATA_RDY_EN
+    // queue every gyro sample (1kHz with DLPF on), each loop averages whatever arrived since the last one
+    if (mpuFifo) {
+        i2cWrite(MPU6050_ADDRESS, MPU_RA_FIFO_EN, 0x70);        // FIFO_EN       -- XG_FIFO_EN, YG_FIFO_EN, ZG_FIFO_EN
+        i2cWrite(MPU6050_ADDRESS, MPU_RA_USER_CTRL, 0x44);      // USER_CTRL     -- FIFO_EN, FIFO_RESET
+    }
 
     // ACC Init stuff. Moved into gyro init because the reset above would screw up accel config. Oops.
     // Accel scale 8g (4096 LSB/g)
@@ -285,4 +334,96 @@ static void mpu6050GyroRead(int16_t *gyroData)
     data[2] = (int16_t)((buf[4] << 8) | buf[5]) / 4;
 
     alignSensors(data, gyroData, gyroAlign);
+    mpu6050QueueAccRead();
+}
+
+static void mpu6050GyroFifoRead(int16_t *gyroData)
+{
+    uint8_t buf[MPU_FIFO_BURST * 6];
+    int32_t sum[3] = { 0, 0, 0 };
+    int16_t data[3];
+    uint16_t count, samples, burst, i, j;
+
+    i2cRead(MPU6050_ADDRESS, MPU_RA_FIFO_COUNTH, 2, buf);
+    count = (buf[0] << 8) | buf[1];
+
+    // a full FIFO has dropped samples and may have lost its frame alignment, start over
+    if (count > MPU6050_FIFO_SIZE - 6) {
+        gyroFifoStats.overflowCount++;
+        i2cWrite(MPU6050_ADDRESS, MPU_RA_USER_CTRL, 0x44);
+        count = 0;
+    }
+
+    samples = count / 6;
+    if (samples == 0) {
+        // nothing queued since the last loop, use the current output registers
+        mpu6050GyroRead(gyroData);
+        return;
+    }
+
+    for (i = 0; i < samples; i += burst) {
+        burst = min(samples - i, MPU_FIFO_BURST);
+        i2cRead(MPU6050_ADDRESS, MPU_RA_FIFO_R_W, burst * 6, buf);
+        for (j = 0; j < burst * 6; j += 6) {
+            sum[0] += (int16_t)((buf[j] << 8) | buf[j + 1]);
+            sum[1] += (int16_t)((buf[j + 2] << 8) | buf[j + 3]);
+            sum[2] += (int16_t)((buf[j + 4] << 8) | buf[j + 5]);
+        }
+    }
+
+    // boxcar average over the loop period is the anti-alias filter, same /4 scaling as above
+    data[0] = sum[0] / (samples * 4);
+    data[1] = sum[1] / (samples * 4);
+    data[2] = sum[2] / (samples * 4);
+    gyroFifoStats.samples = samples;
+
+    alignSensors(data, gyroData, gyroAlign);
+    mpu6050QueueAccRead();
+}
+
+// gyro data ready interrupt, or the loop with interrupts off
+static void mpu6050QueueReadAll(void)
+{
+    if (allJob.status == I2C_JOB_IDLE)
+        i2cQueueJobFromIsr(&allJob);
+}
+
+// ACCEL_XOUT_H (0x3B) to GYRO_ZOUT_L (0x48) in one transaction
+static void mpu6050ReadAll(sensor_data_t *sensorData)
+{
+    uint8_t *buf = allBuf;
+    int16_t data[3];
+
+    // nothing prefetched (no gyro_sync, calibration), read it now. The interrupt may queue it meanwhile
+    __disable_irq();
+    mpu6050QueueReadAll();
+    __enable_irq();
+    if (!i2cJobWait(&allJob)) {
+        allJob.status = I2C_JOB_IDLE;
+        return;
+    }
+
+    if (accActive) {
+        data[0] = (int16_t)((buf[0] << 8) | buf[1]);
+        data[1] = (int16_t)((buf[2] << 8) | buf[3]);
+        data[2] = (int16_t)((buf[4] << 8) | buf[5]);
+        alignSensors(data, sensorData->acc, accAlign);
+        sensorData->updated |= ACC_UPDATED;
+    }
+
+    tempRaw = (int16_t)((buf[6] << 8) | buf[7]);
+
+    data[0] = (int16_t)((buf[8] << 8) | buf[9]) / 4;
+    data[1] = (int16_t)((buf[10] << 8) | buf[11]) / 4;
+    data[2] = (int16_t)((buf[12] << 8) | buf[13]) / 4;
+    alignSensors(data, sensorData->gyro, gyroAlign);
+    sensorData->updated |= GYRO_UPDATED;
+    allJob.status = I2C_JOB_IDLE;
+}
+
+// raw / 340 + 36.53, rounded, from what the last combined read left. Shifted up 100 degrees so the division
+// always rounds down, the chip's range starts at -60
+static void mpu6050ReadTemp(int16_t *tempData)
+{
+    *tempData = (tempRaw + 12420 + 340 / 2 + 340 * 100) / 340 - 100;
 }
@@ -17,9 +17,19 @@
 #define MPU6500_RA_ACCEL_CFG                (0x1C)
 #define MPU6500_RA_LPF                      (0x1A)
 #define MPU6500_RA_RATE_DIV                 (0x19)
+#define MPU6500_RA_INT_ENABLE               (0x38)
+#define MPU6500_RA_FIFO_EN                  (0x23)
+#define MPU6500_RA_USER_CTRL                (0x6A)
+#define MPU6500_RA_FIFO_COUNTH              (0x72)
+#define MPU6500_RA_FIFO_RW                  (0x74)
 
 #define MPU6500_WHO_AM_I_CONST              (0x70)
 #define BIT_RESET                           (0x80)
+#define BIT_GYRO_FIFO_EN                    (0x70)
+#define BIT_FIFO_EN_RESET                   (0x44)
+
+#define MPU6500_FIFO_SIZE                   512
+#define MPU_FIFO_BURST                      8       // gyro samples per FIFO read transaction
 
 enum lpf_e {
     INV_FILTER_256HZ_NOLPF2 = 0,
@@ -58,16 +68,23 @@ enum accel_fsr_e {
 static uint8_t mpuLowPassFilter = INV_FILTER_42HZ;
 static sensor_align_e gyroAlign = CW0_DEG;
 static sensor_align_e accAlign = CW0_DEG;
+static bool mpuFifo = false;
+static int16_t tempRaw;            // left by the last combined read
 
 static void mpu6500AccInit(sensor_align_e align);
 static void mpu6500AccRead(int16_t *accData);
 static void mpu6500GyroInit(sensor_align_e align);
 static void mpu6500GyroRead(int16_t *gyroData);
+static void mpu6500GyroFifoRead(int16_t *gyroData);
+static void mpu6500ReadAll(sensor_data_t *sensorData);
+static void mpu6500ReadTemp(int16_t *tempData);
 
 extern uint16_t acc_1G;
+extern gyroFifoStats_t gyroFifoStats;
 
 static void mpu6500WriteRegister(uint8_t reg, uint8_t data)
 {
+    spiTransferWait();
     spiSelect(true);
     spiTransferByte(reg);
     spiTransferByte(data);
@@ -76,13 +93,36 @@ static void mpu6500WriteRegister(uint8_t reg, uint8_t data)
 
 static void mpu6500ReadRegister(uint8_t reg, uint8_t *data, int length)
 {
+    spiTransferWait();          // a queued acc read may still be on the bus
     spiSelect(true);
     spiTransferByte(reg | 0x80); // read transaction
-    spiTransfer(data, NULL, length);
-    spiSelect(false);
+    if (length > 1 && spiTransferDMA(data, NULL, length, NULL)) {
+        spiTransferWait();
+    } else {
+        spiTransfer(data, NULL, length);
+        spiSelect(false);
+    }
+}
+
+// The acc registers are read by DMA right after the gyro, the transfer runs while the gyro data is
+// processed and mpu6500AccRead() normally only has to collect it.
+static uint8_t accBuf[6];
+static volatile bool accReadQueued = false;
+static bool accActive = false;     // this chip is the acc in use, not just the gyro
+
+static void mpu6500QueueAccRead(void)
+{
+    if (!accActive || !spiDmaActive() || spiTransferBusy())
+        return;
+
+    spiSelect(true);
+    spiTransferByte(MPU6500_RA_ACCEL_XOUT_H | 0x80);
+    accReadQueued = spiTransferDMA(accBuf, NULL, sizeof(accBuf), NULL);
+    if (!accReadQueued)
+        spiSelect(false);
 }
 
-bool mpu6500Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf)
+bool mpu6500Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf, bool fifo)
 {
     uint8_t tmp;
 
@@ -93,7 +133,11 @@ bool mpu6500Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf)
     acc->init = mpu6500AccInit;
     acc->read = mpu6500AccRead;
     gyro->init = mpu6500GyroInit;
-    gyro->read = mpu6500GyroRead;
+    gyro->read = fifo ? mpu6500GyroFifoRead : mpu6500GyroRead;
+    // FIFO gyro data has to come from the FIFO, otherwise acc, temp and gyro are one burst
+    gyro->readAll = fifo ? NULL : mpu6500ReadAll;
+    gyro->temperature = fifo ? NULL : mpu6500ReadTemp;
+    mpuFifo = fifo;
 
     // 16.4 dps/lsb scalefactor
     gyro->scale = (4.0f / 16.4f) * (M_PI / 180.0f) * 0.000001f;
@@ -118,6 +162,7 @@ bool mpu6500Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf)
 static void mpu6500AccInit(sensor_align_e align)
 {
     acc_1G = 512 * 8;
+    accActive = true;
 
     if (align > 0)
         accAlign = align;
@@ -125,14 +170,17 @@ static void mpu6500AccInit(sensor_align_e align)
 
 static void mpu6500AccRead(int16_t *accData)
 {
-    uint8_t buf[6];
     int16_t data[3];
 
-    mpu6500ReadRegister(MPU6500_RA_ACCEL_XOUT_H, buf, 6);
+    if (accReadQueued)
+        spiTransferWait();
+    else
+        mpu6500ReadRegister(MPU6500_RA_ACCEL_XOUT_H, accBuf, 6);
+    accReadQueued = false;
 
-    data[0] = (int16_t)((buf[0] << 8) | buf[1]);
-    data[1] = (int16_t)((buf[2] << 8) | buf[3]);
-    data[2] = (int16_t)((buf[4] << 8) | buf[5]);
+    data[0] = (int16_t)((accBuf[0] << 8) | accBuf[1]);
+    data[1] = (int16_t)((accBuf[2] << 8) | accBuf[3]);
+    data[2] = (int16_t)((accBuf[4] << 8) | accBuf[5]);
 
     alignSensors(data, accData, accAlign);
 }
@@ -158,6 +206,14 @@ static void mpu6500GyroInit(sensor_align_e align)
     mpu6500WriteRegister(MPU6500_RA_ACCEL_CFG, INV_FSR_8G << 3);
     mpu6500WriteRegister(MPU6500_RA_LPF, mpuLowPassFilter);
     mpu6500WriteRegister(MPU6500_RA_RATE_DIV, 0); // 1kHz S/R
+    // data ready pulse on MPU_INT, used by gyro_sync
+    if (hw_revision >= NAZE32_REV5)
+        mpu6500WriteRegister(MPU6500_RA_INT_ENABLE, 0x01);
+    // queue every gyro sample, each loop averages whatever arrived since the last one
+    if (mpuFifo) {
+        mpu6500WriteRegister(MPU6500_RA_FIFO_EN, BIT_GYRO_FIFO_EN);
+        mpu6500WriteRegister(MPU6500_RA_USER_CTRL, BIT_FIFO_EN_RESET);
+    }
 
     if (align > 0)
         gyroAlign = align;
@@ -175,4 +231,81 @@ static void mpu6500GyroRead(int16_t *gyroData)
     data[2] = (int16_t)((buf[4] << 8) | buf[5]) / 4;
 
     alignSensors(data, gyroData, gyroAlign);
+    mpu6500QueueAccRead();
+}
+
+static void mpu6500GyroFifoRead(int16_t *gyroData)
+{
+    uint8_t buf[MPU_FIFO_BURST * 6];
+    int32_t sum[3] = { 0, 0, 0 };
+    int16_t data[3];
+    uint16_t count, samples, burst, i, j;
+
+    mpu6500ReadRegister(MPU6500_RA_FIFO_COUNTH, buf, 2);
+    count = ((buf[0] & 0x1F) << 8) | buf[1];
+
+    // a full FIFO has dropped samples and may have lost its frame alignment, start over
+    if (count > MPU6500_FIFO_SIZE - 6) {
+        gyroFifoStats.overflowCount++;
+        mpu6500WriteRegister(MPU6500_RA_USER_CTRL, BIT_FIFO_EN_RESET);
+        count = 0;
+    }
+
+    samples = count / 6;
+    if (samples == 0) {
+        // nothing queued since the last loop, use the current output registers
+        mpu6500GyroRead(gyroData);
+        return;
+    }
+
+    for (i = 0; i < samples; i += burst) {
+        burst = min(samples - i, MPU_FIFO_BURST);
+        mpu6500ReadRegister(MPU6500_RA_FIFO_RW, buf, burst * 6);
+        for (j = 0; j < burst * 6; j += 6) {
+            sum[0] += (int16_t)((buf[j] << 8) | buf[j + 1]);
+            sum[1] += (int16_t)((buf[j + 2] << 8) | buf[j + 3]);
+            sum[2] += (int16_t)((buf[j + 4] << 8) | buf[j + 5]);
+        }
+    }
+
+    // boxcar average over the loop period is the anti-alias filter, same /4 scaling as above
+    data[0] = sum[0] / (samples * 4);
+    data[1] = sum[1] / (samples * 4);
+    data[2] = sum[2] / (samples * 4);
+    gyroFifoStats.samples = samples;
+
+    alignSensors(data, gyroData, gyroAlign);
+    mpu6500QueueAccRead();
+}
+
+// ACCEL_XOUT_H (0x3B) to GYRO_ZOUT_L (0x48) in one transaction
+static void mpu6500ReadAll(sensor_data_t *sensorData)
+{
+    uint8_t buf[14];
+    int16_t data[3];
+
+    mpu6500ReadRegister(MPU6500_RA_ACCEL_XOUT_H, buf, 14);
+
+    if (accActive) {
+        data[0] = (int16_t)((buf[0] << 8) | buf[1]);
+        data[1] = (int16_t)((buf[2] << 8) | buf[3]);
+        data[2] = (int16_t)((buf[4] << 8) | buf[5]);
+        alignSensors(data, sensorData->acc, accAlign);
+        sensorData->updated |= ACC_UPDATED;
+    }
+
+    tempRaw = (int16_t)((buf[6] << 8) | buf[7]);
+
+    data[0] = (int16_t)((buf[8] << 8) | buf[9]) / 4;
+    data[1] = (int16_t)((buf[10] << 8) | buf[11]) / 4;
+    data[2] = (int16_t)((buf[12] << 8) | buf[13]) / 4;
+    alignSensors(data, sensorData->gyro, gyroAlign);
+    sensorData->updated |= GYRO_UPDATED;
+}
+
+// raw / 333.87 + 21, rounded, from what the last combined read left. Shifted up 100 degrees so the division
+// always rounds down, the chip's range starts at -77
+static void mpu6500ReadTemp(int16_t *tempData)
+{
+    *tempData = (tempRaw * 100 + 21 * 33387 + 33387 / 2 + 33387 * 100) / 33387 - 100;
 }
@@ -1,3 +1,3 @@
 #pragma once
 
-bool mpu6500Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf);
+bool mpu6500Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf, bool fifo);
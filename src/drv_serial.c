@@ -18,6 +18,27 @@ void serialWrite(serialPort_t *instance, uint8_t ch)
     instance->vTable->serialWrite(instance, ch);
 }
 
+bool serialWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t len)
+{
+    if (instance->vTable->serialWriteBuf)
+        return instance->vTable->serialWriteBuf(instance, data, len);
+
+    // all or nothing, same as the drivers that queue a whole buffer
+    if (serialTxBytesFree(instance) < len)
+        return false;
+    while (len--)
+        instance->vTable->serialWrite(instance, *data++);
+    return true;
+}
+
+uint32_t serialTxBytesFree(serialPort_t *instance)
+{
+    if (instance->vTable->serialTxBytesFree)
+        return instance->vTable->serialTxBytesFree(instance);
+
+    return (instance->txBufferTail + instance->txBufferSize - instance->txBufferHead - 1) % instance->txBufferSize;
+}
+
 uint8_t serialTotalBytesWaiting(serialPort_t *instance)
 {
     return instance->vTable->serialTotalBytesWaiting(instance);
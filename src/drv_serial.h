@@ -40,9 +40,18 @@ struct serialPortVTable {
     bool (*isSerialTransmitBufferEmpty)(serialPort_t *instance);
 
     void (*setMode)(serialPort_t *instance, portMode_t mode);
+
+    // optional, queues a whole buffer and starts the transmitter once, false and nothing queued if it doesn't fit.
+    // NULL falls back to serialWrite per byte
+    bool (*serialWriteBuf)(serialPort_t *instance, const uint8_t *data, uint32_t len);
+
+    // optional, bytes that can be queued without overwriting any still being sent. NULL counts the ring only
+    uint32_t (*serialTxBytesFree)(serialPort_t *instance);
 };
 
 void serialWrite(serialPort_t *instance, uint8_t ch);
+bool serialWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t len);
+uint32_t serialTxBytesFree(serialPort_t *instance);
 uint8_t serialTotalBytesWaiting(serialPort_t *instance);
 uint8_t serialRead(serialPort_t *instance);
 void serialSetBaudRate(serialPort_t *instance, uint32_t baudRate);
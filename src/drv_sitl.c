@@ -0,0 +1,454 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+// SITL system driver: clock, PWM and the peripherals the simulated board doesn't have.
+//
+// The clock is simulated. With a speed factor it follows the host clock scaled by it, so -s 10 flies ten times
+// faster than real time as long as the host keeps up. With -s 0 it runs in lockstep: every read moves it
+// SITL_LOCKSTEP_US forward and waits jump straight to their end. A lockstep run doesn't depend on the host at
+// all, the same input always gives the same flight, and it goes as fast as the host can run the loop. Time the
+// firmware would only spend waiting for the next task or control loop is skipped, see sitlIdle().
+//
+// The chip flash is a file, see drv_sitl_flash.c. A replay works on a private copy, whatever it saves doesn't
+// change the flight's config.
+//
+// -R records the sensor readings and RC, -r replays such a log instead of flying the model, see sitl_replay.c.
+// A replay is lockstep, doesn't listen on the serial ports and stops at the end of the log.
+//
+// A reset starts the executable over. What the firmware keeps in NOINIT RAM goes along in an unlinked temporary
+// file, its descriptor survives the exec and SITL_NOINIT_ENV names it. A fresh start has that RAM zeroed, which
+// the firmware treats like the noise after a power cycle.
+
+#define SITL_LOCKSTEP_US        2
+#define SITL_VBAT               126         // 0.1V, a charged 3S pack
+#define SITL_NOINIT_ENV         "SITL_NOINIT_FD"
+
+// the linker's bounds of the NOINIT section
+extern uint8_t __start_sitl_noinit[];
+extern uint8_t __stop_sitl_noinit[];
+
+GPIO_TypeDef sitlGpio[3];
+USART_TypeDef sitlUsart[3] = { { 0 }, { 1 }, { 2 } };
+SCB_Type sitlScb;
+uint32_t SystemCoreClock = 1000000000;
+uint32_t hse_value = 8000000;
+
+static uint64_t simTime;                    // us
+static uint64_t lastPoll;
+static uint64_t endTime;                    // 0 runs until interrupted
+static double speed = 1.0;
+static struct timespec hostStart;
+static volatile sig_atomic_t stopRequested = 0;
+static char **savedArgv;
+static char exePath[256];
+static bool replay = false;
+static uint16_t rcInput[MAX_INPUTS];
+
+static void sitlUsage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-s speed] [-t seconds] [-p port] [-f flash file] [-R log] [-r log]\n"
+                    "  -s  simulation speed, 1 is real time, 0 runs in lockstep as fast as possible (default 1)\n"
+                    "  -t  stop after this many simulated seconds and print the run statistics\n"
+                    "  -p  TCP port of USART1, USART2, USART3 and the soft serial ports follow it (default 5760)\n"
+                    "  -f  file holding the flash contents (default sitl_flash.bin)\n"
+                    "  -R  record the sensor readings and RC to this log\n"
+                    "  -r  replay this log (- for stdin) instead of the model, print angles, altitude, vario and motors\n", name);
+    exit(1);
+}
+
+static uint64_t hostNanos(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)(now.tv_sec - hostStart.tv_sec) * 1000000000 + now.tv_nsec - hostStart.tv_nsec;
+}
+
+static void sitlExit(int code)
+{
+    uint64_t host = hostNanos();
+    uint32_t loops = sitlModelGyroReads();
+#ifdef PROFILING
+    int i;
+#endif
+
+    sitlUartClose();
+    sitlReplayClose();
+    sitlFlashSync();
+
+    fprintf(stderr, "sitl: %.2fs simulated in %.2fs (%.1fx), %u loops, %.2fus host time per loop\n",
+        simTime / 1e6, host / 1e9, host ? simTime * 1e3 / host : 0.0, loops, loops ? host / 1e3 / loops : 0.0);
+    if (!replay)
+        sitlModelPrintState();
+#ifdef PROFILING
+    // host ns, a lockstep replay gives the same work to every build, see support/imutest
+    for (i = 0; i < PERF_SECTION_COUNT; i++) {
+        if (perfSections[i].count)
+            fprintf(stderr, "sitl: %-8s min %u avg %u max %u ns over %u runs\n", perfSectionNames[i],
+                perfSections[i].min, perfAverage(i), perfSections[i].max, perfSections[i].count);
+    }
+#endif
+    exit(code);
+}
+
+static void sitlStop(int sig)
+{
+    (void)sig;
+    stopRequested = 1;
+}
+
+// The logged rcData is what computeRC() made of the receiver, it goes in as MSP RC does and is taken as is. A
+// change is a new RC frame, computeRC() runs in the next loop like it did when the log was recorded.
+static void sitlReplayRc(void)
+{
+    static int32_t last[8];
+    int32_t rc[8];
+    int i;
+
+    if (!sitlReplayGet(SITL_REPLAY_RC, rc))
+        return;
+    for (i = 0; i < 8; i++)
+        rcData[i] = rc[i];
+    if (memcmp(rc, last, sizeof(rc))) {
+        memcpy(last, rc, sizeof(last));
+        mspFrameRecieve();
+    }
+}
+
+static void sitlPoll(void)
+{
+    if (replay)
+        sitlReplayRc();
+    if (simTime - lastPoll < SITL_POLL_US)
+        return;
+    lastPoll = simTime;
+
+    if (!replay)
+        sitlUartPoll();
+    if (stopRequested || sitlReplayFinished() || (endTime && simTime >= endTime))
+        sitlExit(0);
+}
+
+static void sitlClockUpdate(void)
+{
+    if (speed > 0)
+        simTime = (uint64_t)(hostNanos() * speed / 1000);
+    else
+        simTime += SITL_LOCKSTEP_US;
+    sitlPoll();
+}
+
+// the NOINIT RAM of the firmware that was reset, if it was
+static void sitlNoinitRestore(void)
+{
+    const char *fd = getenv(SITL_NOINIT_ENV);
+    size_t size = __stop_sitl_noinit - __start_sitl_noinit;
+
+    if (!fd)
+        return;
+    if (pread(atoi(fd), __start_sitl_noinit, size, 0) != (ssize_t)size)
+        memset(__start_sitl_noinit, 0, size);
+    close(atoi(fd));
+    unsetenv(SITL_NOINIT_ENV);
+}
+
+static void sitlNoinitSave(void)
+{
+    FILE *file = tmpfile();
+    char fd[16];
+
+    if (!file || fwrite(__start_sitl_noinit, __stop_sitl_noinit - __start_sitl_noinit, 1, file) != 1 || fflush(file)) {
+        perror("sitl: keeping the noinit RAM");
+        return;
+    }
+    snprintf(fd, sizeof(fd), "%d", fileno(file));
+    setenv(SITL_NOINIT_ENV, fd, 1);
+}
+
+void sitlInit(int argc, char *argv[])
+{
+    const char *flashFile = "sitl_flash.bin";
+    int opt, i;
+
+    savedArgv = argv;
+    if (readlink("/proc/self/exe", exePath, sizeof(exePath) - 1) < 0)
+        strcpy(exePath, argv[0]);
+    while ((opt = getopt(argc, argv, "s:t:p:f:R:r:")) != -1) {
+        switch (opt) {
+            case 's':
+                speed = atof(optarg);
+                break;
+            case 't':
+                endTime = (uint64_t)(atof(optarg) * 1e6);
+                break;
+            case 'p':
+                sitlUartSetBasePort(atoi(optarg));
+                break;
+            case 'f':
+                flashFile = optarg;
+                break;
+            case 'R':
+                sitlRecordOpen(optarg);
+                break;
+            case 'r':
+                sitlReplayOpen(optarg);
+                replay = true;
+                break;
+            default:
+                sitlUsage(argv[0]);
+        }
+    }
+    if (speed < 0)
+        sitlUsage(argv[0]);
+    if (replay)
+        speed = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &hostStart);
+    sitlNoinitRestore();
+    signal(SIGINT, sitlStop);
+    signal(SIGTERM, sitlStop);
+    signal(SIGPIPE, SIG_IGN);
+
+    sitlFlashInit(flashFile, replay);
+    sitlModelInit();
+
+    // sticks centered, throttle and aux low until something sends RC over MSP. Raw order of the default AETR1234 map
+    for (i = 0; i < MAX_INPUTS; i++)
+        rcInput[i] = i == 2 || i > 3 ? 1000 : 1500;
+}
+
+uint64_t sitlTime(void)
+{
+    return simTime;
+}
+
+uint32_t sitlCycleCount(void)
+{
+    return (uint32_t)hostNanos();
+}
+
+// called by the scheduler when nothing needs to run before until, a lockstep clock goes straight there
+void sitlIdle(uint32_t until)
+{
+    int32_t wait = (int32_t)(until - (uint32_t)simTime);
+
+    if (speed > 0 || wait <= 0)
+        return;
+    simTime += wait;
+    sitlPoll();
+}
+
+// drv_system.h
+
+void systemInit(void)
+{
+}
+
+// from system_stm32f10x.c, there is only the one crystal here
+void SetSysClock(bool overclock)
+{
+    (void)overclock;
+}
+
+uint32_t micros(void)
+{
+    sitlClockUpdate();
+    return (uint32_t)simTime;
+}
+
+uint32_t millis(void)
+{
+    sitlClockUpdate();
+    return (uint32_t)(simTime / 1000);
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    struct timespec wait;
+    uint64_t end = simTime + us;
+
+    if (speed > 0) {
+        wait.tv_sec = (time_t)(us / speed / 1e6);
+        wait.tv_nsec = (long)((us / speed - wait.tv_sec * 1e6) * 1000);
+        nanosleep(&wait, NULL);
+        sitlClockUpdate();
+    } else {
+        simTime = end;
+        sitlPoll();
+    }
+}
+
+void delay(uint32_t ms)
+{
+    delayMicroseconds(ms * 1000);
+}
+
+void failureMode(uint8_t mode)
+{
+    fprintf(stderr, "sitl: failure mode %d\n", mode);
+    sitlExit(1);
+}
+
+void systemReset(bool toBootloader)
+{
+    if (toBootloader) {
+        fprintf(stderr, "sitl: reboot to bootloader requested, exiting\n");
+        sitlExit(0);
+    }
+    if (sitlReplayActive()) {
+        // the log goes on from before the reset, the restarted firmware can't follow it
+        fprintf(stderr, "sitl: reset during replay, exiting\n");
+        sitlExit(0);
+    }
+
+    sitlUartClose();
+    sitlReplayClose();
+    sitlFlashSync();
+    sitlNoinitSave();
+
+    // start over with the same options, like the chip coming out of reset
+    fprintf(stderr, "sitl: reset\n");
+    execv(exePath, savedArgv);
+    perror("sitl: reset");
+    exit(1);
+}
+
+// PWM, motors go to the model. RC input stays where sitlInit() put it, MSP RC (serialrx_type 4) moves the sticks.
+// A replay feeds the logged rcData in as MSP RC whatever receiver the config has, see sitlReplayRc()
+
+bool pwmInit(drv_pwm_config_t *init)
+{
+    init->numServos = init->useServos ? MAX_SERVOS : 0;
+    if (replay) {
+        featureSet(FEATURE_SERIALRX);
+        mcfg.serialrx_type = SERIALRX_MSP;
+    }
+    return false;
+}
+
+void pwmWriteMotor(uint8_t index, uint16_t value)
+{
+    sitlModelSetMotor(index, value);
+    if (index == mixerMotorCount() - 1)
+        sitlReplayLoop();
+}
+
+void pwmWriteServo(uint8_t index, uint16_t value)
+{
+    (void)index;
+    (void)value;
+}
+
+uint16_t pwmRead(uint8_t channel)
+{
+    return channel < MAX_INPUTS ? rcInput[channel] : 0;
+}
+
+// ADC, only the battery is connected
+
+void adcInit(drv_adc_config_t *init)
+{
+    (void)init;
+}
+
+uint16_t adcGetChannel(uint8_t channel)
+{
+    // inverse of batteryAdcToVoltage(), rounded up so that truncates back to SITL_VBAT
+    if (channel == ADC_BATTERY && mcfg.vbatscale)
+        return (SITL_VBAT * 4095 * 10 + 33 * mcfg.vbatscale - 1) / (33 * mcfg.vbatscale);
+    return 0;
+}
+
+// GPIO, nothing to drive
+
+void gpioInit(GPIO_TypeDef *gpio, gpio_config_t *config)
+{
+    (void)gpio;
+    (void)config;
+}
+
+void gpioExtiConfig(uint8_t portsrc, uint8_t pinsrc, EXTITrigger_TypeDef trigger, extiCallbackPtr callback)
+{
+    (void)portsrc;
+    (void)pinsrc;
+    (void)trigger;
+    (void)callback;
+}
+
+// buses, the simulated chips don't sit on one
+
+void i2cInit(I2CDevice index)
+{
+    (void)index;
+}
+
+uint16_t i2cGetErrorCounter(void)
+{
+    return 0;
+}
+
+void i2cGetStats(i2cStats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+int spiInit(void)
+{
+    return SPI_DEVICE_NONE;
+}
+
+void spiDmaInit(void)
+{
+}
+
+bool spiDmaActive(void)
+{
+    return false;
+}
+
+void spiGetStats(spiStats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+// no flash chip on the bus, the blackbox can only stream out of a serial port
+
+bool m25p16Init(void)
+{
+    return false;
+}
+
+bool m25p16Busy(void)
+{
+    return false;
+}
+
+bool m25p16EraseAll(void)
+{
+    return false;
+}
+
+bool m25p16ProgramPage(uint32_t address, uint8_t *data, int len, spiCallbackPtr callback)
+{
+    (void)address;
+    (void)data;
+    (void)len;
+    (void)callback;
+    return false;
+}
+
+bool m25p16Read(uint32_t address, uint8_t *data, int len)
+{
+    (void)address;
+    (void)data;
+    (void)len;
+    return false;
+}
@@ -0,0 +1,92 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// SITL chip flash. A file mapped at the flash address of the real chip, config_store.c runs on it unchanged
+// and a saved config is still there the next time. Programming only clears bits and erasing works on whole
+// pages, like on the chip. support/config_store_test runs the config store on this as well.
+
+#define SITL_FLASH_BASE         0x08000000
+#define SITL_FLASH_SIZE         (128 * 1024)
+#define SITL_FLASH_PAGE_SIZE    0x400
+
+static uint8_t *flash;
+
+// a private mapping keeps whatever is saved out of the file
+void sitlFlashInit(const char *path, bool private)
+{
+    struct stat st;
+    bool blank;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    blank = st.st_size != SITL_FLASH_SIZE;
+    if (blank && ftruncate(fd, SITL_FLASH_SIZE) < 0) {
+        perror(path);
+        exit(1);
+    }
+
+    // config_store.c addresses the flash directly, it has to be where the chip has it
+    flash = mmap((void *)SITL_FLASH_BASE, SITL_FLASH_SIZE, PROT_READ | PROT_WRITE, (private ? MAP_PRIVATE : MAP_SHARED) | MAP_FIXED_NOREPLACE, fd, 0);
+    if (flash != (uint8_t *)SITL_FLASH_BASE) {
+        fprintf(stderr, "sitl: can't map flash at 0x%08x\n", SITL_FLASH_BASE);
+        exit(1);
+    }
+    close(fd);
+
+    if (blank)
+        memset(flash, 0xFF, SITL_FLASH_SIZE);
+}
+
+void sitlFlashSync(void)
+{
+    if (flash)
+        msync(flash, SITL_FLASH_SIZE, MS_SYNC);
+}
+
+void FLASH_Unlock(void)
+{
+}
+
+void FLASH_Lock(void)
+{
+}
+
+void FLASH_ClearFlag(uint32_t flags)
+{
+    (void)flags;
+}
+
+FLASH_Status FLASH_ErasePage(uint32_t address)
+{
+    if (address < SITL_FLASH_BASE || address >= SITL_FLASH_BASE + SITL_FLASH_SIZE)
+        return FLASH_ERROR_WRP;
+
+    memset(flash + ((address - SITL_FLASH_BASE) & ~(SITL_FLASH_PAGE_SIZE - 1)), 0xFF, SITL_FLASH_PAGE_SIZE);
+    return FLASH_COMPLETE;
+}
+
+FLASH_Status FLASH_ProgramHalfWord(uint32_t address, uint16_t data)
+{
+    uint16_t *p = (uint16_t *)(flash + (address - SITL_FLASH_BASE));
+
+    if (address < SITL_FLASH_BASE || address >= SITL_FLASH_BASE + SITL_FLASH_SIZE || (address & 1))
+        return FLASH_ERROR_WRP;
+    if (*p != 0xFFFF && data != 0)
+        return FLASH_ERROR_PG;
+
+    *p = data;
+    return FLASH_COMPLETE;
+}
@@ -0,0 +1,326 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// SITL serial ports. Every port the firmware opens listens on a local TCP port, USART1 on the base port (5760
+// unless changed with -p), USART2 and USART3 on the next two and the soft serial ports after those. One client
+// per port, the configurator or a script talking MSP/CLI to USART1 for instance. Bytes written while nobody is
+// connected are dropped like on an unplugged wire.
+//
+// Sockets are looked at from sitlUartPoll() every SITL_POLL_US of simulated time: received bytes go into the
+// rx ring, or to the port callback in one piece like the idle line interrupt does, and the tx ring is sent at
+// the port's baud rate, 10 bits a byte, so a stream the line can't keep up with backs up in the ring like on
+// the board. Only the CLI writing byte by byte into a full ring, and a port being reconfigured, get it all out
+// at once.
+
+#define SITL_UART_COUNT         3
+#define SITL_PORT_COUNT         (SITL_UART_COUNT + 2)   // soft serial ports come after the UARTs
+
+typedef struct sitlPort_t {
+    serialPort_t *port;                     // NULL until the firmware opens it
+    int listenFd;
+    int clientFd;
+    uint32_t txBits;                        // line time left over from the last poll
+} sitlPort_t;
+
+static sitlPort_t sitlPorts[SITL_PORT_COUNT];
+static uint16_t basePort = 5760;
+
+static uartPort_t uartPorts[SITL_UART_COUNT];
+static volatile uint8_t rx1Buffer[UART1_RX_BUFFER_SIZE];
+static volatile uint8_t tx1Buffer[UART1_TX_BUFFER_SIZE];
+static volatile uint8_t rx2Buffer[UART2_RX_BUFFER_SIZE];
+static volatile uint8_t tx2Buffer[UART2_TX_BUFFER_SIZE];
+static volatile uint8_t rx3Buffer[UART3_RX_BUFFER_SIZE];
+static volatile uint8_t tx3Buffer[UART3_TX_BUFFER_SIZE];
+
+softSerial_t softSerialPorts[2];
+
+static sitlPort_t *sitlPortFind(serialPort_t *instance)
+{
+    int i;
+
+    for (i = 0; i < SITL_PORT_COUNT; i++) {
+        if (sitlPorts[i].port == instance)
+            return &sitlPorts[i];
+    }
+    return NULL;
+}
+
+static void sitlPortOpen(int index, serialPort_t *port)
+{
+    sitlPort_t *p = &sitlPorts[index];
+    struct sockaddr_in addr;
+    int one = 1;
+
+    p->port = port;
+    port->rxBufferHead = port->rxBufferTail = 0;
+    port->txBufferHead = port->txBufferTail = 0;
+    if (p->listenFd > 0)
+        return;
+
+    p->clientFd = -1;
+    p->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (p->listenFd < 0) {
+        perror("sitl: socket");
+        return;
+    }
+    setsockopt(p->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    fcntl(p->listenFd, F_SETFL, O_NONBLOCK);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(basePort + index);
+    if (bind(p->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(p->listenFd, 1) < 0) {
+        fprintf(stderr, "sitl: can't listen on port %d: %s\n", basePort + index, strerror(errno));
+        close(p->listenFd);
+        p->listenFd = -1;
+        return;
+    }
+    fprintf(stderr, "sitl: serial port %d on tcp port %d\n", index + 1, basePort + index);
+}
+
+static void sitlPortDisconnect(sitlPort_t *p)
+{
+    close(p->clientFd);
+    p->clientFd = -1;
+}
+
+// sends up to limit bytes of the tx ring
+static void sitlPortSend(sitlPort_t *p, uint32_t limit)
+{
+    serialPort_t *s = p->port;
+    uint32_t end;
+    ssize_t sent;
+
+    while (s->txBufferTail != s->txBufferHead && limit) {
+        if (p->clientFd < 0) {
+            s->txBufferTail = s->txBufferHead;
+            break;
+        }
+        end = s->txBufferHead > s->txBufferTail ? s->txBufferHead : s->txBufferSize;
+        // blocking, a client that is slow to read holds up the simulation rather than losing bytes
+        sent = send(p->clientFd, (const uint8_t *)&s->txBuffer[s->txBufferTail], min(end - s->txBufferTail, limit), MSG_NOSIGNAL);
+        if (sent <= 0) {
+            sitlPortDisconnect(p);
+            continue;
+        }
+        s->txBufferTail = (s->txBufferTail + sent) % s->txBufferSize;
+        limit -= sent;
+    }
+}
+
+static void sitlPortFlush(sitlPort_t *p)
+{
+    sitlPortSend(p, UINT32_MAX);
+}
+
+static void sitlPortReceive(sitlPort_t *p)
+{
+    serialPort_t *s = p->port;
+    uint8_t buf[256];
+    uint32_t space;
+    ssize_t len;
+    int i;
+
+    // without a callback only take what fits, the rest waits in the socket
+    space = (s->rxBufferTail + s->rxBufferSize - s->rxBufferHead - 1) % s->rxBufferSize;
+    if (!s->callback && space == 0)
+        return;
+
+    len = recv(p->clientFd, buf, s->callback || space > sizeof(buf) ? sizeof(buf) : space, MSG_DONTWAIT);
+    if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        sitlPortDisconnect(p);
+        return;
+    }
+    if (len < 0)
+        return;
+
+    if (s->callback) {
+        s->callback(buf, len);
+        return;
+    }
+    for (i = 0; i < len; i++) {
+        s->rxBuffer[s->rxBufferHead] = buf[i];
+        s->rxBufferHead = (s->rxBufferHead + 1) % s->rxBufferSize;
+    }
+}
+
+void sitlUartPoll(void)
+{
+    sitlPort_t *p;
+    int i, one = 1;
+
+    for (i = 0; i < SITL_PORT_COUNT; i++) {
+        p = &sitlPorts[i];
+        if (!p->port || p->listenFd <= 0)
+            continue;
+
+        if (p->clientFd < 0) {
+            p->clientFd = accept(p->listenFd, NULL, NULL);
+            if (p->clientFd < 0)
+                continue;
+            setsockopt(p->clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        // an idle line doesn't save up time for later
+        p->txBits += p->port->baudRate / (1000000 / SITL_POLL_US);
+        sitlPortSend(p, p->txBits / 10);
+        p->txBits = p->port->txBufferTail == p->port->txBufferHead ? 0 : p->txBits % 10;
+        if (p->clientFd >= 0 && (p->port->mode & MODE_RX))
+            sitlPortReceive(p);
+    }
+}
+
+void sitlUartClose(void)
+{
+    int i;
+
+    for (i = 0; i < SITL_PORT_COUNT; i++) {
+        if (sitlPorts[i].listenFd <= 0)
+            continue;
+        sitlPortFlush(&sitlPorts[i]);
+        if (sitlPorts[i].clientFd >= 0)
+            close(sitlPorts[i].clientFd);
+        close(sitlPorts[i].listenFd);
+        sitlPorts[i].port = NULL;
+        sitlPorts[i].listenFd = 0;
+    }
+}
+
+void sitlUartSetBasePort(uint16_t port)
+{
+    basePort = port;
+}
+
+// serialPort API, shared by the UARTs and the soft serial ports
+
+void uartWrite(serialPort_t *instance, uint8_t ch)
+{
+    uint32_t next = (instance->txBufferHead + 1) % instance->txBufferSize;
+
+    if (next == instance->txBufferTail)
+        sitlPortFlush(sitlPortFind(instance));
+    instance->txBuffer[instance->txBufferHead] = ch;
+    instance->txBufferHead = next;
+}
+
+// like the chip: all or nothing, and the ring only empties when the sockets are polled
+bool uartWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t len)
+{
+    if ((instance->txBufferTail + instance->txBufferSize - instance->txBufferHead - 1) % instance->txBufferSize < len)
+        return false;
+    while (len--)
+        uartWrite(instance, *data++);
+    return true;
+}
+
+uint8_t uartTotalBytesWaiting(serialPort_t *instance)
+{
+    uint32_t waiting = (instance->rxBufferHead + instance->rxBufferSize - instance->rxBufferTail) % instance->rxBufferSize;
+
+    return waiting > 255 ? 255 : waiting;
+}
+
+uint8_t uartRead(serialPort_t *instance)
+{
+    uint8_t ch = instance->rxBuffer[instance->rxBufferTail];
+
+    instance->rxBufferTail = (instance->rxBufferTail + 1) % instance->rxBufferSize;
+    return ch;
+}
+
+void uartSetBaudRate(serialPort_t *instance, uint32_t baudRate)
+{
+    instance->baudRate = baudRate;
+}
+
+static void uartSetMode(serialPort_t *instance, portMode_t mode)
+{
+    instance->mode = mode;
+}
+
+// the sender waits for this before reconfiguring a port, the bytes have to be out by then
+bool isUartTransmitBufferEmpty(serialPort_t *instance)
+{
+    sitlPortFlush(sitlPortFind(instance));
+    return true;
+}
+
+const struct serialPortVTable uartVTable[] = {
+    {
+        uartWrite,
+        uartTotalBytesWaiting,
+        uartRead,
+        uartSetBaudRate,
+        isUartTransmitBufferEmpty,
+        uartSetMode,
+        uartWriteBuf,
+        NULL,
+    }
+};
+
+serialPort_t *uartOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback, uint32_t baudRate, portMode_t mode)
+{
+    static volatile uint8_t * const rxBuffers[SITL_UART_COUNT] = { rx1Buffer, rx2Buffer, rx3Buffer };
+    static volatile uint8_t * const txBuffers[SITL_UART_COUNT] = { tx1Buffer, tx2Buffer, tx3Buffer };
+    static const uint32_t rxSizes[SITL_UART_COUNT] = { UART1_RX_BUFFER_SIZE, UART2_RX_BUFFER_SIZE, UART3_RX_BUFFER_SIZE };
+    static const uint32_t txSizes[SITL_UART_COUNT] = { UART1_TX_BUFFER_SIZE, UART2_TX_BUFFER_SIZE, UART3_TX_BUFFER_SIZE };
+    uartPort_t *s;
+
+    if (!USARTx)
+        return NULL;
+
+    s = &uartPorts[USARTx->index];
+    s->USARTx = USARTx;
+    s->port.vTable = uartVTable;
+    s->port.rxBuffer = rxBuffers[USARTx->index];
+    s->port.txBuffer = txBuffers[USARTx->index];
+    s->port.rxBufferSize = rxSizes[USARTx->index];
+    s->port.txBufferSize = txSizes[USARTx->index];
+    s->port.callback = callback;
+    s->port.mode = mode;
+    s->port.baudRate = baudRate;
+    sitlPortOpen(USARTx->index, &s->port);
+
+    return &s->port;
+}
+
+// soft serial, same thing on the ports after the UARTs
+
+static void softSerialOpen(int index, uint32_t baud)
+{
+    softSerial_t *s = &softSerialPorts[index];
+
+    s->port.vTable = uartVTable;
+    s->port.rxBuffer = s->rxBuffer;
+    s->port.txBuffer = s->txBuffer;
+    s->port.rxBufferSize = SOFT_SERIAL_BUFFER_SIZE;
+    s->port.txBufferSize = SOFT_SERIAL_BUFFER_SIZE;
+    s->port.callback = NULL;
+    s->port.mode = MODE_RXTX;
+    s->port.baudRate = baud;
+    sitlPortOpen(SITL_UART_COUNT + index, &s->port);
+}
+
+void setupSoftSerialPrimary(uint32_t baud, uint8_t inverted)
+{
+    softSerialPorts[0].isInverted = inverted;
+    softSerialOpen(0, baud);
+}
+
+void setupSoftSerialSecondary(uint8_t inverted)
+{
+    softSerialPorts[1].isInverted = inverted;
+    softSerialOpen(1, softSerialPorts[0].port.baudRate);
+}
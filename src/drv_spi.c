@@ -15,6 +15,16 @@ static int spiDetect(void);
 
 #define FLASH_M25P16    (0x202015)
 
+// DMA1 channel 4/5 are SPI2 RX/TX, shared with USART1 which runs on interrupts once spiDmaInit() was called
+#define SPI_RX_DMA      DMA1_Channel4
+#define SPI_TX_DMA      DMA1_Channel5
+
+static bool spiDmaEnabled = false;
+static volatile bool spiDmaBusy = false;
+static spiCallbackPtr spiDmaCallback;
+static uint8_t spiDummyByte;
+static spiStats_t spiStats;
+
 int spiInit(void)
 {
     gpio_config_t gpio;
@@ -78,6 +88,8 @@ uint8_t spiTransferByte(uint8_t in)
 bool spiTransfer(uint8_t *out, uint8_t *in, int len)
 {
     uint8_t b;
+    spiStats.transfers++;
+    spiStats.bytes += len;
     SPI2->DR;
     while (len--) {
         b = in ? *(in++) : 0xFF;
@@ -92,6 +104,113 @@ bool spiTransfer(uint8_t *out, uint8_t *in, int len)
     return true;
 }
 
+void spiDmaInit(void)
+{
+    NVIC_InitTypeDef nvic;
+
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    // RX completes last, its transfer complete ends the transaction
+    nvic.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+    nvic.NVIC_IRQChannelPreemptionPriority = 1;
+    nvic.NVIC_IRQChannelSubPriority = 1;
+    nvic.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvic);
+
+    spiDmaEnabled = true;
+}
+
+bool spiDmaActive(void)
+{
+    return spiDmaEnabled;
+}
+
+// Clocks len bytes into out (and from in, or 0xFF when in is NULL) after the caller has selected the
+// device and sent any command bytes. Returns right away, the chip select is released and callback
+// run from the DMA interrupt when the last byte is in. Without spiDmaInit() it is done polled.
+bool spiTransferDMA(uint8_t *out, uint8_t *in, int len, spiCallbackPtr callback)
+{
+    DMA_InitTypeDef dma;
+
+    if (!spiDmaEnabled || len <= 0) {
+        spiTransfer(out, in, len);
+        spiSelect(false);
+        if (callback)
+            callback();
+        return true;
+    }
+
+    if (spiDmaBusy) {
+        spiStats.dmaRejected++;
+        return false;
+    }
+
+    spiDmaBusy = true;
+    spiDmaCallback = callback;
+    spiStats.dmaTransfers++;
+    spiStats.bytes += len;
+    spiDummyByte = 0xFF;
+    SPI2->DR;
+
+    DMA_StructInit(&dma);
+    dma.DMA_PeripheralBaseAddr = (uint32_t)&SPI2->DR;
+    dma.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    dma.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+    dma.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+    dma.DMA_Mode = DMA_Mode_Normal;
+    dma.DMA_Priority = DMA_Priority_High;
+    dma.DMA_M2M = DMA_M2M_Disable;
+    dma.DMA_BufferSize = len;
+
+    // received bytes are dropped into the dummy byte if nobody wants them
+    dma.DMA_DIR = DMA_DIR_PeripheralSRC;
+    dma.DMA_MemoryBaseAddr = out ? (uint32_t)out : (uint32_t)&spiDummyByte;
+    dma.DMA_MemoryInc = out ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+    DMA_DeInit(SPI_RX_DMA);
+    DMA_Init(SPI_RX_DMA, &dma);
+    DMA_ITConfig(SPI_RX_DMA, DMA_IT_TC, ENABLE);
+
+    dma.DMA_DIR = DMA_DIR_PeripheralDST;
+    dma.DMA_MemoryBaseAddr = in ? (uint32_t)in : (uint32_t)&spiDummyByte;
+    dma.DMA_MemoryInc = in ? DMA_MemoryInc_Enable : DMA_MemoryInc_Disable;
+    DMA_DeInit(SPI_TX_DMA);
+    DMA_Init(SPI_TX_DMA, &dma);
+
+    DMA_Cmd(SPI_RX_DMA, ENABLE);
+    DMA_Cmd(SPI_TX_DMA, ENABLE);
+    SPI_I2S_DMACmd(SPI2, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, ENABLE);
+
+    return true;
+}
+
+bool spiTransferBusy(void)
+{
+    return spiDmaBusy;
+}
+
+void spiTransferWait(void)
+{
+    while (spiDmaBusy);
+}
+
+// called from DMA1_Channel4_IRQHandler in drv_uart.c while USART1 is not using the channel
+void spiDmaIRQHandler(void)
+{
+    DMA_ClearITPendingBit(DMA1_IT_TC4);
+    SPI_I2S_DMACmd(SPI2, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, DISABLE);
+    DMA_Cmd(SPI_RX_DMA, DISABLE);
+    DMA_Cmd(SPI_TX_DMA, DISABLE);
+    spiSelect(false);
+    spiDmaBusy = false;
+    if (spiDmaCallback)
+        spiDmaCallback();
+}
+
+void spiGetStats(spiStats_t *stats)
+{
+    *stats = spiStats;
+}
+
 static int spiDetect(void)
 {
     uint8_t out[] = { 0x9F, 0, 0, 0 };
@@ -106,8 +225,8 @@ static int spiDetect(void)
     if (flash_id == FLASH_M25P16)
         return SPI_DEVICE_FLASH;
 
-    // try autodetect MPU
-    delay(50);
+    // try autodetect MPU, 50ms after power up
+    while (millis() < 50);
     spiSelect(true);
     spiTransferByte(0x75 | 0x80);
     in[0] = spiTransferByte(0xff);
@@ -4,7 +4,23 @@
 #define SPI_DEVICE_FLASH    (1)
 #define SPI_DEVICE_MPU      (2)
 
+typedef void (*spiCallbackPtr)(void);
+
+typedef struct spiStats_t {
+    uint32_t transfers;                 // polled spiTransfer() calls
+    uint32_t dmaTransfers;
+    uint32_t bytes;
+    uint16_t dmaRejected;               // spiTransferDMA() calls made while a transfer was still running
+} spiStats_t;
+
 int spiInit(void);
 void spiSelect(bool select);
 uint8_t spiTransferByte(uint8_t in);
 bool spiTransfer(uint8_t *out, uint8_t *in, int len);
+void spiDmaInit(void);
+bool spiDmaActive(void);
+bool spiTransferDMA(uint8_t *out, uint8_t *in, int len, spiCallbackPtr callback);
+bool spiTransferBusy(void);
+void spiTransferWait(void);
+void spiDmaIRQHandler(void);
+void spiGetStats(spiStats_t *stats);
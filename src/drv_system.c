@@ -21,6 +21,12 @@ static void cycleCounterInit(void)
     RCC_ClocksTypeDef clocks;
     RCC_GetClocksFreq(&clocks);
     usTicks = clocks.SYSCLK_Frequency / 1000000;
+#ifdef PROFILING
+    // DWT cycle counter for the loop profiler, needs trace enabled in the debug block
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
 }
 
 // SysTick
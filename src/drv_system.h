@@ -7,6 +7,18 @@ void delay(uint32_t ms);
 uint32_t micros(void);
 uint32_t millis(void);
 
+#if defined(PROFILING) && defined(SITL)
+// host clock in ns, SystemCoreClock is 1GHz on SITL
+#define cycleCount()        sitlCycleCount()
+#elif defined(PROFILING)
+// DWT registers aren't covered by this CMSIS version
+#define DWT_CTRL            (*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT          (*(volatile uint32_t *)0xE0001004)
+#define DWT_CTRL_CYCCNTENA  (1 << 0)
+// free running core clock cycle count, wraps every ~60s at 72MHz
+#define cycleCount()        (DWT_CYCCNT)
+#endif
+
 // failure
 void failureMode(uint8_t mode);
 
@@ -32,6 +32,13 @@ uartPort_t *serialUSART1(uint32_t baudRate, portMode_t mode)
 
     s->rxDMAChannel = DMA1_Channel5;
     s->txDMAChannel = DMA1_Channel4;
+#ifndef CJMCU
+    // SPI2 transfers own both channels, fall back to RX/TX by IRQ
+    if (spiDmaActive()) {
+        s->rxDMAChannel = NULL;
+        s->txDMAChannel = NULL;
+    }
+#endif
 
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART1, ENABLE);
     // USART1_TX    PA9
@@ -46,8 +53,8 @@ uartPort_t *serialUSART1(uint32_t baudRate, portMode_t mode)
     if (mode & MODE_RX)
         gpioInit(GPIOA, &gpio);
 
-    // DMA TX Interrupt
-    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+    // DMA TX Interrupt, or RX/TX Interrupt
+    NVIC_InitStructure.NVIC_IRQChannel = s->txDMAChannel ? DMA1_Channel4_IRQn : USART1_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
@@ -56,7 +63,7 @@ uartPort_t *serialUSART1(uint32_t baudRate, portMode_t mode)
     return s;
 }
 
-// USART2 - GPS or Spektrum or ?? (RX + TX by IRQ)
+// USART2 - GPS or Spektrum or ?? (RX by DMA, TX by IRQ)
 uartPort_t *serialUSART2(uint32_t baudRate, portMode_t mode)
 {
     uartPort_t *s;
@@ -75,6 +82,9 @@ uartPort_t *serialUSART2(uint32_t baudRate, portMode_t mode)
     s->port.rxBuffer = rx2Buffer;
     s->port.txBuffer = tx2Buffer;
 
+    s->rxDMAChannel = DMA1_Channel6;
+    s->txDMAChannel = NULL;
+
     s->USARTx = USART2;
 
     RCC_APB1PeriphClockCmd(RCC_APB1Periph_USART2, ENABLE);
@@ -90,7 +100,7 @@ uartPort_t *serialUSART2(uint32_t baudRate, portMode_t mode)
     if (mode & MODE_RX)
         gpioInit(GPIOA, &gpio);
 
-    // RX/TX Interrupt
+    // TX and RX idle line Interrupt
     NVIC_InitStructure.NVIC_IRQChannel = USART2_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority = 2;
@@ -167,7 +177,7 @@ serialPort_t *uartOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback,
     // common serial initialisation code should move to serialPort::init()
     s->port.rxBufferHead = s->port.rxBufferTail = 0;
     s->port.txBufferHead = s->port.txBufferTail = 0;
-    // callback for IRQ-based RX ONLY
+    // frame callback, DMA RX ONLY. called from the idle line interrupt with everything received since the last one
     s->port.callback = callback;
     s->port.mode = mode;
     s->port.baudRate = baudRate;
@@ -211,6 +221,8 @@ serialPort_t *uartOpen(USART_TypeDef *USARTx, serialReceiveCallbackPtr callback,
             DMA_Cmd(s->rxDMAChannel, ENABLE);
             USART_DMACmd(USARTx, USART_DMAReq_Rx, ENABLE);
             s->rxDMAPos = DMA_GetCurrDataCounter(s->rxDMAChannel);
+            if (callback)
+                USART_ITConfig(USARTx, USART_IT_IDLE, ENABLE);
         } else {
             USART_ITConfig(USARTx, USART_IT_RXNE, ENABLE);
         }
@@ -298,6 +310,22 @@ bool isUartTransmitBufferEmpty(serialPort_t *instance)
         return s->port.txBufferTail == s->port.txBufferHead;
 }
 
+uint32_t uartTxBytesFree(serialPort_t *instance)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    uint32_t tail = *(volatile uint32_t *)&s->port.txBufferTail;
+    uint32_t free = (tail + s->port.txBufferSize - s->port.txBufferHead - 1) % s->port.txBufferSize;
+    uint32_t sending;
+
+    // uartStartTxDMA() moves the tail past a chunk as soon as it starts, the last CNDTR bytes before the tail
+    // are still going out. Tail first: a chunk starting in between only makes the result come out low
+    if (s->txDMAChannel && (s->txDMAChannel->CCR & 1)) {
+        sending = s->txDMAChannel->CNDTR;
+        free = sending < free ? free - sending : 0;
+    }
+    return free;
+}
+
 uint8_t uartRead(serialPort_t *instance)
 {
     uint8_t ch;
@@ -315,12 +343,8 @@ uint8_t uartRead(serialPort_t *instance)
     return ch;
 }
 
-void uartWrite(serialPort_t *instance, uint8_t ch)
+static void uartStartTx(uartPort_t *s)
 {
-    uartPort_t *s = (uartPort_t *)instance;
-    s->port.txBuffer[s->port.txBufferHead] = ch;
-    s->port.txBufferHead = (s->port.txBufferHead + 1) % s->port.txBufferSize;
-
     if (s->txDMAChannel) {
         if (!(s->txDMAChannel->CCR & 1))
             uartStartTxDMA(s);
@@ -329,6 +353,39 @@ void uartWrite(serialPort_t *instance, uint8_t ch)
     }
 }
 
+void uartWrite(serialPort_t *instance, uint8_t ch)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    s->port.txBuffer[s->port.txBufferHead] = ch;
+    s->port.txBufferHead = (s->port.txBufferHead + 1) % s->port.txBufferSize;
+
+    uartStartTx(s);
+}
+
+bool uartWriteBuf(serialPort_t *instance, const uint8_t *data, uint32_t len)
+{
+    uartPort_t *s = (uartPort_t *)instance;
+    uint32_t chunk;
+
+    // never lap the tail, the caller decides whether to drop or retry
+    if (uartTxBytesFree(instance) < len)
+        return false;
+
+    // copy in at most two pieces around the end of the ring, then kick the transmitter once for all of it
+    while (len) {
+        chunk = s->port.txBufferSize - s->port.txBufferHead;
+        if (chunk > len)
+            chunk = len;
+        memcpy((uint8_t *)&s->port.txBuffer[s->port.txBufferHead], data, chunk);
+        s->port.txBufferHead = (s->port.txBufferHead + chunk) % s->port.txBufferSize;
+        data += chunk;
+        len -= chunk;
+    }
+
+    uartStartTx(s);
+    return true;
+}
+
 const struct serialPortVTable uartVTable[] = {
     { 
         uartWrite, 
@@ -337,15 +394,23 @@ const struct serialPortVTable uartVTable[] = {
         uartSetBaudRate,
         isUartTransmitBufferEmpty,
         uartSetMode,
+        uartWriteBuf,
+        uartTxBytesFree,
     }
 };
 
 // Handlers
 
-// USART1 Tx DMA Handler
+// USART1 Tx DMA Handler, or SPI2 Rx DMA when USART1 isn't using DMA
 void DMA1_Channel4_IRQHandler(void)
 {
     uartPort_t *s = &uartPort1;
+#ifndef CJMCU
+    if (!s->txDMAChannel) {
+        spiDmaIRQHandler();
+        return;
+    }
+#endif
     DMA_ClearITPendingBit(DMA1_IT_TC4);
     DMA_Cmd(s->txDMAChannel, DISABLE);
 
@@ -368,12 +433,16 @@ void DMA1_Channel2_IRQHandler(void)
         s->txDMAEmpty = true;
 }
 
-// USART1 Tx IRQ Handler
+// USART1 Rx/Tx IRQ Handler
 void USART1_IRQHandler(void)
 {
     uartPort_t *s = &uartPort1;
     uint16_t SR = s->USARTx->SR;
 
+    if (SR & USART_FLAG_RXNE) {
+        s->port.rxBuffer[s->port.rxBufferHead] = s->USARTx->DR;
+        s->port.rxBufferHead = (s->port.rxBufferHead + 1) % s->port.rxBufferSize;
+    }
     if (SR & USART_FLAG_TXE) {
         if (s->port.txBufferTail != s->port.txBufferHead) {
             s->USARTx->DR = s->port.txBuffer[s->port.txBufferTail];
@@ -384,20 +453,22 @@ void USART1_IRQHandler(void)
     }
 }
 
-// USART2 Rx/Tx IRQ Handler
+// USART2 Rx idle/Tx IRQ Handler
 void USART2_IRQHandler(void)
 {
+    static uint8_t frame[UART2_RX_BUFFER_SIZE];
     uartPort_t *s = &uartPort2;
     uint16_t SR = s->USARTx->SR;
-
-    if (SR & USART_FLAG_RXNE) {
-        // If we registered a callback, pass crap there
-        if (s->port.callback) {
-            s->port.callback(s->USARTx->DR);
-        } else {
-            s->port.rxBuffer[s->port.rxBufferHead] = s->USARTx->DR;
-            s->port.rxBufferHead = (s->port.rxBufferHead + 1) % s->port.rxBufferSize;
-        }
+    uint16_t len = 0;
+
+    if (SR & USART_FLAG_IDLE) {
+        // reading DR after SR clears the idle flag, the data itself is already in the DMA buffer
+        (void)s->USARTx->DR;
+        // the line went quiet, so what arrived since last time is a whole frame. hand it over in one piece
+        while (uartTotalBytesWaiting(&s->port) && len < sizeof(frame))
+            frame[len++] = uartRead(&s->port);
+        if (len && s->port.callback)
+            s->port.callback(frame, len);
     }
     if (SR & USART_FLAG_TXE) {
         if (s->port.txBufferTail != s->port.txBufferHead) {
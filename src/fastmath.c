@@ -0,0 +1,278 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+
+#ifdef FAST_MATH
+
+// Polynomial replacements for the libm calls in the flight hot path. The F103 has no FPU, every
+// libm transcendental is a few thousand cycles of soft-float, these are a handful of multiplies.
+// Max errors below were measured against libm over the full input range on the host.
+
+#define M_PI_F      3.14159265358979f
+#define M_PI_2_F    1.57079632679490f
+
+// sin(x) for x in [-pi/2, pi/2], Taylor series up to x^9
+static float sinPoly(float x)
+{
+    float x2 = x * x;
+    return x * (1.0f + x2 * (-1.6666667e-1f + x2 * (8.3333333e-3f + x2 * (-1.9841270e-4f + x2 * 2.7557319e-6f))));
+}
+
+// fold any angle into [-pi/2, pi/2] with the same sine
+static float sinReduce(float x)
+{
+    // no loops, angles in the flight code stay within a few turns
+    x -= (2.0f * M_PI_F) * (int32_t)(x * (1.0f / (2.0f * M_PI_F)));
+    if (x > M_PI_F)
+        x -= 2.0f * M_PI_F;
+    else if (x < -M_PI_F)
+        x += 2.0f * M_PI_F;
+
+    if (x > M_PI_2_F)
+        x = M_PI_F - x;
+    else if (x < -M_PI_2_F)
+        x = -M_PI_F - x;
+    return x;
+}
+
+// max abs error 4e-6
+float fastSin(float x)
+{
+    return sinPoly(sinReduce(x));
+}
+
+// max abs error 4e-6
+float fastCos(float x)
+{
+    return sinPoly(sinReduce(x + M_PI_2_F));
+}
+
+void fastSinCos(float x, float *s, float *c)
+{
+    *s = fastSin(x);
+    *c = fastCos(x);
+}
+
+// atan(z) for z in [0, 1], Abramowitz & Stegun 4.4.49
+static float atanPoly(float z)
+{
+    float z2 = z * z;
+    return z * (0.9998660f + z2 * (-0.3302995f + z2 * (0.1801410f + z2 * (-0.0851330f + z2 * 0.0208351f))));
+}
+
+// max abs error 1.2e-5 rad
+float fastAtan2(float y, float x)
+{
+    float absX = fabsf(x);
+    float absY = fabsf(y);
+    float res;
+
+    if (absX == 0.0f && absY == 0.0f)
+        return 0.0f;
+
+    if (absY > absX)
+        res = M_PI_2_F - atanPoly(absX / absY);
+    else
+        res = atanPoly(absY / absX);
+
+    if (x < 0.0f)
+        res = M_PI_F - res;
+    if (y < 0.0f)
+        res = -res;
+    return res;
+}
+
+// max abs error 7e-5 rad, Abramowitz & Stegun 4.4.45
+float fastAcos(float x)
+{
+    float absX = fabsf(x);
+    float res;
+
+    if (absX > 1.0f)
+        absX = 1.0f;
+    res = sqrtf(1.0f - absX) * (1.5707288f + absX * (-0.2121144f + absX * (0.0742610f - absX * 0.0187293f)));
+    return x < 0.0f ? M_PI_F - res : res;
+}
+
+// max relative error 5e-6, bit trick estimate plus two Newton-Raphson steps
+float fastInvSqrt(float x)
+{
+    union {
+        float f;
+        uint32_t i;
+    } conv;
+    float halfX = 0.5f * x;
+
+    conv.f = x;
+    conv.i = 0x5F3759DF - (conv.i >> 1);
+    conv.f = conv.f * (1.5f - halfX * conv.f * conv.f);
+    conv.f = conv.f * (1.5f - halfX * conv.f * conv.f);
+    return conv.f;
+}
+
+// Barometric formula (1 - (p / p0) ^ 0.190295) * 4433000 in cm, p in Pa.
+// (p / p0) ^ a = exp(a * ln(p / p0)) with ln from the atanh series and exp from its Taylor series,
+// both converge fast because p / p0 stays within [0.5, 1.1] (about -700m .. 5500m).
+// max error 0.5cm over that range, same as evaluating powf() in single precision
+float fastPressureToAltitude(float pressure)
+{
+    float ratio = pressure * (1.0f / 101325.0f);
+    float s = (ratio - 1.0f) / (ratio + 1.0f);
+    float s2 = s * s;
+    float ln = 2.0f * s * (1.0f + s2 * (1.0f / 3.0f + s2 * (1.0f / 5.0f + s2 * (1.0f / 7.0f + s2 * (1.0f / 9.0f + s2 * (1.0f / 11.0f))))));
+    float u = 0.190295f * ln;
+    float e = 1.0f + u * (1.0f + u * (0.5f + u * (1.0f / 6.0f + u * (1.0f / 24.0f + u * (1.0f / 120.0f)))));
+    return (1.0f - e) * 4433000.0f;
+}
+
+#endif
+
+#ifdef FIXED_IMU
+
+// Fixed point versions for the FIXED_IMU estimator: angles in Q28 radians, sin/cos and other unit
+// values in Q30. Only 32x32->64 multiplies and one integer division, no soft-float at all.
+
+#define FIX_PI_Q28          843314857
+#define FIX_PI_2_Q28        421657428
+
+#define FIX_MUL29(a, b)     ((int32_t)(((int64_t)(a) * (b)) >> 29))
+
+// sin(x) for x in [-pi/2, pi/2] as Q30, same series as sinPoly()
+static int32_t fixSinPoly(int32_t x)
+{
+    int32_t x2 = (int32_t)(((int64_t)x * x) >> 27);    // Q29, x^2 goes up to 2.47
+    int32_t r;
+
+    r = 2959;                               // 1/9!
+    r = -213044 + FIX_MUL29(r, x2);         // -1/7!
+    r = 8947849 + FIX_MUL29(r, x2);         // 1/5!
+    r = -178956971 + FIX_MUL29(r, x2);      // -1/3!
+    r = FIX_Q30_ONE + FIX_MUL29(r, x2);
+    return (int32_t)(((int64_t)r * x) >> 28);
+}
+
+// angle must be within +/- 3 pi, which is everything a Q28 int32 can hold
+static int32_t fixSinReduce(int32_t x)
+{
+    if (x > FIX_PI_Q28)
+        x -= 2 * FIX_PI_Q28;
+    else if (x < -FIX_PI_Q28)
+        x += 2 * FIX_PI_Q28;
+
+    if (x > FIX_PI_2_Q28)
+        x = FIX_PI_Q28 - x;
+    else if (x < -FIX_PI_2_Q28)
+        x = -FIX_PI_Q28 - x;
+    return x;
+}
+
+// max abs error 4e-6
+int32_t fixSin(int32_t x)
+{
+    return fixSinPoly(fixSinReduce(x));
+}
+
+// max abs error 4e-6
+int32_t fixCos(int32_t x)
+{
+    // shift towards zero first so the sum can't overflow
+    if (x > 0)
+        return fixSinPoly(fixSinReduce(x - 3 * FIX_PI_2_Q28));
+    return fixSinPoly(fixSinReduce(x + FIX_PI_2_Q28));
+}
+
+void fixSinCos(int32_t x, int32_t *s, int32_t *c)
+{
+    *s = fixSin(x);
+    *c = fixCos(x);
+}
+
+// y and x in any common scale, result in Q28 radians. max abs error 7e-5 rad
+int32_t fixAtan2(int32_t y, int32_t x)
+{
+    uint32_t absX = x < 0 ? -(uint32_t)x : (uint32_t)x;
+    uint32_t absY = y < 0 ? -(uint32_t)y : (uint32_t)y;
+    uint32_t hi = absY > absX ? absY : absX;
+    uint32_t lo = absY > absX ? absX : absY;
+    int32_t z, z2, res;
+
+    if (hi == 0)
+        return 0;
+
+    // scale down so the Q15 ratio is a single 32bit division
+    if (hi > 0xFFFF) {
+        int shift = 16 - __builtin_clz(hi);
+        hi >>= shift;
+        lo >>= shift;
+    }
+    z = (int32_t)(((lo << 15) / hi) << 15);
+
+    // same Abramowitz & Stegun polynomial as atanPoly()
+    z2 = FIX_MUL(z, z);
+    res = 22371518;
+    res = -91410863 + FIX_MUL(res, z2);
+    res = 193424926 + FIX_MUL(res, z2);
+    res = -354656388 + FIX_MUL(res, z2);
+    res = 1073597943 + FIX_MUL(res, z2);
+    res = FIX_MUL(res, z) / 4;              // Q30 -> Q28
+
+    if (absY > absX)
+        res = FIX_PI_2_Q28 - res;
+    if (x < 0)
+        res = FIX_PI_Q28 - res;
+    if (y < 0)
+        res = -res;
+    return res;
+}
+
+// integer square root, rounded down
+uint32_t fixSqrt64(uint64_t x)
+{
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > x)
+        bit >>= 2;
+    while (bit) {
+        if (x >= res + bit) {
+            x -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)res;
+}
+
+// Same series as fastPressureToAltitude(), evaluated in Q30. pressure in Pa, result in cm.
+// max error 1cm over 500..1100 hPa
+int32_t fixPressureToAltitude(int32_t pressure)
+{
+    int32_t ratio = (int32_t)(((int64_t)pressure << 30) / 101325);
+    int32_t s = (int32_t)(((int64_t)(ratio - FIX_Q30_ONE) << 30) / ((int64_t)ratio + FIX_Q30_ONE));
+    int32_t s2 = FIX_MUL(s, s);
+    int32_t ln, u, e;
+
+    ln = 97612893;                          // 1/11
+    ln = 119304647 + FIX_MUL(ln, s2);       // 1/9
+    ln = 153391689 + FIX_MUL(ln, s2);       // 1/7
+    ln = 214748365 + FIX_MUL(ln, s2);       // 1/5
+    ln = 357913941 + FIX_MUL(ln, s2);       // 1/3
+    ln = FIX_Q30_ONE + FIX_MUL(ln, s2);
+    ln = 2 * FIX_MUL(ln, s);
+
+    u = FIX_MUL(ln, 204327700);             // 0.190295
+    e = 8947849;                            // 1/5!
+    e = 44739243 + FIX_MUL(e, u);           // 1/4!
+    e = 178956971 + FIX_MUL(e, u);          // 1/3!
+    e = 536870912 + FIX_MUL(e, u);          // 1/2!
+    e = FIX_Q30_ONE + FIX_MUL(e, u);
+    e = FIX_Q30_ONE + FIX_MUL(e, u);
+
+    return (int32_t)(((int64_t)(FIX_Q30_ONE - e) * 4433000 + (1 << 29)) >> 30);
+}
+
+#endif
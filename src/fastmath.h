@@ -0,0 +1,41 @@
+#pragma once
+
+// Hot path math. With FAST_MATH the *_approx() calls use the polynomial versions from fastmath.c,
+// otherwise they fall through to libm. Max errors are documented next to each implementation.
+
+float fastSin(float x);
+float fastCos(float x);
+void fastSinCos(float x, float *s, float *c);
+float fastAtan2(float y, float x);
+float fastAcos(float x);
+float fastInvSqrt(float x);
+float fastPressureToAltitude(float pressure);
+
+#ifdef FAST_MATH
+#define sin_approx(x)               fastSin(x)
+#define cos_approx(x)               fastCos(x)
+#define sincos_approx(x, s, c)      fastSinCos(x, s, c)
+#define atan2_approx(y, x)          fastAtan2(y, x)
+#define acos_approx(x)              fastAcos(x)
+#define invSqrt_approx(x)           fastInvSqrt(x)
+#define pressureToAltitude(p)       fastPressureToAltitude(p)
+#else
+#define sin_approx(x)               sinf(x)
+#define cos_approx(x)               cosf(x)
+#define sincos_approx(x, s, c)      do { *(s) = sinf(x); *(c) = cosf(x); } while (0)
+#define atan2_approx(y, x)          atan2f(y, x)
+#define acos_approx(x)              acosf(x)
+#define invSqrt_approx(x)           (1.0f / sqrtf(x))
+#define pressureToAltitude(p)       ((1.0f - powf((p) / 101325.0f, 0.190295f)) * 4433000.0f)
+#endif
+
+// Fixed point helpers for FIXED_IMU. Angles are Q28 radians (+/- 8 rad), sin/cos are Q30.
+#define FIX_Q30_ONE                 (1 << 30)
+#define FIX_MUL(a, b)               ((int32_t)(((int64_t)(a) * (b)) >> 30))
+
+int32_t fixSin(int32_t x);
+int32_t fixCos(int32_t x);
+void fixSinCos(int32_t x, int32_t *s, int32_t *c);
+int32_t fixAtan2(int32_t y, int32_t x);
+uint32_t fixSqrt64(uint64_t x);
+int32_t fixPressureToAltitude(int32_t pressure);
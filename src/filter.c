@@ -0,0 +1,136 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+
+// Biquad low pass and notch chains for the gyro and the PID D-term. Sections are designed in float
+// from the RBJ audio EQ cookbook whenever the config is activated, the per sample work is fixed
+// point direct form 1 with a 64bit accumulator, so no trig and no soft-float in the loop.
+
+#define BIQUAD_Q                0.70710678f     // butterworth
+#define BIQUAD_COEFF_SHIFT      28
+#define BIQUAD_STATE_SHIFT      8               // fractional bits kept on the filter state
+#define FILTER_DEFAULT_LOOPTIME 3500            // us, assumed for looptime = 0 until the loop has run
+#define FILTER_PERIOD_TOLERANCE 32              // redesign once the measured period is 1/32 off the designed one
+
+filterChain_t gyroFilter;
+filterChain_t dtermFilter;
+
+static uint32_t designedPeriod;                 // us between samples the sections were designed for
+static uint32_t measuredPeriod;                 // from filterSetSamplePeriod(), 0 until the gyro has run a while
+
+static void biquadSet(biquad_t *bq, float b0, float b1, float b2, float a0, float a1, float a2)
+{
+    float scale = (float)(1 << BIQUAD_COEFF_SHIFT) / a0;
+
+    bq->b0 = lrintf(b0 * scale);
+    bq->b1 = lrintf(b1 * scale);
+    bq->b2 = lrintf(b2 * scale);
+    bq->a1 = lrintf(a1 * scale);
+    bq->a2 = lrintf(a2 * scale);
+}
+
+static void filterChainAddLowpass(filterChain_t *chain, uint16_t cutoff, float sampleRate)
+{
+    float omega, sn, cs, alpha;
+
+    // off, or nothing left to filter below nyquist
+    if (cutoff == 0 || cutoff >= sampleRate / 2 || chain->count >= FILTER_CHAIN_LENGTH)
+        return;
+
+    omega = 2.0f * M_PI * cutoff / sampleRate;
+    sn = sinf(omega);
+    cs = cosf(omega);
+    alpha = sn / (2.0f * BIQUAD_Q);
+    biquadSet(&chain->sections[chain->count++], (1.0f - cs) / 2.0f, 1.0f - cs, (1.0f - cs) / 2.0f, 1.0f + alpha, -2.0f * cs, 1.0f - alpha);
+}
+
+static void filterChainAddNotch(filterChain_t *chain, uint16_t center, uint16_t bandwidth, float sampleRate)
+{
+    float omega, sn, cs, alpha;
+
+    if (center == 0 || bandwidth == 0 || center >= sampleRate / 2 || chain->count >= FILTER_CHAIN_LENGTH)
+        return;
+
+    omega = 2.0f * M_PI * center / sampleRate;
+    sn = sinf(omega);
+    cs = cosf(omega);
+    alpha = sn * bandwidth / (2.0f * center);   // Q = center / bandwidth
+    biquadSet(&chain->sections[chain->count++], 1.0f, -2.0f * cs, 1.0f, 1.0f + alpha, -2.0f * cs, 1.0f - alpha);
+}
+
+// Designs both chains for one sample every period us. The state is only cleared when the sections change,
+// new coefficients alone just carry on from the samples so far
+static void filterDesign(uint32_t period)
+{
+    float sampleRate = 1000000.0f / period;
+    uint8_t gyroCount = gyroFilter.count, dtermCount = dtermFilter.count;
+
+    designedPeriod = period;
+
+    gyroFilter.count = 0;
+    filterChainAddLowpass(&gyroFilter, mcfg.gyro_soft_lpf, sampleRate);
+    filterChainAddNotch(&gyroFilter, mcfg.gyro_notch1_hz, mcfg.gyro_notch1_bw, sampleRate);
+    filterChainAddNotch(&gyroFilter, mcfg.gyro_notch2_hz, mcfg.gyro_notch2_bw, sampleRate);
+    if (gyroFilter.count != gyroCount)
+        memset(gyroFilter.state, 0, sizeof(gyroFilter.state));
+
+    dtermFilter.count = 0;
+    filterChainAddLowpass(&dtermFilter, cfg.dterm_lpf, sampleRate);
+    filterChainAddNotch(&dtermFilter, cfg.dterm_notch_hz, cfg.dterm_notch_bw, sampleRate);
+    if (dtermFilter.count != dtermCount)
+        memset(dtermFilter.state, 0, sizeof(dtermFilter.state));
+}
+
+// Recalculates both chains from the config and clears their state. The sample period is the one measured
+// on the gyro so far, or until there is one a guess from the config: looptime, or one loop per MPU data
+// ready at the default 1kHz with gyro_sync
+void filterInit(void)
+{
+    uint32_t period = measuredPeriod;
+
+    if (!period) {
+        if (gyroSyncActive)
+            period = 1000;
+        else
+            period = mcfg.looptime ? mcfg.looptime : FILTER_DEFAULT_LOOPTIME;
+    }
+
+    memset(&gyroFilter, 0, sizeof(gyroFilter));
+    memset(&dtermFilter, 0, sizeof(dtermFilter));
+    filterDesign(period);
+}
+
+// The gyro reports the average time between its samples here, once a second. Both chains run once per gyro
+// sample, so that is their sample period whatever looptime, gyro_sync or the MPU rate make of it. Only a
+// real change redesigns them, the float design is slow without an FPU
+void filterSetSamplePeriod(uint32_t period)
+{
+    measuredPeriod = period;
+    if (period && abs((int32_t)(period - designedPeriod)) > (int32_t)(designedPeriod / FILTER_PERIOD_TOLERANCE))
+        filterDesign(period);
+}
+
+int32_t filterApply(filterChain_t *chain, int axis, int32_t input)
+{
+    biquad_t *bq;
+    biquadState_t *state;
+    int32_t x = input * (1 << BIQUAD_STATE_SHIFT);
+    int64_t sum;
+    int i;
+
+    for (i = 0; i < chain->count; i++) {
+        bq = &chain->sections[i];
+        state = &chain->state[axis][i];
+        sum = (int64_t)bq->b0 * x + (int64_t)bq->b1 * state->x1 + (int64_t)bq->b2 * state->x2 - (int64_t)bq->a1 * state->y1 - (int64_t)bq->a2 * state->y2;
+        state->x2 = state->x1;
+        state->x1 = x;
+        state->y2 = state->y1;
+        state->y1 = sum >> BIQUAD_COEFF_SHIFT;
+        x = state->y1;
+    }
+
+    return (x + (1 << (BIQUAD_STATE_SHIFT - 1))) >> BIQUAD_STATE_SHIFT;
+}
@@ -25,6 +25,48 @@ float magneticDeclination = 0.0f;       // calculated at startup from config
 float accVelScale;
 float throttleAngleScale;
 float fc_acc;
+static float gyroCmpfFactor;            // complementary filter weights, scaled for acc_fusion_divider
+static float invGyroCmpfFactor;
+static float gyroCmpfmFactor;
+static float invGyroCmpfmFactor;
+static float imuKp;                     // quaternion estimator feedback gains
+static float imuKi;
+
+#ifdef FIXED_IMU
+// Fixed point estimator. Sensor vectors are Q12 in sensor LSB, gyro angles Q28 radians, weights Q30
+// unless noted. All the float settings are converted once here so the loop never touches soft-float.
+#define IMU_FIX_ONE         (1 << 12)
+#define IMU_FIX_ROUND(x)    (((x) + IMU_FIX_ONE / 2) >> 12)
+#define FIX_DEG_TO_RAD_Q28  4685083             // pi / 180 in Q28
+#define FIX_MAX_TILT_Q28    417630745           // acos(0.015), past this the throttle correction is off
+#define FIX_MIN_COS_PITCH   53687091            // 0.05 in Q30
+#define FIX_DECIDEG_PER_RAD_Q16 37549362        // 1800 / pi in Q16
+#define FIX_DEG_PER_RAD_Q16 3754936             // 180 / pi in Q16
+
+typedef int32_t gyroAngle_t;
+static int32_t gyroCmpfWeight;
+static int32_t accCmpfWeight;
+static int32_t gyroCmpfmWeight;
+static int32_t magCmpfWeight;
+static uint32_t gyroScaleQ48;           // gyro.scale in rad/us/LSB
+static int32_t throttleAngleScaleQ8;
+static int32_t declinationQ16;          // magneticDeclination in 0.1deg
+static uint32_t accZTimeConstant;       // fc_acc in us
+static int32_t accVelScaleQ40;
+static int32_t baroNoiseLpfQ16;
+static int32_t baroCfVelQ16;
+static int32_t baroCfAltQ16;
+static int32_t rollGain[2];             // Q16, see linearizeAttitude()
+static int32_t pitchGain[2];
+static int32_t headingGain[2];
+#else
+typedef float gyroAngle_t;
+static float rollGain[2];
+static float pitchGain[2];
+static float headingGain[2];
+#endif
+static int16_t fusedAngle[2];           // angle[] and heading at the last acc fusion
+static int16_t fusedHeading;
 
 // **************
 // gyro+acc IMU
@@ -34,16 +76,42 @@ int16_t gyroZero[3] = { 0, 0, 0 };
 int16_t angle[2] = { 0, 0 };     // absolute angle inclination in multiple of 0.1 degree    180 deg = 1800
 float anglerad[2] = { 0.0f, 0.0f };    // absolute angle inclination in radians
 
-static void getEstimatedAttitude(void);
+static void getEstimatedAttitude(gyroAngle_t *deltaGyroAngle, uint32_t deltaT);
+static void propagateAttitude(gyroAngle_t *deltaGyroAngle);
 
 void imuInit(void)
 {
+    if (mcfg.acc_fusion_divider < 1)
+        mcfg.acc_fusion_divider = 1;
     smallAngle = lrintf(acc_1G * cosf(RAD * cfg.small_angle));
     accVelScale = 9.80665f / acc_1G / 10000.0f;
     throttleAngleScale = (1800.0f / M_PI) * (900.0f / cfg.throttle_correction_angle);
     
     fc_acc = 0.5f / (M_PI * cfg.accz_lpf_cutoff); // calculate RC time constant used in the accZ lpf
 
+    // the filters run once per acc update, keep the time constant the same regardless of the divider
+    gyroCmpfFactor = (float)mcfg.gyro_cmpf_factor / mcfg.acc_fusion_divider;
+    invGyroCmpfFactor = 1.0f / (gyroCmpfFactor + 1.0f);
+    gyroCmpfmFactor = (float)mcfg.gyro_cmpfm_factor / mcfg.acc_fusion_divider;
+    invGyroCmpfmFactor = 1.0f / (gyroCmpfmFactor + 1.0f);
+    imuKp = mcfg.imu_kp / 10000.0f;
+    imuKi = mcfg.imu_ki / 10000.0f;
+
+#ifdef FIXED_IMU
+    gyroCmpfWeight = lrintf(gyroCmpfFactor * invGyroCmpfFactor * FIX_Q30_ONE);
+    accCmpfWeight = FIX_Q30_ONE - gyroCmpfWeight;
+    gyroCmpfmWeight = lrintf(gyroCmpfmFactor * invGyroCmpfmFactor * FIX_Q30_ONE);
+    magCmpfWeight = FIX_Q30_ONE - gyroCmpfmWeight;
+    gyroScaleQ48 = lrintf(gyro.scale * 281474976710656.0f);
+    throttleAngleScaleQ8 = lrintf(throttleAngleScale * 256.0f);
+    declinationQ16 = lrintf(magneticDeclination * 65536.0f);
+    accZTimeConstant = lrintf(fc_acc * 1000000.0f);
+    accVelScaleQ40 = lrintf(accVelScale * 1099511627776.0f);
+    baroNoiseLpfQ16 = lrintf(cfg.baro_noise_lpf * 65536.0f);
+    baroCfVelQ16 = lrintf(cfg.baro_cf_vel * 65536.0f);
+    baroCfAltQ16 = lrintf(cfg.baro_cf_alt * 65536.0f);
+#endif
+
 #ifdef MAG
     // if mag sensor is enabled, use it
     if (sensors(SENSOR_MAG))
@@ -54,11 +122,48 @@ void imuInit(void)
 void computeIMU(void)
 {
     static int16_t gyroYawSmooth = 0;
+    static uint32_t previousT;
+    static uint32_t deltaTSum = 0;
+    static gyroAngle_t deltaGyroAngle[3];
+    static uint8_t fusionCounter = 0;
+    uint32_t currentT, deltaT;
+#ifdef FIXED_IMU
+    int64_t scale;
+#else
+    float scale;
+#endif
+    int axis;
 
     Gyro_getADC();
     if (sensors(SENSOR_ACC)) {
-        ACC_getADC();
-        getEstimatedAttitude();
+        // gyro is integrated every loop, the acc read and attitude fusion only every acc_fusion_divider loops
+        currentT = micros();
+        deltaT = currentT - previousT;
+        previousT = currentT;
+#ifdef FIXED_IMU
+        scale = (int64_t)deltaT * gyroScaleQ48;
+        for (axis = 0; axis < 3; axis++)
+            deltaGyroAngle[axis] += (gyroADC[axis] * scale) >> 20;
+#else
+        scale = deltaT * gyro.scale;
+        for (axis = 0; axis < 3; axis++)
+            deltaGyroAngle[axis] += gyroADC[axis] * scale;
+#endif
+        deltaTSum += deltaT;
+
+        if (++fusionCounter >= mcfg.acc_fusion_divider) {
+            ACC_getADC();
+            PERF_BEGIN(PERF_ATTITUDE);
+            getEstimatedAttitude(deltaGyroAngle, deltaTSum);
+            PERF_END(PERF_ATTITUDE);
+            for (axis = 0; axis < 3; axis++)
+                deltaGyroAngle[axis] = 0;
+            deltaTSum = 0;
+            fusionCounter = 0;
+        } else {
+            // angle[] and heading follow the gyro in between, so angle mode and mag hold never see them stale
+            propagateAttitude(deltaGyroAngle);
+        }
     } else {
         accADC[X] = 0;
         accADC[Y] = 0;
@@ -89,9 +194,6 @@ void computeIMU(void)
 //
 // **************************************************
 
-#define INV_GYR_CMPF_FACTOR   (1.0f / ((float)mcfg.gyro_cmpf_factor + 1.0f))
-#define INV_GYR_CMPFM_FACTOR  (1.0f / ((float)mcfg.gyro_cmpfm_factor + 1.0f))
-
 typedef struct fp_vector {
     float X;
     float Y;
@@ -103,6 +205,15 @@ typedef union {
     t_fp_vector_def V;
 } t_fp_vector;
 
+typedef union {
+    int32_t A[3];
+    struct {
+        int32_t X;
+        int32_t Y;
+        int32_t Z;
+    } V;
+} t_fix_vector;
+
 t_fp_vector EstG;
 
 // Normalize a vector
@@ -128,12 +239,9 @@ void rotateV(struct fp_vector *v, float *delta)
     float cosx, sinx, cosy, siny, cosz, sinz;
     float coszcosx, sinzcosx, coszsinx, sinzsinx;
 
-    cosx = cosf(delta[ROLL]);
-    sinx = sinf(delta[ROLL]);
-    cosy = cosf(delta[PITCH]);
-    siny = sinf(delta[PITCH]);
-    cosz = cosf(delta[YAW]);
-    sinz = sinf(delta[YAW]);
+    sincos_approx(delta[ROLL], &sinx, &cosx);
+    sincos_approx(delta[PITCH], &siny, &cosy);
+    sincos_approx(delta[YAW], &sinz, &cosz);
 
     coszcosx = cosz * cosx;
     sinzcosx = sinz * cosx;
@@ -167,49 +275,66 @@ int32_t applyDeadband(int32_t value, int32_t deadband)
     return value;
 }
 
-// rotate acc into Earth frame and calculate acceleration in it
-void acc_calc(uint32_t deltaT)
+#ifndef FIXED_IMU
+// calculate acceleration in the Earth frame, accel_ned is accSmooth already rotated into it
+void acc_calc(uint32_t deltaT, t_fp_vector *accel_ned)
 {
     static int32_t accZoffset = 0;
     static float accz_smooth = 0;
     float dT = 0;
-    float rpy[3];
-    t_fp_vector accel_ned;
 
     // deltaT is measured in us ticks
     dT = (float)deltaT * 1e-6f;
 
-    // the accel values have to be rotated into the earth frame
-    rpy[0] = -(float)anglerad[ROLL];
-    rpy[1] = -(float)anglerad[PITCH];
-    rpy[2] = -(float)heading * RAD;
-
-    accel_ned.V.X = accSmooth[0];
-    accel_ned.V.Y = accSmooth[1];
-    accel_ned.V.Z = accSmooth[2];
-
-    rotateV(&accel_ned.V, rpy);
-
     if (cfg.acc_unarmedcal == 1) {
         if (!f.ARMED) {
             accZoffset -= accZoffset / 64;
-            accZoffset += accel_ned.V.Z;
+            accZoffset += accel_ned->V.Z;
         }
-        accel_ned.V.Z -= accZoffset / 64;  // compensate for gravitation on z-axis
+        accel_ned->V.Z -= accZoffset / 64;  // compensate for gravitation on z-axis
     } else
-        accel_ned.V.Z -= acc_1G;
+        accel_ned->V.Z -= acc_1G;
 
-    accz_smooth = accz_smooth + (dT / (fc_acc + dT)) * (accel_ned.V.Z - accz_smooth); // low pass filter
+    accz_smooth = accz_smooth + (dT / (fc_acc + dT)) * (accel_ned->V.Z - accz_smooth); // low pass filter
 
     // apply Deadband to reduce integration drift and vibration influence and
     // sum up Values for later integration to get velocity and distance
-    accSum[X] += applyDeadband(lrintf(accel_ned.V.X), cfg.accxy_deadband);
-    accSum[Y] += applyDeadband(lrintf(accel_ned.V.Y), cfg.accxy_deadband);
+    accSum[X] += applyDeadband(lrintf(accel_ned->V.X), cfg.accxy_deadband);
+    accSum[Y] += applyDeadband(lrintf(accel_ned->V.Y), cfg.accxy_deadband);
     accSum[Z] += applyDeadband(lrintf(accz_smooth), cfg.accz_deadband);
     
     accTimeSum += deltaT;
     accSumCount++;
 }
+#else
+// same as above with accel_ned in Q12
+void acc_calc(uint32_t deltaT, t_fix_vector *accel_ned)
+{
+    static int32_t accZoffset = 0;
+    static int32_t accz_smooth = 0;
+    int32_t alpha;
+
+    if (cfg.acc_unarmedcal == 1) {
+        if (!f.ARMED) {
+            accZoffset -= accZoffset / 64;
+            accZoffset += accel_ned->V.Z / IMU_FIX_ONE;
+        }
+        accel_ned->V.Z -= accZoffset / 64 * IMU_FIX_ONE;  // compensate for gravitation on z-axis
+    } else
+        accel_ned->V.Z -= acc_1G * IMU_FIX_ONE;
+
+    // low pass filter, dT / (fc_acc + dT) in Q16
+    alpha = ((uint64_t)deltaT << 16) / (accZTimeConstant + deltaT);
+    accz_smooth += ((int64_t)(accel_ned->V.Z - accz_smooth) * alpha) >> 16;
+
+    accSum[X] += applyDeadband(IMU_FIX_ROUND(accel_ned->V.X), cfg.accxy_deadband);
+    accSum[Y] += applyDeadband(IMU_FIX_ROUND(accel_ned->V.Y), cfg.accxy_deadband);
+    accSum[Z] += applyDeadband(IMU_FIX_ROUND(accz_smooth), cfg.accz_deadband);
+
+    accTimeSum += deltaT;
+    accSumCount++;
+}
+#endif
 
 void accSum_reset(void)
 {
@@ -220,75 +345,67 @@ void accSum_reset(void)
     accTimeSum = 0;
 }
 
+#ifndef FIXED_IMU
 // baseflight calculation by Luggi09 originates from arducopter
 static int16_t calculateHeading(t_fp_vector *vec)
 {
     int16_t head;
 
-    float cosineRoll = cosf(anglerad[ROLL]);
-    float sineRoll = sinf(anglerad[ROLL]);
-    float cosinePitch = cosf(anglerad[PITCH]);
-    float sinePitch = sinf(anglerad[PITCH]);
-    float Xh = vec->A[X] * cosinePitch + vec->A[Y] * sineRoll * sinePitch + vec->A[Z] * sinePitch * cosineRoll;
-    float Yh = vec->A[Y] * cosineRoll - vec->A[Z] * sineRoll;
-    float hd = (atan2f(Yh, Xh) * 1800.0f / M_PI + magneticDeclination) / 10.0f;
+    float cosineRoll, sineRoll, cosinePitch, sinePitch, Xh, Yh, hd;
+
+    sincos_approx(anglerad[ROLL], &sineRoll, &cosineRoll);
+    sincos_approx(anglerad[PITCH], &sinePitch, &cosinePitch);
+    Xh = vec->A[X] * cosinePitch + vec->A[Y] * sineRoll * sinePitch + vec->A[Z] * sinePitch * cosineRoll;
+    Yh = vec->A[Y] * cosineRoll - vec->A[Z] * sineRoll;
+    hd = (atan2_approx(Yh, Xh) * 1800.0f / M_PI + magneticDeclination) / 10.0f;
     head = lrintf(hd);
     if (head < 0)
         head += 360;
 
     return head;
 }
+#endif
 
-static void getEstimatedAttitude(void)
+static void updateThrottleAngleCorrection(float cosZ)
+{
+    if (cosZ <= 0.015f) { // we are inverted, vertical or with a small angle < 0.86 deg
+        throttleAngleCorrection = 0;
+    } else {
+        int deg = lrintf(acos_approx(cosZ) * throttleAngleScale);
+        if (deg > 900)
+            deg = 900;
+        throttleAngleCorrection = lrintf(cfg.throttle_correction_value * sin_approx(deg / (900.0f * M_PI / 2.0f))) ;
+    }
+}
+
+#ifndef FIXED_IMU
+static void getEstimatedAttitudeComplementary(float *deltaGyroAngle, uint32_t deltaT, bool useAcc)
 {
     int32_t axis;
-    int32_t accMag = 0;
     static t_fp_vector EstM;
     static t_fp_vector EstN = { .A = { 1.0f, 0.0f, 0.0f } };
-    static float accLPF[3];
-    static uint32_t previousT;
-    uint32_t currentT = micros();
-    uint32_t deltaT;
-    float scale, deltaGyroAngle[3];
-    deltaT = currentT - previousT;
-    scale = deltaT * gyro.scale;
-    previousT = currentT;
-
-    // Initialization
-    for (axis = 0; axis < 3; axis++) {
-        deltaGyroAngle[axis] = gyroADC[axis] * scale;
-        if (cfg.acc_lpf_factor > 0) {
-            accLPF[axis] = accLPF[axis] * (1.0f - (1.0f / cfg.acc_lpf_factor)) + accADC[axis] * (1.0f / cfg.acc_lpf_factor);
-            accSmooth[axis] = accLPF[axis];
-        } else {
-            accSmooth[axis] = accADC[axis];
-        }
-        accMag += (int32_t)accSmooth[axis] * accSmooth[axis];
-    }
-    accMag = accMag * 100 / ((int32_t)acc_1G * acc_1G);
+    float rpy[3];
+    t_fp_vector accel_ned;
 
     rotateV(&EstG.V, deltaGyroAngle);
 
     // Apply complimentary filter (Gyro drift correction)
-    // If accel magnitude >1.15G or <0.85G and ACC vector outside of the limit range => we neutralize the effect of accelerometers in the angle estimation.
-    // To do that, we just skip filter, as EstV already rotated by Gyro
-    if (72 < (uint16_t)accMag && (uint16_t)accMag < 133) {
+    // To neutralize the effect of accelerometers in the angle estimation we just skip filter, as EstV already rotated by Gyro
+    if (useAcc) {
         for (axis = 0; axis < 3; axis++)
-            EstG.A[axis] = (EstG.A[axis] * (float)mcfg.gyro_cmpf_factor + accSmooth[axis]) * INV_GYR_CMPF_FACTOR;
+            EstG.A[axis] = (EstG.A[axis] * gyroCmpfFactor + accSmooth[axis]) * invGyroCmpfFactor;
     }
 
     f.SMALL_ANGLE = (EstG.A[Z] > smallAngle);
 
     // Attitude of the estimated vector
-    anglerad[ROLL] = atan2f(EstG.V.Y, EstG.V.Z);
-    anglerad[PITCH] = atan2f(-EstG.V.X, sqrtf(EstG.V.Y * EstG.V.Y + EstG.V.Z * EstG.V.Z));
-    angle[ROLL] = lrintf(anglerad[ROLL] * (1800.0f / M_PI));
-    angle[PITCH] = lrintf(anglerad[PITCH] * (1800.0f / M_PI));
+    anglerad[ROLL] = atan2_approx(EstG.V.Y, EstG.V.Z);
+    anglerad[PITCH] = atan2_approx(-EstG.V.X, sqrtf(EstG.V.Y * EstG.V.Y + EstG.V.Z * EstG.V.Z));
 
     if (sensors(SENSOR_MAG)) {
         rotateV(&EstM.V, deltaGyroAngle);
         for (axis = 0; axis < 3; axis++)
-            EstM.A[axis] = (EstM.A[axis] * (float)mcfg.gyro_cmpfm_factor + magADC[axis]) * INV_GYR_CMPFM_FACTOR;
+            EstM.A[axis] = (EstM.A[axis] * gyroCmpfmFactor + magADC[axis]) * invGyroCmpfmFactor;
         heading = calculateHeading(&EstM);
     } else {
         rotateV(&EstN.V, deltaGyroAngle);
@@ -296,22 +413,421 @@ static void getEstimatedAttitude(void)
         heading = calculateHeading(&EstN);
     }
 
-    acc_calc(deltaT); // rotate acc vector into earth frame
+    // the accel values have to be rotated into the earth frame
+    rpy[0] = -(float)anglerad[ROLL];
+    rpy[1] = -(float)anglerad[PITCH];
+    rpy[2] = -(float)heading * RAD;
+
+    accel_ned.V.X = accSmooth[0];
+    accel_ned.V.Y = accSmooth[1];
+    accel_ned.V.Z = accSmooth[2];
+
+    rotateV(&accel_ned.V, rpy);
+    acc_calc(deltaT, &accel_ned);
+
+    if (cfg.throttle_correction_value)
+        updateThrottleAngleCorrection(EstG.V.Z * invSqrt_approx(EstG.V.X * EstG.V.X + EstG.V.Y * EstG.V.Y + EstG.V.Z * EstG.V.Z));
+}
+#else
+// **************************************************
+// Fixed point version of the complementary filter above
+//
+// Same algorithm step by step, so angle[], heading and accSum[] match the float build to within
+// rounding. Rotations use a 64bit accumulator per output and one shift, angles come from fixAtan2().
+// **************************************************
+
+static t_fix_vector EstGFixed;
+static int32_t angleFixed[2];           // Q28 radians
+
+static void rotateVFixed(t_fix_vector *v, int32_t *delta)
+{
+    t_fix_vector v_tmp = *v;
+    int32_t mat[3][3];
+    int32_t cosx, sinx, cosy, siny, cosz, sinz;
+    int32_t coszcosx, sinzcosx, coszsinx, sinzsinx;
+
+    fixSinCos(delta[ROLL], &sinx, &cosx);
+    fixSinCos(delta[PITCH], &siny, &cosy);
+    fixSinCos(delta[YAW], &sinz, &cosz);
+
+    coszcosx = FIX_MUL(cosz, cosx);
+    sinzcosx = FIX_MUL(sinz, cosx);
+    coszsinx = FIX_MUL(sinx, cosz);
+    sinzsinx = FIX_MUL(sinx, sinz);
+
+    mat[0][0] = FIX_MUL(cosz, cosy);
+    mat[0][1] = -FIX_MUL(cosy, sinz);
+    mat[0][2] = siny;
+    mat[1][0] = sinzcosx + FIX_MUL(coszsinx, siny);
+    mat[1][1] = coszcosx - FIX_MUL(sinzsinx, siny);
+    mat[1][2] = -FIX_MUL(sinx, cosy);
+    mat[2][0] = sinzsinx - FIX_MUL(coszcosx, siny);
+    mat[2][1] = coszsinx + FIX_MUL(sinzcosx, siny);
+    mat[2][2] = FIX_MUL(cosy, cosx);
+
+    v->V.X = ((int64_t)v_tmp.V.X * mat[0][0] + (int64_t)v_tmp.V.Y * mat[1][0] + (int64_t)v_tmp.V.Z * mat[2][0]) >> 30;
+    v->V.Y = ((int64_t)v_tmp.V.X * mat[0][1] + (int64_t)v_tmp.V.Y * mat[1][1] + (int64_t)v_tmp.V.Z * mat[2][1]) >> 30;
+    v->V.Z = ((int64_t)v_tmp.V.X * mat[0][2] + (int64_t)v_tmp.V.Y * mat[1][2] + (int64_t)v_tmp.V.Z * mat[2][2]) >> 30;
+}
+
+// Q28 radians to Q16 0.1deg
+static int32_t radToDecidegree(int32_t rad)
+{
+    return ((int64_t)rad * 37549362) >> 28;     // 1800 / pi in Q16
+}
+
+static int16_t calculateHeadingFixed(t_fix_vector *vec)
+{
+    int32_t cosineRoll, sineRoll, cosinePitch, sinePitch, Xh, Yh;
+    int16_t head;
+
+    fixSinCos(angleFixed[ROLL], &sineRoll, &cosineRoll);
+    fixSinCos(angleFixed[PITCH], &sinePitch, &cosinePitch);
+    Xh = FIX_MUL(vec->A[X], cosinePitch) + FIX_MUL(FIX_MUL(vec->A[Y], sineRoll), sinePitch) + FIX_MUL(FIX_MUL(vec->A[Z], sinePitch), cosineRoll);
+    Yh = FIX_MUL(vec->A[Y], cosineRoll) - FIX_MUL(vec->A[Z], sineRoll);
+    head = ((radToDecidegree(fixAtan2(Yh, Xh)) + declinationQ16) / 10 + (1 << 15)) >> 16;
+    if (head < 0)
+        head += 360;
+
+    return head;
+}
+
+static void updateThrottleAngleCorrectionFixed(int32_t tilt)
+{
+    if (tilt >= FIX_MAX_TILT_Q28) {
+        throttleAngleCorrection = 0;
+    } else {
+        int deg = ((int64_t)tilt * throttleAngleScaleQ8 + ((int64_t)1 << 35)) >> 36;
+        if (deg > 900)
+            deg = 900;
+        // 189879 = 1 / (900 * pi / 2) in Q28, same argument as the float version
+        throttleAngleCorrection = ((int64_t)cfg.throttle_correction_value * fixSin(deg * 189879) + (1 << 29)) >> 30;
+    }
+}
+
+static void getEstimatedAttitudeFixed(int32_t *deltaGyroAngle, uint32_t deltaT, bool useAcc)
+{
+    static t_fix_vector EstM;
+    static t_fix_vector EstN = { .A = { FIX_Q30_ONE, 0, 0 } };     // Q30 unit vector
+    int32_t rpy[3];
+    int32_t lengthSq, horizontal;
+    t_fix_vector accel_ned;
+    int axis;
+
+    rotateVFixed(&EstGFixed, deltaGyroAngle);
+
+    if (useAcc) {
+        for (axis = 0; axis < 3; axis++)
+            EstGFixed.A[axis] = FIX_MUL(EstGFixed.A[axis], gyroCmpfWeight) + FIX_MUL(accSmooth[axis] * IMU_FIX_ONE, accCmpfWeight);
+    }
+
+    f.SMALL_ANGLE = (EstGFixed.V.Z > smallAngle * IMU_FIX_ONE);
+
+    angleFixed[ROLL] = fixAtan2(EstGFixed.V.Y, EstGFixed.V.Z);
+    horizontal = fixSqrt64((int64_t)EstGFixed.V.Y * EstGFixed.V.Y + (int64_t)EstGFixed.V.Z * EstGFixed.V.Z);
+    angleFixed[PITCH] = fixAtan2(-EstGFixed.V.X, horizontal);
+    angle[ROLL] = (radToDecidegree(angleFixed[ROLL]) + (1 << 15)) >> 16;
+    angle[PITCH] = (radToDecidegree(angleFixed[PITCH]) + (1 << 15)) >> 16;
+
+    if (sensors(SENSOR_MAG)) {
+        rotateVFixed(&EstM, deltaGyroAngle);
+        for (axis = 0; axis < 3; axis++)
+            EstM.A[axis] = FIX_MUL(EstM.A[axis], gyroCmpfmWeight) + FIX_MUL(magADC[axis] * IMU_FIX_ONE, magCmpfWeight);
+        heading = calculateHeadingFixed(&EstM);
+    } else {
+        rotateVFixed(&EstN, deltaGyroAngle);
+        // rotation only changes the length by rounding, one Newton step for 1/sqrt keeps it at 1
+        lengthSq = ((int64_t)EstN.V.X * EstN.V.X + (int64_t)EstN.V.Y * EstN.V.Y + (int64_t)EstN.V.Z * EstN.V.Z) >> 30;
+        lengthSq = ((int64_t)3 * FIX_Q30_ONE - lengthSq) / 2;
+        for (axis = 0; axis < 3; axis++)
+            EstN.A[axis] = FIX_MUL(EstN.A[axis], lengthSq);
+        heading = calculateHeadingFixed(&EstN);
+    }
+
+    // the accel values have to be rotated into the earth frame
+    rpy[0] = -angleFixed[ROLL];
+    rpy[1] = -angleFixed[PITCH];
+    rpy[2] = -heading * FIX_DEG_TO_RAD_Q28;
+
+    for (axis = 0; axis < 3; axis++)
+        accel_ned.A[axis] = accSmooth[axis] * IMU_FIX_ONE;
+
+    rotateVFixed(&accel_ned, rpy);
+    acc_calc(deltaT, &accel_ned);
 
+    // tilt straight from the gravity estimate, acos(Z / |G|) == atan2(|XY|, Z)
     if (cfg.throttle_correction_value) {
+        horizontal = fixSqrt64((int64_t)EstGFixed.V.X * EstGFixed.V.X + (int64_t)EstGFixed.V.Y * EstGFixed.V.Y);
+        updateThrottleAngleCorrectionFixed(fixAtan2(horizontal, EstGFixed.V.Z));
+    }
+}
+#endif
+
+// **************************************************
+// Quaternion attitude estimator with Mahony style feedback
+// http://www.x-io.co.uk/open-source-imu-and-ahrs-algorithms/
+//
+// Attitude is kept as a quaternion rotating body into earth frame and updated from the gyro deltas
+// without any trig. Acc (and mag) errors are fed back as a rate correction. Angles, heading and
+// the earth frame acceleration all come from one rotation matrix computed once per update.
+// **************************************************
+
+static float q0 = 1.0f, q1 = 0.0f, q2 = 0.0f, q3 = 0.0f;
+static float rMat[3][3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+
+static void computeRotationMatrix(void)
+{
+    float q1q1 = q1 * q1;
+    float q2q2 = q2 * q2;
+    float q3q3 = q3 * q3;
+    float q0q1 = q0 * q1;
+    float q0q2 = q0 * q2;
+    float q0q3 = q0 * q3;
+    float q1q2 = q1 * q2;
+    float q1q3 = q1 * q3;
+    float q2q3 = q2 * q3;
+
+    rMat[0][0] = 1.0f - 2.0f * q2q2 - 2.0f * q3q3;
+    rMat[0][1] = 2.0f * (q1q2 - q0q3);
+    rMat[0][2] = 2.0f * (q1q3 + q0q2);
+    rMat[1][0] = 2.0f * (q1q2 + q0q3);
+    rMat[1][1] = 1.0f - 2.0f * q1q1 - 2.0f * q3q3;
+    rMat[1][2] = 2.0f * (q2q3 - q0q1);
+    rMat[2][0] = 2.0f * (q1q3 - q0q2);
+    rMat[2][1] = 2.0f * (q2q3 + q0q1);
+    rMat[2][2] = 1.0f - 2.0f * q1q1 - 2.0f * q2q2;
+}
+
+static void getEstimatedAttitudeQuaternion(float *deltaGyroAngle, uint32_t deltaT, bool useAcc)
+{
+    static float integralError[3];
+    float dT = deltaT * 1e-6f;
+    float error[3] = { 0.0f, 0.0f, 0.0f };
+    float delta[3];
+    float recipNorm, deltaSq, qs, qv;
+    float dq0, dq1, dq2, dq3, n0, n1, n2, n3;
+    int16_t head;
+    int axis;
+    t_fp_vector accel_ned;
+
+    // acc: cross product of measured and estimated (third row of rMat) gravity direction
+    if (useAcc) {
+        float ax = accSmooth[X], ay = accSmooth[Y], az = accSmooth[Z];
+        recipNorm = invSqrt_approx(ax * ax + ay * ay + az * az);
+        ax *= recipNorm;
+        ay *= recipNorm;
+        az *= recipNorm;
+        error[X] += ay * rMat[2][2] - az * rMat[2][1];
+        error[Y] += az * rMat[2][0] - ax * rMat[2][2];
+        error[Z] += ax * rMat[2][1] - ay * rMat[2][0];
+    }
+
+    // mag: reference flux is the measured one rotated into earth frame with its horizontal part on the X axis
+    if (sensors(SENSOR_MAG) && (magADC[X] || magADC[Y] || magADC[Z])) {
+        float mx = magADC[X], my = magADC[Y], mz = magADC[Z];
+        float hx, hy, bx, bz, wx, wy, wz;
+        recipNorm = invSqrt_approx(mx * mx + my * my + mz * mz);
+        mx *= recipNorm;
+        my *= recipNorm;
+        mz *= recipNorm;
+        hx = rMat[0][0] * mx + rMat[0][1] * my + rMat[0][2] * mz;
+        hy = rMat[1][0] * mx + rMat[1][1] * my + rMat[1][2] * mz;
+        bx = sqrtf(hx * hx + hy * hy);
+        bz = rMat[2][0] * mx + rMat[2][1] * my + rMat[2][2] * mz;
+        // estimated flux direction back in body frame
+        wx = rMat[0][0] * bx + rMat[2][0] * bz;
+        wy = rMat[0][1] * bx + rMat[2][1] * bz;
+        wz = rMat[0][2] * bx + rMat[2][2] * bz;
+        error[X] += my * wz - mz * wy;
+        error[Y] += mz * wx - mx * wz;
+        error[Z] += mx * wy - my * wx;
+    }
+
+    // feedback as a rotation over dT on top of the gyro delta
+    for (axis = 0; axis < 3; axis++) {
+        if (imuKi > 0.0f)
+            integralError[axis] += imuKi * error[axis] * dT;
+        else
+            integralError[axis] = 0.0f;
+        delta[axis] = deltaGyroAngle[axis] + (imuKp * error[axis] + integralError[axis]) * dT;
+    }
+
+    // second order expansion of the rotation quaternion, cos(|d|/2) and sin(|d|/2)/|d|
+    deltaSq = delta[X] * delta[X] + delta[Y] * delta[Y] + delta[Z] * delta[Z];
+    qs = 1.0f - deltaSq * 0.125f;
+    qv = 0.5f - deltaSq * (1.0f / 48.0f);
+    dq0 = qs;
+    dq1 = delta[X] * qv;
+    dq2 = delta[Y] * qv;
+    dq3 = delta[Z] * qv;
+
+    n0 = q0 * dq0 - q1 * dq1 - q2 * dq2 - q3 * dq3;
+    n1 = q0 * dq1 + q1 * dq0 + q2 * dq3 - q3 * dq2;
+    n2 = q0 * dq2 - q1 * dq3 + q2 * dq0 + q3 * dq1;
+    n3 = q0 * dq3 + q1 * dq2 - q2 * dq1 + q3 * dq0;
+
+    recipNorm = invSqrt_approx(n0 * n0 + n1 * n1 + n2 * n2 + n3 * n3);
+    q0 = n0 * recipNorm;
+    q1 = n1 * recipNorm;
+    q2 = n2 * recipNorm;
+    q3 = n3 * recipNorm;
+
+    computeRotationMatrix();
+
+    f.SMALL_ANGLE = (rMat[2][2] * acc_1G > smallAngle);
+
+    // same definitions as the complementary filter, with rMat[2] as the normalized gravity vector
+    anglerad[ROLL] = atan2_approx(rMat[2][1], rMat[2][2]);
+    anglerad[PITCH] = atan2_approx(-rMat[2][0], sqrtf(rMat[2][1] * rMat[2][1] + rMat[2][2] * rMat[2][2]));
+
+    head = lrintf((atan2_approx(-rMat[1][0], rMat[0][0]) * 1800.0f / M_PI + magneticDeclination) / 10.0f);
+    if (head < 0)
+        head += 360;
+    heading = head;
+
+    accel_ned.V.X = rMat[0][0] * accSmooth[X] + rMat[0][1] * accSmooth[Y] + rMat[0][2] * accSmooth[Z];
+    accel_ned.V.Y = rMat[1][0] * accSmooth[X] + rMat[1][1] * accSmooth[Y] + rMat[1][2] * accSmooth[Z];
+    accel_ned.V.Z = rMat[2][0] * accSmooth[X] + rMat[2][1] * accSmooth[Y] + rMat[2][2] * accSmooth[Z];
+#ifdef FIXED_IMU
+    {
+        t_fix_vector accel_fix;
+        for (axis = 0; axis < 3; axis++)
+            accel_fix.A[axis] = lrintf(accel_ned.A[axis] * IMU_FIX_ONE);
+        acc_calc(deltaT, &accel_fix);
+    }
+#else
+    acc_calc(deltaT, &accel_ned);
+#endif
+
+    if (cfg.throttle_correction_value)
+        updateThrottleAngleCorrection(rMat[2][2]);
+}
+
+// how angle[] (0.1deg) and heading (deg) move per radian of body rotation around pitch and yaw, at the attitude
+// of the last fusion. Roll rotation only moves the roll angle, one for one
+static void linearizeAttitude(void)
+{
+#ifdef FIXED_IMU
+    int32_t sinRoll, cosRoll, sinPitch, cosPitch;
+
+    fixSinCos(((int64_t)angle[ROLL] * FIX_DEG_TO_RAD_Q28) / 10, &sinRoll, &cosRoll);
+    fixSinCos(((int64_t)angle[PITCH] * FIX_DEG_TO_RAD_Q28) / 10, &sinPitch, &cosPitch);
+    // heading and the roll axis are undefined straight up or down, keep the gains finite
+    if (cosPitch < FIX_MIN_COS_PITCH)
+        cosPitch = FIX_MIN_COS_PITCH;
+    rollGain[0] = ((int64_t)sinPitch * sinRoll / cosPitch * FIX_DECIDEG_PER_RAD_Q16) >> 30;
+    rollGain[1] = ((int64_t)sinPitch * cosRoll / cosPitch * FIX_DECIDEG_PER_RAD_Q16) >> 30;
+    pitchGain[0] = FIX_MUL(cosRoll, FIX_DECIDEG_PER_RAD_Q16);
+    pitchGain[1] = -FIX_MUL(sinRoll, FIX_DECIDEG_PER_RAD_Q16);
+    headingGain[0] = -(int64_t)sinRoll * FIX_DEG_PER_RAD_Q16 / cosPitch;
+    headingGain[1] = -(int64_t)cosRoll * FIX_DEG_PER_RAD_Q16 / cosPitch;
+#else
+    float sinRoll, cosRoll, sinPitch, cosPitch;
+
+    sincos_approx(angle[ROLL] * RADX10, &sinRoll, &cosRoll);
+    sincos_approx(angle[PITCH] * RADX10, &sinPitch, &cosPitch);
+    // heading and the roll axis are undefined straight up or down, keep the gains finite
+    if (cosPitch < 0.05f)
+        cosPitch = 0.05f;
+    rollGain[0] = sinPitch * sinRoll / cosPitch * (1800.0f / M_PI);
+    rollGain[1] = sinPitch * cosRoll / cosPitch * (1800.0f / M_PI);
+    pitchGain[0] = cosRoll * (1800.0f / M_PI);
+    pitchGain[1] = -sinRoll * (1800.0f / M_PI);
+    headingGain[0] = -sinRoll / cosPitch * (180.0f / M_PI);
+    headingGain[1] = -cosRoll / cosPitch * (180.0f / M_PI);
+#endif
 
-        float cosZ = EstG.V.Z / sqrtf(EstG.V.X * EstG.V.X + EstG.V.Y * EstG.V.Y + EstG.V.Z * EstG.V.Z);
+    fusedAngle[ROLL] = angle[ROLL];
+    fusedAngle[PITCH] = angle[PITCH];
+    fusedHeading = heading;
+}
+
+// deltaGyroAngle is the gyro rotation accumulated over deltaT since the previous call
+static void getEstimatedAttitude(gyroAngle_t *deltaGyroAngle, uint32_t deltaT)
+{
+    int32_t axis;
+    int32_t accMag = 0;
+#ifdef FIXED_IMU
+    static int32_t accLPF[3];
+    float delta[3];
+#else
+    static float accLPF[3];
+#endif
+    bool useAcc;
 
-        if (cosZ <= 0.015f) { // we are inverted, vertical or with a small angle < 0.86 deg
-            throttleAngleCorrection = 0;
+    for (axis = 0; axis < 3; axis++) {
+        if (cfg.acc_lpf_factor > 0) {
+#ifdef FIXED_IMU
+            accLPF[axis] += (accADC[axis] * IMU_FIX_ONE - accLPF[axis]) / cfg.acc_lpf_factor;
+            accSmooth[axis] = accLPF[axis] / IMU_FIX_ONE;
+#else
+            accLPF[axis] = accLPF[axis] * (1.0f - (1.0f / cfg.acc_lpf_factor)) + accADC[axis] * (1.0f / cfg.acc_lpf_factor);
+            accSmooth[axis] = accLPF[axis];
+#endif
         } else {
-            int deg = lrintf(acosf(cosZ) * throttleAngleScale);
-            if (deg > 900)
-                deg = 900;
-            throttleAngleCorrection = lrintf(cfg.throttle_correction_value * sinf(deg / (900.0f * M_PI / 2.0f))) ;
+            accSmooth[axis] = accADC[axis];
         }
+        accMag += (int32_t)accSmooth[axis] * accSmooth[axis];
+    }
+    accMag = accMag * 100 / ((int32_t)acc_1G * acc_1G);
 
+    // If accel magnitude >1.15G or <0.85G and ACC vector outside of the limit range => we neutralize the effect of accelerometers in the angle estimation.
+    useAcc = 72 < (uint16_t)accMag && (uint16_t)accMag < 133;
+
+#ifdef FIXED_IMU
+    // the quaternion estimator stays float, everything else is fixed point
+    if (mcfg.imu_algorithm != IMU_QUATERNION) {
+        getEstimatedAttitudeFixed(deltaGyroAngle, deltaT, useAcc);
+        linearizeAttitude();
+        return;
     }
+    for (axis = 0; axis < 3; axis++)
+        delta[axis] = deltaGyroAngle[axis] * (1.0f / (1 << 28));
+    getEstimatedAttitudeQuaternion(delta, deltaT, useAcc);
+#else
+    if (mcfg.imu_algorithm == IMU_QUATERNION)
+        getEstimatedAttitudeQuaternion(deltaGyroAngle, deltaT, useAcc);
+    else
+        getEstimatedAttitudeComplementary(deltaGyroAngle, deltaT, useAcc);
+#endif
+
+    angle[ROLL] = lrintf(anglerad[ROLL] * (1800.0f / M_PI));
+    angle[PITCH] = lrintf(anglerad[PITCH] * (1800.0f / M_PI));
+    linearizeAttitude();
+}
+
+// With acc_fusion_divider > 1 the loops without a fusion move angle[] and heading from their values at the last
+// one, by the gyro rotation accumulated since. First order Euler angle kinematics, the gains only depend on
+// the attitude at the fusion: a few multiplies per loop instead of the full update.
+static void propagateAttitude(gyroAngle_t *deltaGyroAngle)
+{
+    int32_t roll, pitch, head;
+
+#ifdef FIXED_IMU
+    // Q28 radians times Q16 gains
+    roll = ((int64_t)deltaGyroAngle[ROLL] * FIX_DECIDEG_PER_RAD_Q16 + (int64_t)deltaGyroAngle[PITCH] * rollGain[0] + (int64_t)deltaGyroAngle[YAW] * rollGain[1] + ((int64_t)1 << 43)) >> 44;
+    pitch = ((int64_t)deltaGyroAngle[PITCH] * pitchGain[0] + (int64_t)deltaGyroAngle[YAW] * pitchGain[1] + ((int64_t)1 << 43)) >> 44;
+    head = ((int64_t)deltaGyroAngle[PITCH] * headingGain[0] + (int64_t)deltaGyroAngle[YAW] * headingGain[1] + ((int64_t)1 << 43)) >> 44;
+#else
+    roll = lrintf(deltaGyroAngle[ROLL] * (1800.0f / M_PI) + deltaGyroAngle[PITCH] * rollGain[0] + deltaGyroAngle[YAW] * rollGain[1]);
+    pitch = lrintf(deltaGyroAngle[PITCH] * pitchGain[0] + deltaGyroAngle[YAW] * pitchGain[1]);
+    head = lrintf(deltaGyroAngle[PITCH] * headingGain[0] + deltaGyroAngle[YAW] * headingGain[1]);
+#endif
+
+    roll += fusedAngle[ROLL];
+    if (roll > 1800)
+        roll -= 3600;
+    else if (roll < -1800)
+        roll += 3600;
+    angle[ROLL] = roll;
+    angle[PITCH] = fusedAngle[PITCH] + pitch;
+
+    head += fusedHeading;
+    if (head < 0)
+        head += 360;
+    else if (head >= 360)
+        head -= 360;
+    heading = head;
 }
 
 #ifdef BARO
@@ -327,12 +843,20 @@ int getEstimatedAltitude(void)
     int32_t vel_tmp;
     int32_t BaroAlt_tmp;
     int32_t setVel;
+#ifdef FIXED_IMU
+    int32_t vel_acc;                    // cm/s, Q16
+    int32_t accZ_tmp;                   // acc LSB, Q8
+    static int32_t accZ_old = 0;
+    static int32_t vel = 0;             // cm/s, Q16
+    static int32_t accAlt = 0;          // cm, Q8
+#else
     float dt;
     float vel_acc;
     float accZ_tmp;
     static float accZ_old = 0.0f;
     static float vel = 0.0f;
     static float accAlt = 0.0f;
+#endif
     static int32_t lastBaroAlt;
     static int32_t baroGroundAltitude = 0;
     static int32_t baroGroundPressure = 0;
@@ -346,7 +870,11 @@ int getEstimatedAltitude(void)
     if (calibratingB > 0) {
         baroGroundPressure -= baroGroundPressure / 8;
         baroGroundPressure += baroPressureSum / (cfg.baro_tab_size - 1);
-        baroGroundAltitude = (1.0f - powf((baroGroundPressure / 8) / 101325.0f, 0.190295f)) * 4433000.0f;
+#ifdef FIXED_IMU
+        baroGroundAltitude = fixPressureToAltitude(baroGroundPressure / 8);
+#else
+        baroGroundAltitude = pressureToAltitude(baroGroundPressure / 8);
+#endif
 
         vel = 0;
         accAlt = 0;
@@ -355,9 +883,15 @@ int getEstimatedAltitude(void)
 
     // calculates height from ground via baro readings
     // see: https://github.com/diydrones/ardupilot/blob/master/libraries/AP_Baro/AP_Baro.cpp#L140
-    BaroAlt_tmp = lrintf((1.0f - powf((float)(baroPressureSum / (cfg.baro_tab_size - 1)) / 101325.0f, 0.190295f)) * 4433000.0f); // in cm
+#ifdef FIXED_IMU
+    BaroAlt_tmp = fixPressureToAltitude(baroPressureSum / (cfg.baro_tab_size - 1)); // in cm
+    BaroAlt_tmp -= baroGroundAltitude;
+    BaroAlt = ((int64_t)BaroAlt * baroNoiseLpfQ16 + (int64_t)BaroAlt_tmp * (65536 - baroNoiseLpfQ16) + (1 << 15)) >> 16;
+#else
+    BaroAlt_tmp = lrintf(pressureToAltitude((float)(baroPressureSum / (cfg.baro_tab_size - 1)))); // in cm
     BaroAlt_tmp -= baroGroundAltitude;
     BaroAlt = lrintf((float)BaroAlt * cfg.baro_noise_lpf + (float)BaroAlt_tmp * (1.0f - cfg.baro_noise_lpf)); // additional LPF to reduce baro noise
+#endif
 
     // calculate sonar altitude only if the sonar is facing downwards(<25deg)
     if (tiltAngle > 250)
@@ -377,10 +911,26 @@ int getEstimatedAltitude(void)
         }
     }
 
+#ifdef FIXED_IMU
+    // Integrator - velocity, cm/sec
+    accZ_tmp = accSumCount ? ((int64_t)accSum[2] << 8) / accSumCount : 0;
+    vel_acc = ((int64_t)accZ_tmp * accTimeSum * accVelScaleQ40) >> 32;
+
+    // Integrator - Altitude in cm, 4295 = 1e-6 in Q32
+    accAlt += ((int64_t)(vel_acc / 2 + vel) * accTimeSum * 4295) >> 40;
+    accAlt = ((int64_t)accAlt * baroCfAltQ16 + ((int64_t)BaroAlt << 8) * (65536 - baroCfAltQ16)) >> 16;
+
+    // when the sonar is in his best range
+    if (sonarAlt > 0 && sonarAlt < 200)
+        EstAlt = BaroAlt;
+    else
+        EstAlt = accAlt / 256;
+#else
     dt = accTimeSum * 1e-6f; // delta acc reading time in seconds
 
     // Integrator - velocity, cm/sec
-    accZ_tmp = (float)accSum[2] / (float)accSumCount;
+    // with a large acc_fusion_divider there may not have been an acc update since the last call
+    accZ_tmp = accSumCount ? (float)accSum[2] / (float)accSumCount : 0.0f;
     vel_acc = accZ_tmp * accVelScale * (float)accTimeSum;
 
     // Integrator - Altitude in cm
@@ -392,6 +942,7 @@ int getEstimatedAltitude(void)
         EstAlt = BaroAlt;
     else
         EstAlt = accAlt;
+#endif
 
     vel += vel_acc;
 
@@ -403,7 +954,11 @@ int getEstimatedAltitude(void)
 
     accSum_reset();
 
+#ifdef FIXED_IMU
+    baroVel = (int64_t)(BaroAlt - lastBaroAlt) * 1000000 / dTime;
+#else
     baroVel = (BaroAlt - lastBaroAlt) * 1000000.0f / dTime;
+#endif
     lastBaroAlt = BaroAlt;
 
     baroVel = constrain(baroVel, -1500, 1500);    // constrain baro velocity +/- 1500cm/s
@@ -411,8 +966,13 @@ int getEstimatedAltitude(void)
 
     // apply Complimentary Filter to keep the calculated velocity based on baro velocity (i.e. near real velocity).
     // By using CF it's possible to correct the drift of integrated accZ (velocity) without loosing the phase, i.e without delay
+#ifdef FIXED_IMU
+    vel = ((int64_t)vel * baroCfVelQ16 + ((int64_t)baroVel << 16) * (65536 - baroCfVelQ16)) >> 16;
+    vel_tmp = (vel + (1 << 15)) >> 16;
+#else
     vel = vel * cfg.baro_cf_vel + baroVel * (1 - cfg.baro_cf_vel);
     vel_tmp = lrintf(vel);
+#endif
 
     // set vario
     vario = applyDeadband(vel_tmp, 5);
@@ -438,7 +998,11 @@ int getEstimatedAltitude(void)
         BaroPID += errorVelocityI / 8196;     // I in the range of +/-200
 
         // D
+#ifdef FIXED_IMU
+        BaroPID -= constrain(cfg.D8[PIDVEL] * (accZ_tmp + accZ_old) / (512 * 256), -150, 150);
+#else
         BaroPID -= constrain(cfg.D8[PIDVEL] * (accZ_tmp + accZ_old) / 512, -150, 150);
+#endif
 
     } else {
         BaroPID = 0;
@@ -9,6 +9,8 @@
 
 core_t core;
 int hw_revision = 0;
+uint32_t bootTime[BOOT_PHASE_COUNT];    // us spent in each part of main() before the first loop
+bool bootSensorCacheHit = false;
 
 extern rcReadRawDataPtr rcReadRawFunc;
 
@@ -36,7 +38,20 @@ int fputc(int c, FILE *f)
 }
 #endif
 
+void bootTimeMark(bootPhase_e phase)
+{
+    static uint32_t lastMark = 0;
+    uint32_t now = micros();
+
+    bootTime[phase] = now - lastMark;
+    lastMark = now;
+}
+
+#ifdef SITL
+int main(int argc, char *argv[])
+#else
 int main(void)
+#endif
 {
     uint8_t i;
     int id;
@@ -48,6 +63,11 @@ int main(void)
     serialPort_t* loopbackPort2 = NULL;
 #endif
 
+#ifdef SITL
+    // simulated clock, flash and model, before anything asks for the time
+    sitlInit(argc, argv);
+#endif
+    crashLogInit();
     initEEPROM();
     checkFirstTime(false);
     readEEPROM();
@@ -67,15 +87,27 @@ int main(void)
 #endif
 
     activateConfig();
+    bootTimeMark(BOOT_SYSTEM);
 
 #ifndef CJMCU
     id = spiInit();
-    if (id == SPI_DEVICE_MPU && hw_revision == NAZE32_REV5)
+    if (id == SPI_DEVICE_MPU && hw_revision == NAZE32_REV5) {
         hw_revision = NAZE32_SP;
+        // sensor reads by DMA, before serialInit() so USART1 knows to leave the channels alone
+        spiDmaInit();
+    }
+    if (id == SPI_DEVICE_FLASH) {
+        // blackbox pages are programmed by DMA, same constraint as above. Only when logging to flash is set up,
+        // otherwise USART1 keeps its DMA and the pages (if any) are programmed polled
+        if (mcfg.blackbox_rate && mcfg.blackbox_device == BLACKBOX_DEVICE_FLASH)
+            spiDmaInit();
+        blackboxInit();
+    }
 #endif
 
     if (hw_revision != NAZE32_SP)
         i2cInit(I2C_DEVICE);
+    bootTimeMark(BOOT_BUS);
 
     // configure power ADC
     if (mcfg.power_adc_channel > 0 && (mcfg.power_adc_channel == 1 || mcfg.power_adc_channel == 9))
@@ -114,7 +146,8 @@ int main(void)
 
     LED1_ON;
     LED0_OFF;
-    for (i = 0; i < 10; i++) {
+    // short hello when the sensors were confirmed from the detection cache
+    for (i = 0; i < (bootSensorCacheHit ? 2 : 10); i++) {
         LED1_TOGGLE;
         LED0_TOGGLE;
         delay(25);
@@ -124,9 +157,12 @@ int main(void)
     }
     LED0_OFF;
     LED1_OFF;
+    bootTimeMark(BOOT_BLINK);
 
     imuInit(); // Mag is initialized inside imuInit
+    filterInit(); // again now that gyro_sync is known, it sets the filter sample rate
     mixerInit(); // this will set core.useServo var depending on mixer type
+    bootTimeMark(BOOT_IMU);
 
     serialInit(mcfg.serial_baudrate);
 
@@ -231,6 +267,9 @@ int main(void)
     calibratingB = CALIBRATING_BARO_CYCLES;             // 10 seconds init_delay + 200 * 25 ms = 15 seconds before ground pressure settles
     f.SMALL_ANGLE = 1;
 
+    schedulerInit();
+    bootTimeMark(BOOT_PERIPHERALS);
+
     // loopy
     while (1) {
         loop();
@@ -260,9 +299,27 @@ int main(void)
     }
 }
 
-void HardFault_Handler(void)
+// stack is the exception frame: r0-r3, r12, lr, pc, xpsr
+__attribute__((used)) void hardFaultHandler(uint32_t *stack)
 {
     // fall out of the sky
     writeAllMotors(mcfg.mincommand);
+    // keep the crash log and come back up disarmed, the log survives a soft reset
+    crashLogFault(stack[6], stack[5]);
+    systemReset(false);
     while (1);
 }
+
+#ifndef SITL
+__attribute__((naked)) void HardFault_Handler(void)
+{
+    // pass whichever stack the fault was stacked on
+    __asm__ volatile (
+        "tst lr, #4     \n"
+        "ite eq         \n"
+        "mrseq r0, msp  \n"
+        "mrsne r0, psp  \n"
+        "b hardFaultHandler \n"
+    );
+}
+#endif
@@ -234,6 +234,11 @@ void mixerResetMotors(void)
         motor_disarmed[i] = feature(FEATURE_3D) ? mcfg.neutral3d : mcfg.mincommand;
 }
 
+uint8_t mixerMotorCount(void)
+{
+    return numberMotor;
+}
+
 void mixerLoadMix(int index)
 {
     int i;
@@ -14,6 +14,7 @@ uint8_t toggleBeep = 0;
 uint32_t currentTime = 0;
 uint32_t previousTime = 0;
 uint16_t cycleTime = 0;         // this is the number in micro second to achieve a full loop, it can differ a little and is taken into account in the PID loop
+uint16_t motorLatency = 0;      // time from gyro sample to motor update in us
 int16_t headFreeModeHold;
 
 uint16_t vbat;                  // battery voltage in 0.1V steps
@@ -152,9 +153,10 @@ void annexCode(void)
 
     if (f.HEADFREE_MODE) {
         float radDiff = (heading - headFreeModeHold) * M_PI / 180.0f;
-        float cosDiff = cosf(radDiff);
-        float sinDiff = sinf(radDiff);
-        int16_t rcCommand_PITCH = rcCommand[PITCH] * cosDiff + rcCommand[ROLL] * sinDiff;
+        float cosDiff, sinDiff;
+        int16_t rcCommand_PITCH;
+        sincos_approx(radDiff, &sinDiff, &cosDiff);
+        rcCommand_PITCH = rcCommand[PITCH] * cosDiff + rcCommand[ROLL] * sinDiff;
         rcCommand[ROLL] = rcCommand[ROLL] * cosDiff - rcCommand[PITCH] * sinDiff;
         rcCommand[PITCH] = rcCommand_PITCH;
     }
@@ -197,16 +199,6 @@ void annexCode(void)
 #endif
     }
 
-#ifdef LEDRING
-    if (feature(FEATURE_LED_RING)) {
-        static uint32_t LEDTime;
-        if ((int32_t)(currentTime - LEDTime) >= 0) {
-            LEDTime = currentTime + 50000;
-            ledringState();
-        }
-    }
-#endif
-
     if ((int32_t)(currentTime - calibratedAccTime) >= 0) {
         if (!f.SMALL_ANGLE) {
             f.ACC_CALIBRATED = 0; // the multi uses ACC and is not calibrated or is too much inclinated
@@ -217,14 +209,6 @@ void annexCode(void)
         }
     }
 
-    serialCom();
-
-#ifndef CJMCU
-    if (!cliMode && feature(FEATURE_TELEMETRY)) {
-        handleTelemetry();
-    }
-#endif
-
     if (sensors(SENSOR_GPS)) {
         static uint32_t GPSLEDTime;
         if ((int32_t)(currentTime - GPSLEDTime) >= 0 && (GPS_numSat >= 5)) {
@@ -234,9 +218,10 @@ void annexCode(void)
     }
 
     // Read out gyro temperature. can use it for something somewhere. maybe get MCU temperature instead? lots of fun possibilities.
-    if (gyro.temperature)
+    // A combined read only keeps the raw value, it gets converted here
+    if (gyro.temperature) {
         gyro.temperature(&telemTemperature1);
-    else {
+    } else {
         // TODO MCU temp
     }
 }
@@ -295,11 +280,6 @@ static void mwDisarm(void)
         f.ARMED = 0;
 }
 
-static void mwVario(void)
-{
-
-}
-
 static int32_t errorGyroI[3] = { 0, 0, 0 };
 static int32_t errorAngleI[2] = { 0, 0 };
 
@@ -352,9 +332,14 @@ static void pidMultiWii(void)
         PTerm -= (int32_t)gyroData[axis] * dynP8[axis] / 10 / 8; // 32 bits is needed for calculation
         delta = gyroData[axis] - lastGyro[axis];
         lastGyro[axis] = gyroData[axis];
-        deltaSum = delta1[axis] + delta2[axis] + delta;
-        delta2[axis] = delta1[axis];
-        delta1[axis] = delta;
+        if (dtermFilter.count) {
+            // filtered delta replaces the moving sum, x3 keeps the same D gain
+            deltaSum = filterApply(&dtermFilter, axis, delta) * 3;
+        } else {
+            deltaSum = delta1[axis] + delta2[axis] + delta;
+            delta2[axis] = delta1[axis];
+            delta1[axis] = delta;
+        }
         DTerm = (deltaSum * dynD8[axis]) / 32;
         axisPID[axis] = PTerm + ITerm - DTerm;
     }
@@ -408,7 +393,7 @@ static void pidRewrite(void)
 
         // limit maximum integrator value to prevent WindUp - accumulating extreme values when system is saturated.
         // I coefficient (I8) moved before integration to make limiting independent from PID settings
-        errorGyroI[axis] = constrain(errorGyroI[axis], (int32_t)-GYRO_I_MAX << 13, (int32_t)+GYRO_I_MAX << 13);
+        errorGyroI[axis] = constrain(errorGyroI[axis], -((int32_t)GYRO_I_MAX << 13), (int32_t)GYRO_I_MAX << 13);
         ITerm = errorGyroI[axis] >> 13;
 
         //-----calculate D-term
@@ -418,10 +403,14 @@ static void pidRewrite(void)
         // Correct difference by cycle time. Cycle time is jittery (can be different 2 times), so calculated difference
         // would be scaled by different dt each time. Division by dT fixes that.
         delta = (delta * ((uint16_t)0xFFFF / (cycleTime >> 4))) >> 6;
-        // add moving average here to reduce noise
-        deltaSum = delta1[axis] + delta2[axis] + delta;
-        delta2[axis] = delta1[axis];
-        delta1[axis] = delta;
+        // add moving average here to reduce noise, or the configured D-term filter
+        if (dtermFilter.count) {
+            deltaSum = filterApply(&dtermFilter, axis, delta) * 3;
+        } else {
+            deltaSum = delta1[axis] + delta2[axis] + delta;
+            delta2[axis] = delta1[axis];
+            delta1[axis] = delta;
+        }
         DTerm = (deltaSum * cfg.D8[axis]) >> 8;
 
         // -----calculate total PID output
@@ -453,6 +442,8 @@ void loop(void)
     static int16_t initialThrottleHold;
 #endif
     static uint32_t loopTime;
+    uint32_t sampleTime;
+    bool runLoop;
     uint16_t auxState = 0;
 #ifdef GPS
     static uint8_t GPSNavReset = 1;
@@ -500,6 +491,7 @@ void loop(void)
                     rcData[i] = mcfg.midrc;      // after specified guard time after RC signal is lost (in 0.1sec)
                 rcData[THROTTLE] = cfg.failsafe_throttle;
                 if (failsafeCnt > 5 * (cfg.failsafe_delay + cfg.failsafe_off_delay)) {  // Turn OFF motors after specified Time (in 0.1sec)
+                    crashLogFreeze(CRASH_FAILSAFE);
                     mwDisarm();             // This will prevent the copter to automatically rearm if failsafe shuts it down and prevents
                     f.OK_TO_ARM = 0;        // to restart accidentely by just reconnect to the tx - you will have to switch off first to rearm
                 }
@@ -792,61 +784,34 @@ void loop(void)
             f.HEADFREE_MODE = 0;
         }
     } else {                    // not in rc loop
-        static int taskOrder = 0;    // never call all function in the same loop, to avoid high delay spikes
-        switch (taskOrder) {
-        case 0:
-            taskOrder++;
-#ifdef MAG
-            if (sensors(SENSOR_MAG) && Mag_getADC())
-                break;
-#endif
-        case 1:
-            taskOrder++;
-#ifdef BARO
-            if (sensors(SENSOR_BARO) && Baro_update())
-                break;
-#endif
-        case 2:
-            taskOrder++;
-#ifdef BARO
-            if (sensors(SENSOR_BARO) && getEstimatedAltitude())
-                break;
-#endif
-        case 3:
-            // if GPS feature is enabled, gpsThread() will be called at some intervals to check for stuck
-            // hardware, wrong baud rates, init GPS if needed, etc. Don't use SENSOR_GPS here as gpsThread() can and will
-            // change this based on available hardware
-            taskOrder++;
-#ifdef GPS
-            if (feature(FEATURE_GPS)) {
-                gpsThread();
-                break;
-            }
-#endif
-        case 4:
-            taskOrder = 0;
-#ifdef SONAR
-            if (sensors(SENSOR_SONAR)) {
-                Sonar_update();
-            }
-#endif
-            if (feature(FEATURE_VARIO) && f.VARIO_MODE)
-                mwVario();
-            break;
-        }
+        // background tasks only run when they fit before the next control loop deadline
+        schedulerExecute(loopTime, mcfg.looptime != 0 || gyroSyncActive);
     }
 
     currentTime = micros();
-    if (mcfg.looptime == 0 || (int32_t)(currentTime - loopTime) >= 0) {
-        loopTime = currentTime + mcfg.looptime;
+    if (gyroSyncActive) {
+        // run as soon as the gyro signals a new sample, loopTime becomes the time the next one is due
+        runLoop = gyroSyncCheck(&sampleTime, &loopTime);
+    } else {
+        runLoop = mcfg.looptime == 0 || (int32_t)(currentTime - loopTime) >= 0;
+        sampleTime = currentTime;
+        if (runLoop)
+            loopTime = currentTime + mcfg.looptime;
+    }
 
+    if (runLoop) {
+        PERF_BEGIN(PERF_LOOP);
+        PERF_BEGIN(PERF_IMU);
         computeIMU();
+        PERF_END(PERF_IMU);
         // Measure loop rate just afer reading the sensors
         currentTime = micros();
         cycleTime = (int32_t)(currentTime - previousTime);
         previousTime = currentTime;
         // non IMU critical, temeperatur, serialcom
-         annexCode();
+        PERF_BEGIN(PERF_ANNEX);
+        annexCode();
+        PERF_END(PERF_ANNEX);
 #ifdef MAG
         if (sensors(SENSOR_MAG)) {
             if (abs(rcCommand[YAW]) < 70 && f.MAG_MODE) {
@@ -913,8 +878,8 @@ void loop(void)
 #ifdef GPS
         if (sensors(SENSOR_GPS)) {
             if ((f.GPS_HOME_MODE || f.GPS_HOLD_MODE) && f.GPS_FIX_HOME) {
-                float sin_yaw_y = sinf(heading * 0.0174532925f);
-                float cos_yaw_x = cosf(heading * 0.0174532925f);
+                float sin_yaw_y, cos_yaw_x;
+                sincos_approx(heading * 0.0174532925f, &sin_yaw_y, &cos_yaw_x);
                 if (cfg.nav_slew_rate) {
                     nav_rated[LON] += constrain(wrap_18000(nav[LON] - nav_rated[LON]), -cfg.nav_slew_rate, cfg.nav_slew_rate); // TODO check this on uint8
                     nav_rated[LAT] += constrain(wrap_18000(nav[LAT] - nav_rated[LAT]), -cfg.nav_slew_rate, cfg.nav_slew_rate);
@@ -929,10 +894,20 @@ void loop(void)
 #endif
 
         // PID - note this is function pointer set by setPIDController()
+        PERF_BEGIN(PERF_PID);
         pid_controller();
+        PERF_END(PERF_PID);
 
+        PERF_BEGIN(PERF_MIXER);
         mixTable();
         writeServos();
+        PERF_END(PERF_MIXER);
+        PERF_BEGIN(PERF_MOTORS);
         writeMotors();
+        PERF_END(PERF_MOTORS);
+        motorLatency = micros() - sampleTime;
+        blackboxLog();
+        crashLogUpdate();
+        PERF_END(PERF_LOOP);
     }
 }
@@ -69,6 +69,11 @@ typedef enum FlapsType {
     FLAPS_TYPE_MAX = FLAPS_FLAPERONS_INVERTED_ENABLED
 } FlapsType;
 
+typedef enum ImuAlgorithm {
+    IMU_COMPLEMENTARY = 0,
+    IMU_QUATERNION,
+} ImuAlgorithm;
+
 /*********** RC alias *****************/
 enum {
     ROLL = 0,
@@ -181,6 +186,9 @@ typedef struct config_t {
 
     uint8_t dynThrPID;
     uint16_t tpa_breakpoint;                // Breakpoint where TPA is activated
+    uint16_t dterm_lpf;                     // biquad low pass on the D-term instead of the 3 sample moving sum, cutoff in Hz. 0 = off
+    uint16_t dterm_notch_hz;                // biquad notch on the D-term, center in Hz. 0 = off
+    uint16_t dterm_notch_bw;                // notch -3dB bandwidth in Hz
     int16_t mag_declination;                // Get your magnetic decliniation from here : http://magnetic-declination.com/
     int16_t angleTrim[2];                   // accelerometer trim
 
@@ -233,6 +241,15 @@ typedef struct config_t {
 } config_t;
 
 // System-wide
+// Hardware found by sensorsAutodetect(), the next boot only asks these drivers and falls back to the full probe on a mismatch
+typedef struct sensorCache_t {
+    uint8_t hw_revision;                    // board the cache was taken on
+    uint8_t gyro;                           // GyroSensors, GYRO_NONE = empty cache
+    uint8_t acc;                            // AccelSensors, ACC_DEFAULT = probe
+    uint8_t baro;                           // BaroSensors, BARO_NONE = probe
+    uint8_t mag;                            // CompassSensors, MAG_DEFAULT = probe
+} sensorCache_t;
+
 typedef struct master_t {
     uint8_t version;
     uint16_t size;
@@ -241,6 +258,8 @@ typedef struct master_t {
     uint8_t mixerConfiguration;
     uint32_t enabledFeatures;
     uint16_t looptime;                      // imu loop time in us
+    uint8_t gyro_sync;                      // run the control loop off the gyro data ready interrupt instead of looptime (MPU on rev5+ hardware only)
+    uint8_t gyro_fifo;                      // queue gyro samples in the MPU FIFO and average all of them each loop (MPU6050/MPU6500 only)
     uint8_t emf_avoidance;                  // change pll settings to avoid noise in the uhf band
     motorMixer_t customMixer[MAX_MOTORS];   // custom mixtable
 
@@ -266,8 +285,17 @@ typedef struct master_t {
     uint8_t acc_hardware;                   // Which acc hardware to use on boards with more than one device
     uint8_t mag_hardware;                   // Which mag hardware to use
     uint16_t gyro_lpf;                      // gyro LPF setting - values are driver specific, in case of invalid number, a reasonable default ~30-40HZ is chosen.
+    uint16_t gyro_soft_lpf;                 // biquad low pass on the gyro after the sensor, cutoff in Hz. 0 = off
+    uint16_t gyro_notch1_hz;                // biquad notch on the gyro, center in Hz. 0 = off
+    uint16_t gyro_notch1_bw;                // notch -3dB bandwidth in Hz
+    uint16_t gyro_notch2_hz;                // second gyro notch, center in Hz. 0 = off
+    uint16_t gyro_notch2_bw;
     uint16_t gyro_cmpf_factor;              // Set the Gyro Weight for Gyro/Acc complementary filter. Increasing this value would reduce and delay Acc influence on the output of the filter.
     uint16_t gyro_cmpfm_factor;             // Set the Gyro Weight for Gyro/Magnetometer complementary filter. Increasing this value would reduce and delay Magnetometer influence on the output of the filter
+    uint8_t acc_fusion_divider;             // Read ACC and run the attitude/heading/earth frame acc update every Nth loop, gyro deltas are accumulated and angles/heading follow the gyro in between. 1 = every loop
+    uint8_t imu_algorithm;                  // See ImuAlgorithm enum. 0 = complementary filter, 1 = quaternion with Mahony feedback
+    uint16_t imu_kp;                        // quaternion estimator acc/mag proportional feedback gain * 10000
+    uint16_t imu_ki;                        // quaternion estimator acc/mag integral feedback gain * 10000
     uint8_t moron_threshold;                // people keep forgetting that moving model while init results in wrong gyro offsets. and then they never reset gyro. so this is now on by default.
     uint16_t max_angle_inclination;         // max inclination allowed in angle (level) mode. default 500 (50 degrees).
     int16_t accZero[3];
@@ -317,9 +345,14 @@ typedef struct master_t {
     uint8_t telemetry_provider;             // See TelemetryProvider enum.
     uint8_t telemetry_port;                 // See TelemetryPort enum.
     uint8_t telemetry_switch;               // Use aux channel to change serial output & baudrate( MSP / Telemetry ). It disables automatic switching to Telemetry when armed.
+    uint8_t blackbox_rate;                  // log a blackbox frame every this many loops while armed, 0 disables logging
+    uint8_t blackbox_device;                // See BlackboxDevice enum.
+    uint32_t blackbox_baudrate;             // serial blackbox stream baudrate, the port goes back to serial_baudrate when disarmed
+    uint8_t blackbox_raw;                   // also log the raw sensor readings, their sample times and rcData, what a SITL replay needs
     config_t profile[3];                    // 3 separate profiles
     uint8_t current_profile;                // currently loaded profile
     uint8_t reboot_character;               // which byte is used to reboot. Default 'R', could be changed carefully to something else.
+    sensorCache_t sensorCache;              // written by sensorsAutodetect(), not a user setting
 
     uint8_t magic_ef;                       // magic number, should be 0xEF
     uint8_t chk;                            // XOR checksum
@@ -358,6 +391,144 @@ typedef struct flags_t {
     uint8_t FIXED_WING;                     // set when in flying_wing or airplane mode. currently used by althold selection code
 } flags_t;
 
+// background tasks run by the scheduler, sync this with tasks[] in scheduler.c
+typedef enum {
+    TASK_MAG = 0,
+    TASK_BARO,
+    TASK_ALTITUDE,
+    TASK_GPS,
+    TASK_SONAR,
+    TASK_SERIAL,
+    TASK_TELEMETRY,
+    TASK_LEDRING,
+    TASK_CONFIG,
+    TASK_BLACKBOX,
+    TASK_COUNT
+} taskId_e;
+
+typedef struct task_t {
+    const char *name;
+    void (*taskFunc)(void);
+    uint32_t desiredPeriod;                 // in us
+    uint8_t priority;                       // static priority, grows with time spent waiting
+
+    uint32_t lastExecutedAt;                // micros() when the task was last dispatched
+    uint32_t worstCaseExecutionTime;        // slowly decaying execution time peak, used to decide if the task fits
+    uint32_t maxExecutionTime;              // highest execution time seen since boot
+    uint32_t averageExecutionTime;          // in 1/16 us
+    uint32_t averageDeltaTime;              // time between dispatches in 1/16 us
+    uint16_t lateCount;                     // dispatches that missed at least one full period
+} task_t;
+
+// biquad section for filter.c, Q28 coefficients normalized to a0
+typedef struct biquad_t {
+    int32_t b0, b1, b2, a1, a2;
+} biquad_t;
+
+typedef struct biquadState_t {
+    int32_t x1, x2, y1, y2;                 // previous inputs and outputs with 8 fractional bits
+} biquadState_t;
+
+#define FILTER_CHAIN_LENGTH 3
+
+// sections are applied in order, with separate state per axis
+typedef struct filterChain_t {
+    uint8_t count;
+    biquad_t sections[FILTER_CHAIN_LENGTH];
+    biquadState_t state[3][FILTER_CHAIN_LENGTH];
+} filterChain_t;
+
+// boot time breakdown, reported by MSP_BOOT_TIME
+typedef enum {
+    BOOT_SYSTEM = 0,                        // eeprom, clock and config, from systemInit()
+    BOOT_BUS,                               // SPI/I2C init and SPI device probe
+    BOOT_GYRO_ACC,
+    BOOT_BARO,
+    BOOT_MAG,                               // including the detection cache update
+    BOOT_BLINK,                             // startup LED/beeper pattern
+    BOOT_IMU,                               // imuInit() with mag calibration, filters, mixer
+    BOOT_PERIPHERALS,                       // serial, pwm, receiver, gps, telemetry
+    BOOT_PHASE_COUNT
+} bootPhase_e;
+
+// flight data recorder state, reported by MSP_FLASH_INFO
+typedef struct blackboxStatus_t {
+    bool present;                           // flash chip found
+    bool logging;
+    bool erasing;
+    bool streaming;                         // a serial port is taken for the stream
+    uint32_t size;                          // bytes
+    uint32_t used;                          // bytes, always a whole number of pages
+    uint32_t frames;                        // logged since boot or the last erase
+    uint32_t dropped;                       // frames skipped because the flash couldn't keep up
+} blackboxStatus_t;
+
+// crash recorder, see crashlog.c
+#define CRASHLOG_SAMPLES    25                  // 2s at one sample per 80ms, 900 bytes of RAM
+#define CRASHLOG_CHANNELS   8
+#define CRASHLOG_MOTORS     8
+
+typedef enum {
+    CRASH_NONE = 0,                         // still recording
+    CRASH_FAILSAFE,                         // disarmed by failsafe
+    CRASH_HARDFAULT,
+    CRASH_LOOP_OVERRUN,                     // cycleTime far beyond looptime while armed
+} crashReason_e;
+
+typedef struct crashSample_t {
+    uint16_t time;                          // millis(), low 16 bits
+    int16_t angle[2];
+    int16_t heading;
+    int16_t gyro[3];
+    uint8_t rcData[CRASHLOG_CHANNELS];      // (us - 1000) / 4, 1000us to 2020us
+    uint8_t motor[CRASHLOG_MOTORS];         // same
+    uint16_t cycleTime;
+    uint8_t i2cErrors;                      // low 8 bits of the counter, only the steps matter
+    uint8_t failsafeCnt;                    // stops at 255
+    uint8_t flags;                          // armed, angle, horizon, baro, mag, gps, passthru
+} crashSample_t;
+
+typedef struct crashLogInfo_t {
+    uint8_t reason;                         // crashReason_e
+    uint8_t count;                          // valid samples
+    uint16_t crashes;                       // events since MSP_CRASH_CLEAR, the samples are of the latest flight's first
+    uint32_t frozenAt;                      // millis() when frozen, time since the boot that crashed
+    uint32_t faultPC;                       // hard fault only
+    uint32_t faultLR;
+    uint32_t faultCFSR;
+    uint32_t faultHFSR;
+} crashLogInfo_t;
+
+// main loop profiler sections, sync this with perfSectionNames[] in perf.c
+typedef enum {
+    PERF_LOOP = 0,
+    PERF_IMU,
+    PERF_ANNEX,
+    PERF_SERIAL,
+    PERF_PID,
+    PERF_MIXER,
+    PERF_MOTORS,
+    PERF_MSP,                               // one request from the host, parsed frame to reply queued
+    PERF_ATTITUDE,                          // the attitude estimator of a fusion loop, part of IMU
+    PERF_SECTION_COUNT
+} perfSection_e;
+
+typedef struct perfSection_t {
+    uint32_t start;                         // cycle count when the section was entered
+    uint32_t min;
+    uint32_t max;
+    uint32_t count;
+    uint64_t total;
+} perfSection_t;
+
+#ifdef PROFILING
+#define PERF_BEGIN(section)     perfSections[section].start = cycleCount()
+#define PERF_END(section)       perfRecord(section, cycleCount() - perfSections[section].start)
+#else
+#define PERF_BEGIN(section)
+#define PERF_END(section)
+#endif
+
 extern int16_t gyroZero[3];
 extern int16_t gyroData[3];
 extern int16_t angle[2];
@@ -375,6 +546,13 @@ extern int accSumCount;
 extern uint32_t currentTime;
 extern uint32_t previousTime;
 extern uint16_t cycleTime;
+extern uint16_t motorLatency;
+extern bool gyroSyncActive;
+extern gyroFifoStats_t gyroFifoStats;
+extern uint32_t bootTime[BOOT_PHASE_COUNT];
+extern bool bootSensorCacheHit;
+extern sensor_data_t sensorData;
+extern sensorRaw_t sensorRaw;
 extern uint16_t calibratingA;
 extern uint16_t calibratingB;
 extern uint16_t calibratingG;
@@ -435,10 +613,16 @@ extern flags_t f;
 extern sensor_t acc;
 extern sensor_t gyro;
 extern baro_t baro;
+extern task_t tasks[TASK_COUNT];
+extern perfSection_t perfSections[PERF_SECTION_COUNT];
+extern filterChain_t gyroFilter;
+extern filterChain_t dtermFilter;
+extern const char * const perfSectionNames[PERF_SECTION_COUNT];
 
 // main
 void setPIDController(int type);
 void loop(void);
+void bootTimeMark(bootPhase_e phase);
 
 // IMU
 void imuInit(void);
@@ -454,6 +638,7 @@ uint16_t batteryAdcToVoltage(uint16_t src);
 int32_t currentSensorToCentiamps(uint16_t src);
 void ACC_getADC(void);
 int Baro_update(void);
+bool gyroSyncCheck(uint32_t *sampleTime, uint32_t *nextSampleTime);
 void Gyro_getADC(void);
 void Mag_init(void);
 int Mag_getADC(void);
@@ -461,10 +646,26 @@ void Sonar_init(void);
 void Sonar_update(void);
 uint16_t RSSI_getValue(void);
 
+// Scheduler
+void schedulerInit(void);
+void schedulerExecute(uint32_t deadline, bool hasDeadline);
+uint16_t schedulerTaskRate(task_t *task);
+
+// Filters
+void filterInit(void);
+void filterSetSamplePeriod(uint32_t period);
+int32_t filterApply(filterChain_t *chain, int axis, int32_t input);
+
+// Profiler
+void perfRecord(uint8_t section, uint32_t cycles);
+uint32_t perfAverage(uint8_t section);
+void perfReset(void);
+
 // Output
 void mixerInit(void);
 void mixerResetMotors(void);
 void mixerLoadMix(int index);
+uint8_t mixerMotorCount(void);
 void writeServos(void);
 void writeMotors(void);
 void writeAllMotors(int16_t mc);
@@ -492,6 +693,32 @@ void featureClear(uint32_t mask);
 void featureClearAll(void);
 uint32_t featureMask(void);
 
+// Config store
+void configStoreInit(void);
+bool configStoreLoad(master_t *dst);
+void configStoreSave(void);
+bool configStoreBusy(void);
+void configStoreUpdate(void);
+void configStoreFlush(void);
+
+// Blackbox
+void blackboxInit(void);
+void blackboxLog(void);
+void blackboxUpdate(void);
+bool blackboxOwnsPort(serialPort_t *serial);
+bool blackboxErase(void);
+bool blackboxRead(uint32_t address, uint8_t *data, int len);
+void blackboxGetStatus(blackboxStatus_t *status);
+
+// Crash log
+void crashLogInit(void);
+void crashLogUpdate(void);
+void crashLogFreeze(uint8_t reason);
+void crashLogFault(uint32_t pc, uint32_t lr);
+void crashLogClear(void);
+void crashLogGetInfo(crashLogInfo_t *info);
+bool crashLogGetSample(uint8_t index, crashSample_t *sample);
+
 // spektrum
 void spektrumInit(rcReadRawDataPtr *callback);
 bool spektrumFrameComplete(void);
@@ -0,0 +1,54 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+
+#ifdef PROFILING
+
+// Per-section cycle counts of the main loop, measured with the DWT cycle counter.
+// Build with OPTIONS=PROFILING, otherwise the PERF_BEGIN/PERF_END markers compile to nothing.
+
+// sync this with perfSection_e enum from mw.h
+const char * const perfSectionNames[PERF_SECTION_COUNT] = {
+    "LOOP", "IMU", "ANNEX", "SERIAL", "PID", "MIXER", "MOTORS", "MSP", "ATTITUDE"
+};
+
+perfSection_t perfSections[PERF_SECTION_COUNT];
+
+void perfRecord(uint8_t section, uint32_t cycles)
+{
+    perfSection_t *s = &perfSections[section];
+
+    if (s->count == 0 || cycles < s->min)
+        s->min = cycles;
+    if (cycles > s->max)
+        s->max = cycles;
+    s->total += cycles;
+    s->count++;
+}
+
+uint32_t perfAverage(uint8_t section)
+{
+    perfSection_t *s = &perfSections[section];
+
+    if (s->count == 0)
+        return 0;
+    return s->total / s->count;
+}
+
+// leaves start alone, this gets called from inside the SERIAL section
+void perfReset(void)
+{
+    int i;
+
+    for (i = 0; i < PERF_SECTION_COUNT; i++) {
+        perfSections[i].min = 0;
+        perfSections[i].max = 0;
+        perfSections[i].total = 0;
+        perfSections[i].count = 0;
+    }
+}
+
+#endif
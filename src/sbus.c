@@ -13,7 +13,7 @@
 #define SBUS_SYNCBYTE 0x0F
 
 static bool sbusFrameDone = false;
-static void sbusDataReceive(uint16_t c);
+static void sbusDataReceive(const uint8_t *data, uint16_t len);
 static uint16_t sbusReadRawRC(uint8_t chan);
 
 // external vars (ugh)
@@ -56,31 +56,18 @@ typedef union {
 
 static sbus_msg sbus;
 
-// Receive ISR callback
-static void sbusDataReceive(uint16_t c)
+// Receive ISR callback, called with whatever arrived before the line went idle
+static void sbusDataReceive(const uint8_t *data, uint16_t len)
 {
-    uint32_t sbusTime;
-    static uint32_t sbusTimeLast;
-    static uint8_t sbusFramePosition;
-
-    sbusTime = micros();
-    if ((sbusTime - sbusTimeLast) > 2500) // sbus2 fast timing
-        sbusFramePosition = 0;
-    sbusTimeLast = sbusTime;
-
-    if (sbusFramePosition == 0 && c != SBUS_SYNCBYTE)
+    // keep the last whole frame if several came in back to back, drop partial ones
+    if (len < SBUS_FRAME_SIZE)
+        return;
+    data += len - SBUS_FRAME_SIZE;
+    if (data[0] != SBUS_SYNCBYTE)
         return;
 
-    sbusFrameDone = false; // lazy main loop didnt fetch the stuff
-    if (sbusFramePosition != 0)
-        sbus.in[sbusFramePosition - 1] = (uint8_t)c;
-
-    if (sbusFramePosition == SBUS_FRAME_SIZE - 1) {
-        sbusFrameDone = true;
-        sbusFramePosition = 0;
-    } else {
-        sbusFramePosition++;
-    }
+    memcpy(sbus.in, data + 1, SBUS_FRAME_SIZE - 1);
+    sbusFrameDone = true;
 }
 
 bool sbusFrameComplete(void)
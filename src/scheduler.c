@@ -0,0 +1,191 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+
+#include "cli.h"
+#include "telemetry_common.h"
+
+// Cooperative background scheduler. Runs in the gaps between control loop iterations and only
+// dispatches a task when its measured execution time fits before the next gyro/PID deadline.
+
+#define TASK_STARVATION_PERIODS     4       // a task waiting this many periods runs even if it doesn't fit
+#define TASK_WCET_DECAY_SHIFT       5       // how fast a one-off execution time spike is forgotten
+
+static void taskUpdateMag(void)
+{
+#ifdef MAG
+    if (sensors(SENSOR_MAG))
+        Mag_getADC();
+#endif
+}
+
+static void taskUpdateBaro(void)
+{
+#ifdef BARO
+    if (sensors(SENSOR_BARO))
+        Baro_update();
+#endif
+}
+
+static void taskUpdateAltitude(void)
+{
+#ifdef BARO
+    if (sensors(SENSOR_BARO))
+        getEstimatedAltitude();
+#endif
+}
+
+static void taskUpdateGps(void)
+{
+#ifdef GPS
+    // if GPS feature is enabled, gpsThread() will be called at some intervals to check for stuck
+    // hardware, wrong baud rates, init GPS if needed, etc. Don't use SENSOR_GPS here as gpsThread() can and will
+    // change this based on available hardware
+    if (feature(FEATURE_GPS))
+        gpsThread();
+#endif
+}
+
+static void taskUpdateSonar(void)
+{
+#ifdef SONAR
+    if (sensors(SENSOR_SONAR))
+        Sonar_update();
+#endif
+}
+
+static void taskHandleSerial(void)
+{
+    PERF_BEGIN(PERF_SERIAL);
+    serialCom();
+    PERF_END(PERF_SERIAL);
+}
+
+static void taskHandleTelemetry(void)
+{
+#ifndef CJMCU
+    if (!cliMode && feature(FEATURE_TELEMETRY))
+        handleTelemetry();
+#endif
+}
+
+static void taskUpdateConfig(void)
+{
+    configStoreUpdate();
+}
+
+static void taskUpdateBlackbox(void)
+{
+    blackboxUpdate();
+}
+
+static void taskUpdateLedring(void)
+{
+#ifdef LEDRING
+    if (feature(FEATURE_LED_RING))
+        ledringState();
+#endif
+}
+
+task_t tasks[TASK_COUNT] = {
+    [TASK_MAG] = { .name = "MAG", .taskFunc = taskUpdateMag, .desiredPeriod = 100000, .priority = 2 },
+    [TASK_BARO] = { .name = "BARO", .taskFunc = taskUpdateBaro, .desiredPeriod = 1000, .priority = 3 },
+    [TASK_ALTITUDE] = { .name = "ALTITUDE", .taskFunc = taskUpdateAltitude, .desiredPeriod = 25000, .priority = 2 },
+    [TASK_GPS] = { .name = "GPS", .taskFunc = taskUpdateGps, .desiredPeriod = 5000, .priority = 2 },
+    [TASK_SONAR] = { .name = "SONAR", .taskFunc = taskUpdateSonar, .desiredPeriod = 50000, .priority = 1 },
+    [TASK_SERIAL] = { .name = "SERIAL", .taskFunc = taskHandleSerial, .desiredPeriod = 1000, .priority = 1 },
+    [TASK_TELEMETRY] = { .name = "TELEMETRY", .taskFunc = taskHandleTelemetry, .desiredPeriod = 1000, .priority = 1 },
+    [TASK_LEDRING] = { .name = "LEDRING", .taskFunc = taskUpdateLedring, .desiredPeriod = 50000, .priority = 1 },
+    [TASK_CONFIG] = { .name = "CONFIG", .taskFunc = taskUpdateConfig, .desiredPeriod = 1000, .priority = 1 },
+    [TASK_BLACKBOX] = { .name = "BLACKBOX", .taskFunc = taskUpdateBlackbox, .desiredPeriod = 1000, .priority = 2 },
+};
+
+#ifdef SITL
+// nothing is due before the next task or the control loop deadline, a simulated clock can skip to there
+static void schedulerIdle(uint32_t now, uint32_t deadline, bool hasDeadline)
+{
+    int32_t wait = hasDeadline ? (int32_t)(deadline - now) : INT32_MAX;
+    int32_t due;
+    int i;
+
+    for (i = 0; i < TASK_COUNT; i++) {
+        due = (int32_t)(tasks[i].lastExecutedAt + tasks[i].desiredPeriod - now);
+        if (due > 0 && due < wait)
+            wait = due;
+    }
+    if (wait > 0 && wait != INT32_MAX)
+        sitlIdle(now + wait);
+}
+#endif
+
+void schedulerInit(void)
+{
+    uint32_t now = micros();
+    int i;
+
+    for (i = 0; i < TASK_COUNT; i++)
+        tasks[i].lastExecutedAt = now;
+}
+
+void schedulerExecute(uint32_t deadline, bool hasDeadline)
+{
+    uint32_t now = micros();
+    uint32_t age, start, executionTime;
+    uint32_t dynamicPriority, bestPriority = 0;
+    task_t *task, *selected = NULL;
+    int i;
+
+    for (i = 0; i < TASK_COUNT; i++) {
+        task = &tasks[i];
+        age = now - task->lastExecutedAt;
+        if (age < task->desiredPeriod)
+            continue;
+
+        // a task that doesn't fit in the remaining time is skipped unless it has been waiting far too long
+        if (hasDeadline && (int32_t)(deadline - now) < (int32_t)task->worstCaseExecutionTime && age < task->desiredPeriod * TASK_STARVATION_PERIODS)
+            continue;
+
+        // priority grows with the number of periods the task has been waiting
+        dynamicPriority = task->priority * (age / task->desiredPeriod);
+        if (dynamicPriority > bestPriority) {
+            bestPriority = dynamicPriority;
+            selected = task;
+        }
+    }
+
+    if (!selected) {
+#ifdef SITL
+        schedulerIdle(now, deadline, hasDeadline);
+#endif
+        return;
+    }
+
+    task = selected;
+    age = now - task->lastExecutedAt;
+    if (age >= task->desiredPeriod * 2)
+        task->lateCount++;
+    task->averageDeltaTime += ((int32_t)(age << 4) - (int32_t)task->averageDeltaTime) >> 5;
+    task->lastExecutedAt = now;
+
+    start = micros();
+    task->taskFunc();
+    executionTime = micros() - start;
+
+    if (executionTime > task->maxExecutionTime)
+        task->maxExecutionTime = executionTime;
+    if (executionTime > task->worstCaseExecutionTime)
+        task->worstCaseExecutionTime = executionTime;
+    else
+        task->worstCaseExecutionTime -= (task->worstCaseExecutionTime - executionTime) >> TASK_WCET_DECAY_SHIFT;
+    task->averageExecutionTime += ((int32_t)(executionTime << 4) - (int32_t)task->averageExecutionTime) >> 5;
+}
+
+uint16_t schedulerTaskRate(task_t *task)
+{
+    if (task->averageDeltaTime == 0)
+        return 0;
+    return (1000000 << 4) / task->averageDeltaTime;
+}
@@ -26,6 +26,45 @@ sensor_t mag;                       // mag access functions
 baro_t baro;                        // barometer access functions
 uint8_t accHardware = ACC_DEFAULT;  // which accel chip is used/detected
 uint8_t magHardware = MAG_DEFAULT;
+bool gyroSyncActive = false;        // control loop is driven by the gyro data ready interrupt
+gyroFifoStats_t gyroFifoStats;
+sensor_data_t sensorData;           // latest combined read, flags are cleared as the data is used
+sensorRaw_t sensorRaw;              // for the blackbox raw field set
+
+#define GYRO_SYNC_TIMEOUT 5000      // us without a data ready interrupt before falling back to free running
+
+static volatile bool gyroSampleReady = false;
+static volatile uint32_t gyroSampleTime = 0;
+static volatile uint32_t gyroSamplePeriod = 1000;
+
+// MPU_INT rising edge, a new gyro sample is waiting in the sensor
+static void gyroDataReadyCallback(void)
+{
+    uint32_t now = micros();
+
+    gyroSamplePeriod = now - gyroSampleTime;
+    gyroSampleTime = now;
+    gyroSampleReady = true;
+    // the sample goes on the bus now, the loop usually finds it read already
+    if (gyro.prefetch)
+        gyro.prefetch();
+}
+
+// Tries the given gyro, or all of them in order for GYRO_NONE
+static uint8_t gyroDetect(uint8_t type)
+{
+    if ((type == GYRO_NONE || type == GYRO_MPU6050) && mpu6050Detect(&acc, &gyro, mcfg.gyro_lpf, mcfg.gyro_fifo, &core.mpu6050_scale))
+        return GYRO_MPU6050; // this filled up acc.* struct with init values
+#ifndef CJMCU
+    if ((type == GYRO_NONE || type == GYRO_MPU6500) && hw_revision == NAZE32_SP && mpu6500Detect(&acc, &gyro, mcfg.gyro_lpf, mcfg.gyro_fifo))
+        return GYRO_MPU6500;
+    if ((type == GYRO_NONE || type == GYRO_L3G4200D) && l3g4200dDetect(&gyro, mcfg.gyro_lpf))
+        return GYRO_L3G4200D;
+    if ((type == GYRO_NONE || type == GYRO_MPU3050) && mpu3050Detect(&gyro, mcfg.gyro_lpf))
+        return GYRO_MPU3050;
+#endif
+    return GYRO_NONE;
+}
 
 bool sensorsAutodetect(void)
 {
@@ -35,28 +74,40 @@ bool sensorsAutodetect(void)
     bool haveMpu65 = false;
 #endif
     bool haveMpu6k = false;
+    uint8_t gyroHardware = GYRO_NONE;
+    uint8_t baroHardware = BARO_NONE;
+    uint8_t accType = mcfg.acc_hardware;
+#ifdef MAG
+    uint8_t magType = mcfg.mag_hardware;
+#endif
+    bool forcedMissing = false;
+    bool changed;
+    sensorCache_t cache;
+    // a cache from this board is trusted as long as its gyro answers, each detect function still checks the chip ID
+    bool useCache = mcfg.sensorCache.gyro != GYRO_NONE && mcfg.sensorCache.hw_revision == hw_revision;
 
     // Autodetect gyro hardware. We have MPU3050 or MPU6050 or MPU6500 on SPI
-    if (mpu6050Detect(&acc, &gyro, mcfg.gyro_lpf, &core.mpu6050_scale)) {
-        // this filled up  acc.* struct with init values
-        haveMpu6k = true;
-    } else
+    if (useCache)
+        gyroHardware = gyroDetect(mcfg.sensorCache.gyro);
+    if (gyroHardware == GYRO_NONE) {
+        useCache = false;
+        gyroHardware = gyroDetect(GYRO_NONE);
+    }
+    // if this fails, we get a beep + blink pattern. we're doomed, no gyro or i2c error.
+    if (gyroHardware == GYRO_NONE)
+        return false;
+    haveMpu6k = gyroHardware == GYRO_MPU6050;
 #ifndef CJMCU
-        if (hw_revision == NAZE32_SP && mpu6500Detect(&acc, &gyro, mcfg.gyro_lpf))
-            haveMpu65 = true;
-        else if (l3g4200dDetect(&gyro, mcfg.gyro_lpf)) {
-        // well, we found our gyro
-        ;
-    } else if (!mpu3050Detect(&gyro, mcfg.gyro_lpf))
+    haveMpu65 = gyroHardware == GYRO_MPU6500;
 #endif
-    {
-        // if this fails, we get a beep + blink pattern. we're doomed, no gyro or i2c error.
-        return false;
-    }
+
+    // autodetect starts at the cached acc, the probe continues past it as usual if it is gone
+    if (useCache && accType == ACC_DEFAULT)
+        accType = mcfg.sensorCache.acc;
 
     // Accelerometer. Fuck it. Let user break shit.
 retry:
-    switch (mcfg.acc_hardware) {
+    switch (accType) {
         case ACC_NONE: // disable ACC
             sensorsClear(SENSOR_ACC);
             break;
@@ -67,38 +118,38 @@ retry:
             acc_params.dataRate = 800; // unused currently
             if (adxl345Detect(&acc_params, &acc))
                 accHardware = ACC_ADXL345;
-            if (mcfg.acc_hardware == ACC_ADXL345)
+            if (accType == ACC_ADXL345)
                 break;
-            ; // fallthrough
 #endif
+            // fall through
         case ACC_MPU6050: // MPU6050
             if (haveMpu6k) {
-                mpu6050Detect(&acc, &gyro, mcfg.gyro_lpf, &core.mpu6050_scale); // yes, i'm rerunning it again.  re-fill acc struct
+                mpu6050Detect(&acc, &gyro, mcfg.gyro_lpf, mcfg.gyro_fifo, &core.mpu6050_scale); // yes, i'm rerunning it again.  re-fill acc struct
                 accHardware = ACC_MPU6050;
-                if (mcfg.acc_hardware == ACC_MPU6050)
+                if (accType == ACC_MPU6050)
                     break;
             }
             ; // fallthrough
 #ifdef NAZE
         case ACC_MPU6500: // MPU6500
             if (haveMpu65) {
-                mpu6500Detect(&acc, &gyro, mcfg.gyro_lpf); // yes, i'm rerunning it again.  re-fill acc struct
+                mpu6500Detect(&acc, &gyro, mcfg.gyro_lpf, mcfg.gyro_fifo); // yes, i'm rerunning it again.  re-fill acc struct
                 accHardware = ACC_MPU6500;
-                if (mcfg.acc_hardware == ACC_MPU6500)
+                if (accType == ACC_MPU6500)
                     break;
             }
             ; // fallthrough
         case ACC_MMA8452: // MMA8452
             if (mma8452Detect(&acc)) {
                 accHardware = ACC_MMA8452;
-                if (mcfg.acc_hardware == ACC_MMA8452)
+                if (accType == ACC_MMA8452)
                     break;
             }
             ; // fallthrough
         case ACC_BMA280: // BMA280
             if (bma280Detect(&acc)) {
                 accHardware = ACC_BMA280;
-                if (mcfg.acc_hardware == ACC_BMA280)
+                if (accType == ACC_BMA280)
                     break;
             }
 #endif
@@ -106,28 +157,41 @@ retry:
 
     // Found anything? Check if user fucked up or ACC is really missing.
     if (accHardware == ACC_DEFAULT) {
-        if (mcfg.acc_hardware > ACC_DEFAULT) {
-            // Nothing was found and we have a forced sensor type. Stupid user probably chose a sensor that isn't present.
-            mcfg.acc_hardware = ACC_DEFAULT;
+        if (accType > ACC_DEFAULT) {
+            // Nothing was found and we have a forced (or cached) sensor type. Stupid user probably chose a sensor that isn't present.
+            if (mcfg.acc_hardware == accType) {
+                mcfg.acc_hardware = ACC_DEFAULT;
+                forcedMissing = true;
+            }
+            accType = ACC_DEFAULT;
             goto retry;
         } else {
             // We're really screwed
             sensorsClear(SENSOR_ACC);
         }
     }
+    bootTimeMark(BOOT_GYRO_ACC);
 
 #ifdef BARO
     // Detect what pressure sensors are available. baro->update() is set to sensor-specific update function
-    if (!bmp085Detect(&baro)) {
+    // A cached MS5611 goes first, that saves the BMP085 probe and its wait
+    if (useCache && mcfg.sensorCache.baro == BARO_MS5611 && ms5611Detect(&baro)) {
+        baroHardware = BARO_MS5611;
+    } else if (bmp085Detect(&baro)) {
+        baroHardware = BARO_BMP085;
+    } else {
         // ms5611 disables BMP085, and tries to initialize + check PROM crc. 
         // moved 5611 init here because there have been some reports that calibration data in BMP180
         // has been "passing" ms5611 PROM crc check
-        if (!ms5611Detect(&baro)) {
+        if (ms5611Detect(&baro)) {
+            baroHardware = BARO_MS5611;
+        } else {
             // if both failed, we don't have anything
             sensorsClear(SENSOR_BARO);
         }
     }
 #endif
+    bootTimeMark(BOOT_BARO);
 
     // Now time to init things, acc first
     if (sensors(SENSOR_ACC))
@@ -135,9 +199,20 @@ retry:
     // this is safe because either mpu6050 or mpu3050 or lg3d20 sets it, and in case of fail, we never get here.
     gyro.init(mcfg.gyro_align);
 
+#ifndef CJMCU
+    // MPU data ready output is only routed to PC13 on rev5 and later hardware
+    if (mcfg.gyro_sync && hw_revision >= NAZE32_REV5 && (haveMpu6k || haveMpu65)) {
+        gpioExtiConfig(GPIO_PortSourceGPIOC, GPIO_PinSource13, EXTI_Trigger_Rising, gyroDataReadyCallback);
+        gyroSyncActive = true;
+    }
+#endif
+
 #ifdef MAG
+    if (useCache && magType == MAG_DEFAULT)
+        magType = mcfg.sensorCache.mag;
+
     retryMag:
-    switch (mcfg.mag_hardware) {
+    switch (magType) {
         case MAG_NONE: // disable MAG
             sensorsClear(SENSOR_MAG);
             break;
@@ -146,7 +221,7 @@ retry:
         case MAG_HMC5883L:
             if (hmc5883lDetect(&mag)) {
               magHardware = MAG_HMC5883L;
-              if (mcfg.mag_hardware == MAG_HMC5883L)
+              if (magType == MAG_HMC5883L)
                 break;
           }
         ; // fallthrough
@@ -154,16 +229,20 @@ retry:
         case MAG_AK8975:
             if (ak8975detect(&mag)) {
                 magHardware = MAG_AK8975;
-                if (mcfg.mag_hardware == MAG_AK8975)
+                if (magType == MAG_AK8975)
                     break;
             }
     }
     
     // Found anything? Check if user fucked up or mag is really missing.
     if (magHardware == MAG_DEFAULT) {
-        if (mcfg.mag_hardware > MAG_DEFAULT) {
-            // Nothing was found and we have a forced sensor type. Stupid user probably chose a sensor that isn't present.
-            mcfg.mag_hardware = MAG_DEFAULT;
+        if (magType > MAG_DEFAULT) {
+            // Nothing was found and we have a forced (or cached) sensor type. Stupid user probably chose a sensor that isn't present.
+            if (mcfg.mag_hardware == magType) {
+                mcfg.mag_hardware = MAG_DEFAULT;
+                forcedMissing = true;
+            }
+            magType = MAG_DEFAULT;
             goto retryMag;
         } else {
             // No mag present
@@ -172,6 +251,21 @@ retry:
     }
 #endif
 
+    // remember what was found. not when a forced sensor was missing, the write would also save the reset setting
+    memset(&cache, 0, sizeof(cache));
+    cache.hw_revision = hw_revision;
+    cache.gyro = gyroHardware;
+    cache.acc = accHardware;
+    cache.baro = baroHardware;
+    cache.mag = magHardware;
+    changed = memcmp(&cache, &mcfg.sensorCache, sizeof(cache)) != 0;
+    bootSensorCacheHit = useCache && !changed;
+    if (changed && !forcedMissing) {
+        mcfg.sensorCache = cache;
+        writeEEPROM(0, false);
+    }
+    bootTimeMark(BOOT_MAG);
+
     // calculate magnetic declination
     deg = cfg.mag_declination / 100;
     min = cfg.mag_declination % 100;
@@ -325,7 +419,14 @@ static void ACC_Common(void)
 
 void ACC_getADC(void)
 {
-    acc.read(accADC);
+    // already fetched together with the gyro this loop
+    if (sensorData.updated & ACC_UPDATED) {
+        memcpy(accADC, sensorData.acc, sizeof(accADC));
+        sensorData.updated &= ~ACC_UPDATED;
+    } else {
+        acc.read(accADC);
+    }
+    memcpy(sensorRaw.acc, accADC, sizeof(sensorRaw.acc));
     ACC_Common();
 }
 
@@ -359,6 +460,7 @@ int Baro_update(void)
         baro.get_up();
         baro.start_ut();
         baroDeadline += baro.ut_delay;
+        sensorRaw.baroAt = micros();
         baro.calculate(&baroPressure, &baroTemperature);
         state = 0;
         return 2;
@@ -448,11 +550,69 @@ static void GYRO_Common(void)
         gyroADC[axis] -= gyroZero[axis];
 }
 
+// Returns true once per gyro data ready interrupt, with the sample timestamp and when the next one is due
+bool gyroSyncCheck(uint32_t *sampleTime, uint32_t *nextSampleTime)
+{
+    uint32_t now = micros();
+
+    if (gyroSampleReady) {
+        __disable_irq();
+        gyroSampleReady = false;
+        *sampleTime = gyroSampleTime;
+        *nextSampleTime = gyroSampleTime + gyroSamplePeriod;
+        __enable_irq();
+        return true;
+    }
+
+    // interrupt went missing, don't stall the control loop
+    if ((int32_t)(now - gyroSampleTime) > GYRO_SYNC_TIMEOUT) {
+        *sampleTime = now;
+        *nextSampleTime = now + gyroSamplePeriod;
+        return true;
+    }
+
+    return false;
+}
+
 void Gyro_getADC(void)
 {
+    static uint32_t rateWindowStart = 0;
+    static uint32_t rateWindowSamples = 0;
+    static uint32_t rateWindowReads = 0;
+    uint32_t now;
+
     // range: +/- 8192; +/- 2000 deg/sec
-    gyro.read(gyroADC);
+    gyroFifoStats.samples = 1;      // FIFO reads overwrite this with the number of samples they averaged
+    sensorRaw.gyroAt = micros();
+    if (gyro.readAll) {
+        gyro.readAll(&sensorData);
+        memcpy(gyroADC, sensorData.gyro, sizeof(gyroADC));
+        sensorData.updated &= ~GYRO_UPDATED;
+    } else {
+        gyro.read(gyroADC);
+    }
+    memcpy(sensorRaw.gyro, gyroADC, sizeof(sensorRaw.gyro));
     GYRO_Common();
+
+    if (gyroFilter.count) {
+        int axis;
+        // a notch or resonant low pass can overshoot the sensor range
+        for (axis = 0; axis < 3; axis++)
+            gyroADC[axis] = constrain(filterApply(&gyroFilter, axis, gyroADC[axis]), INT16_MIN, INT16_MAX);
+    }
+
+    rateWindowSamples += gyroFifoStats.samples;
+    rateWindowReads++;
+    now = micros();
+    if (now - rateWindowStart >= 1000000) {
+        gyroFifoStats.sampleRate = rateWindowSamples * 1000 / ((now - rateWindowStart) / 1000);
+        // the filters see one sample per read, the first window starts at power up rather than the first read
+        if (rateWindowStart)
+            filterSetSamplePeriod((now - rateWindowStart) / rateWindowReads);
+        rateWindowSamples = 0;
+        rateWindowReads = 0;
+        rateWindowStart = now;
+    }
 }
 
 #ifdef MAG
@@ -479,7 +639,9 @@ int Mag_getADC(void)
     t = currentTime + 100000;
 
     // Read mag sensor
+    sensorRaw.magAt = micros();
     mag.read(magADC);
+    memcpy(sensorRaw.mag, magADC, sizeof(sensorRaw.mag));
 
     if (f.CALIBRATE_MAG) {
         tCal = t;
@@ -532,4 +694,4 @@ void Sonar_update(void)
     hcsr04_get_distance(&sonarAlt);
 }
 
-#endif
+#endif
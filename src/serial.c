@@ -76,8 +76,33 @@
 #define MSP_SET_CONFIG           67     //in message          baseflight-specific settings save
 #define MSP_REBOOT               68     //in message          reboot settings
 #define MSP_BUILDINFO            69     //out message         build date as well as some space for future expansion
+#define MSP_TASKS                70     //out message         background task scheduler statistics
+#define MSP_PERF                 71     //out message         main loop profiler cycle counts, resets them after sending (OPTIONS=PROFILING builds only)
+#define MSP_GYRO_FIFO            72     //out message         gyro FIFO overflow count and effective sample rate
+#define MSP_BUS_STATS            73     //out message         I2C transaction count, errors, average time and queue depth, SPI transfer counts
+#define MSP_BOOT_TIME            74     //out message         us spent in each boot phase and whether the sensor detection cache was used
+#define MSP_SUBSCRIBE            75     //in message          bandwidth budget and (message, rate) pairs the board pushes on its own, empty list stops it
+#define MSP_BATCH                76     //in message          list of read-only commands, their replies go out as TX space frees followed by the count sent
+#define MSP_FLASH_INFO           77     //out message         blackbox flash size, bytes used, logging/erase/streaming state, frames logged and dropped
+#define MSP_FLASH_ERASE          78     //in message          erase the whole blackbox flash, disarmed only, poll MSP_FLASH_INFO for completion
+#define MSP_FLASH_READ           79     //out message         address and optional length in, address and up to MSP_FLASH_READ_MAX bytes of log out
+#define MSP_CRASH_DUMP           81     //out message         first sample index in, crash log reason, crash count, fault registers and the samples from there that fit out
+#define MSP_CRASH_CLEAR          82     //in message          forget the crash log and its crash count, disarmed only
 
-#define INBUF_SIZE 64
+// MSP v2 only, 16 bit command ids
+#define MSP2_CONFIG_READ         0x4000 //out message         offset in, total size, offset and as much of master_t from there as fits the TX buffer out
+#define MSP2_CONFIG_WRITE        0x4001 //in message          offset and a chunk of master_t, the chunk that completes it saves to flash
+
+#define INBUF_SIZE 256
+#define MSP_V1_FRAME_SIZE (5 + 255 + 1)   // $M> size cmd, payload, checksum
+#define MSP_FRAME_SIZE (8 + INBUF_SIZE + 1) // $X> flags cmd16 size16, payload, crc8
+#define MSP_MAX_SUBSCRIPTIONS 8
+#define MSP_BUDGET_BURST 100000           // us worth of bandwidth budget that can be saved up
+#define MSP_BATCH_RESERVE 16              // TX space kept free for the MSP_BATCH reply itself
+#define MSP_BATCH_MAX 32                  // commands of a MSP_BATCH list kept to send, the rest are ignored
+#define MSP_FLASH_READ_MAX 240            // fits a v1 frame with the address in front
+#define MSP_CRASH_SAMPLES_MAX 6           // crash log samples per MSP_CRASH_DUMP reply, fits a v1 frame
+#define MSP_CONFIG_WRITE_TIMEOUT 2000     // ms without a MSP2_CONFIG_WRITE chunk before the upload is abandoned
 
 typedef struct box_t {
     const uint8_t boxIndex;         // this is from boxnames enum
@@ -138,30 +163,78 @@ typedef enum serialState_t {
     HEADER_ARROW,
     HEADER_SIZE,
     HEADER_CMD,
+    HEADER_X,
+    HEADER_V2,
 } serialState_t;
 
+typedef struct mspSubscription_t {
+    uint8_t cmd;
+    uint8_t lastSize;               // frame length last time, what the next push is charged against the budget
+    uint32_t period;                // in us
+    uint32_t lastSentAt;
+} mspSubscription_t;
+
 typedef  struct mspPortState_t {
     serialPort_t *port;
     uint8_t checksum;
-    uint8_t indRX;
+    uint16_t indRX;
     uint8_t inBuf[INBUF_SIZE];
-    uint8_t cmdMSP;
-    uint8_t offset;
-    uint8_t dataSize;
+    uint16_t cmdMSP;
+    uint16_t offset;
+    uint16_t dataSize;
     serialState_t c_state;
+    uint8_t mspVersion;             // framing of the request being handled, replies use the same
+    mspSubscription_t subscriptions[MSP_MAX_SUBSCRIPTIONS];
+    uint8_t subscriptionCount;
+    uint8_t subscriptionVersion;
+    uint32_t bandwidth;             // bytes/s pushed replies may use
+    int32_t budget;                 // bytes that may be pushed right now
+    uint32_t budgetUpdatedAt;
+    uint8_t batch[MSP_BATCH_MAX];   // MSP_BATCH list, sent from batchNext on as TX space frees
+    uint8_t batchCount;
+    uint8_t batchNext;
+    uint8_t batchSent;
+    uint8_t batchVersion;
+    bool batchPending;              // until the count went out
 } mspPortState_t;
 
+// replies that only report state, safe to push without a request
+static const uint8_t subscribableMessages[] = {
+    MSP_STATUS, MSP_RAW_IMU, MSP_SERVO, MSP_MOTOR, MSP_RC, MSP_RAW_GPS, MSP_COMP_GPS,
+    MSP_ATTITUDE, MSP_ALTITUDE, MSP_ANALOG, MSP_NAV_STATUS, MSP_DEBUG,
+};
+
+// replies that don't take a payload or change anything, the ones a configurator asks for on connect
+static const uint8_t batchableMessages[] = {
+    MSP_IDENT, MSP_STATUS, MSP_RAW_IMU, MSP_SERVO, MSP_MOTOR, MSP_RC, MSP_RAW_GPS, MSP_COMP_GPS,
+    MSP_ATTITUDE, MSP_ALTITUDE, MSP_ANALOG, MSP_RC_TUNING, MSP_PID, MSP_BOX, MSP_MISC, MSP_MOTOR_PINS,
+    MSP_BOXNAMES, MSP_PIDNAMES, MSP_BOXIDS, MSP_SERVO_CONF, MSP_NAV_STATUS, MSP_NAV_CONFIG, MSP_UID,
+    MSP_GPSSVINFO, MSP_ACC_TRIM, MSP_RCMAP, MSP_CONFIG, MSP_BUILDINFO, MSP_TASKS, MSP_GYRO_FIFO,
+    MSP_BUS_STATS, MSP_BOOT_TIME, MSP_FLASH_INFO, MSP_DEBUG,
+};
+
 static mspPortState_t ports[2];
+static uint16_t configWriteOffset;  // where the next MSP2_CONFIG_WRITE chunk has to start
+static uint32_t configWriteAt;      // millis() of the last chunk
 static mspPortState_t *currentPortState = &ports[0];
 static int numTelemetryPorts = 0;
 
 // static uint8_t checksum, indRX, inBuf[INBUF_SIZE];
 // static uint8_t cmdMSP;
 
+// replies are assembled here in one piece and handed to the port with a single write by tailSerialReply()
+static uint8_t mspFrame[MSP_FRAME_SIZE];
+static uint16_t mspFrameLen;
+static uint16_t mspFrameLimit;
+static uint16_t mspLastFrameLen;
+static bool mspBatching;
+static bool mspBatchFull;                       // a batched reply didn't fit in the TX buffer, the rest are dropped
+
 void serialize8(uint8_t a)
 {
-    serialWrite(currentPortState->port, a);
-    currentPortState->checksum ^= a;
+    // keep room for the checksum, an oversized reply gets truncated rather than overrunning
+    if (mspFrameLen < mspFrameLimit)
+        mspFrame[mspFrameLen++] = a;
 }
 
 void serialize32(uint32_t a)
@@ -197,14 +270,42 @@ uint32_t read32(void)
     return t;
 }
 
+static uint8_t crc8_dvb_s2(uint8_t crc, uint8_t a)
+{
+    int i;
+
+    crc ^= a;
+    for (i = 0; i < 8; i++)
+        crc = (crc & 0x80) ? (crc << 1) ^ 0xD5 : crc << 1;
+    return crc;
+}
+
+static void mspChecksum(uint8_t c)
+{
+    if (currentPortState->mspVersion == 2)
+        currentPortState->checksum = crc8_dvb_s2(currentPortState->checksum, c);
+    else
+        currentPortState->checksum ^= c;
+}
+
 void headSerialResponse(uint8_t err, uint8_t s)
 {
+    // the payload length is patched with what was really written in tailSerialReply()
+    mspFrameLen = 0;
+    mspFrameLimit = currentPortState->mspVersion == 2 ? MSP_FRAME_SIZE - 1 : MSP_V1_FRAME_SIZE - 1;
     serialize8('$');
-    serialize8('M');
-    serialize8(err ? '!' : '>');
-    currentPortState->checksum = 0;               // start calculating a new checksum
-    serialize8(s);
-    serialize8(currentPortState->cmdMSP);
+    if (currentPortState->mspVersion == 2) {
+        serialize8('X');
+        serialize8(err ? '!' : '>');
+        serialize8(0);                            // flags
+        serialize16(currentPortState->cmdMSP);
+        serialize16(s);
+    } else {
+        serialize8('M');
+        serialize8(err ? '!' : '>');
+        serialize8(s);
+        serialize8(currentPortState->cmdMSP);
+    }
 }
 
 void headSerialReply(uint8_t s)
@@ -219,7 +320,41 @@ void headSerialError(uint8_t s)
 
 void tailSerialReply(void)
 {
-    serialize8(currentPortState->checksum);
+    uint8_t checksum = 0;
+    int i;
+
+    // nothing to send if the handler never started a reply
+    if (mspFrameLen < 5)
+        return;
+
+    if (mspFrame[1] == 'X') {
+        mspFrame[6] = (mspFrameLen - 8) & 0xFF;
+        mspFrame[7] = (mspFrameLen - 8) >> 8;
+        for (i = 3; i < mspFrameLen; i++)
+            checksum = crc8_dvb_s2(checksum, mspFrame[i]);
+    } else {
+        mspFrame[3] = mspFrameLen - 5;
+        for (i = 3; i < mspFrameLen; i++)
+            checksum ^= mspFrame[i];
+    }
+    mspFrame[mspFrameLen++] = checksum;
+
+    if (mspBatching && serialTxBytesFree(currentPortState->port) < (uint32_t)mspFrameLen + MSP_BATCH_RESERVE) {
+        mspBatchFull = true;
+        mspFrameLen = 0;
+        return;
+    }
+
+    // a reply that doesn't fit in the TX buffer is dropped whole rather than overwriting what is queued, the
+    // host asks again once the link has drained
+    if (serialWriteBuf(currentPortState->port, mspFrame, mspFrameLen)) {
+        mspLastFrameLen = mspFrameLen;
+    } else {
+        mspLastFrameLen = 0;
+        if (mspBatching)
+            mspBatchFull = true;
+    }
+    mspFrameLen = 0;
 }
 
 void s_struct(uint8_t *cb, uint8_t siz)
@@ -238,27 +373,12 @@ void serializeNames(const char *s)
 
 void serializeBoxNamesReply(void)
 {
-    int i, idx, j, flag = 1, count = 0, len;
-
-reset:
-    // in first run of the loop, we grab total size of junk to be sent
-    // then come back and actually send it
-    for (i = 0; i < numberBoxItems; i++) {
-        idx = availableBoxes[i];
-        len = strlen(boxes[idx].boxName);
-        if (flag) {
-            count += len;
-        } else {
-            for (j = 0; j < len; j++)
-                serialize8(boxes[idx].boxName[j]);
-        }
-    }
+    int i;
 
-    if (flag) {
-        headSerialReply(count);
-        flag = 0;
-        goto reset;
-    }
+    // the payload length is filled in once the frame is complete, so one pass over the names is enough
+    headSerialReply(0);
+    for (i = 0; i < numberBoxItems; i++)
+        serializeNames(boxes[availableBoxes[i]].boxName);
 }
 
 void serialInit(uint32_t baudrate)
@@ -311,6 +431,112 @@ void serialInit(uint32_t baudrate)
     numberBoxItems = idx;
 }
 
+static bool mspListed(const uint8_t *list, unsigned int count, uint8_t cmd)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        if (list[i] == cmd)
+            return true;
+    }
+    return false;
+}
+
+static bool mspSubscribable(uint8_t cmd)
+{
+    return mspListed(subscribableMessages, sizeof(subscribableMessages), cmd);
+}
+
+static void evaluateCommand(void);
+
+// the chunks of an upload go straight into mcfg, one that doesn't complete puts back the config in flash
+static void configWriteAbort(void)
+{
+    if (!configWriteOffset)
+        return;
+    configWriteOffset = 0;
+    // readEEPROM() keeps mcfg while a save is being written, let it finish first
+    configStoreFlush();
+    loadAndActivateConfig();
+}
+
+// sends the subscribed replies that are due, as long as the port's bandwidth budget allows
+static void mspPushSubscriptions(void)
+{
+    mspSubscription_t *sub;
+    uint32_t now = micros();
+    int32_t maxBudget;
+    uint16_t cmd;
+    uint8_t version;
+    int i;
+
+    if (!currentPortState->subscriptionCount)
+        return;
+
+    maxBudget = max(currentPortState->bandwidth * (MSP_BUDGET_BURST / 1000) / 1000, MSP_FRAME_SIZE);
+    currentPortState->budget += (int64_t)(now - currentPortState->budgetUpdatedAt) * currentPortState->bandwidth / 1000000;
+    currentPortState->budget = min(currentPortState->budget, maxBudget);
+    currentPortState->budgetUpdatedAt = now;
+
+    // the request being received may be half parsed, don't let the pushed replies clobber its command
+    cmd = currentPortState->cmdMSP;
+    version = currentPortState->mspVersion;
+    currentPortState->mspVersion = currentPortState->subscriptionVersion;
+    for (i = 0; i < currentPortState->subscriptionCount; i++) {
+        sub = &currentPortState->subscriptions[i];
+        if (now - sub->lastSentAt < sub->period || currentPortState->budget < sub->lastSize)
+            continue;
+        sub->lastSentAt = now;
+        currentPortState->cmdMSP = sub->cmd;
+        evaluateCommand();
+        // a dropped push costs nothing and keeps the size it had last time
+        if (mspLastFrameLen)
+            sub->lastSize = mspLastFrameLen;
+        currentPortState->budget -= mspLastFrameLen;
+    }
+    currentPortState->cmdMSP = cmd;
+    currentPortState->mspVersion = version;
+}
+
+// sends what the TX buffer has room for of the port's MSP_BATCH list, the count once the list is through
+static void mspBatchResume(void)
+{
+    mspPortState_t *state = currentPortState;
+    uint16_t cmd = state->cmdMSP;
+    uint8_t version = state->mspVersion;
+    bool empty;
+
+    if (!state->batchPending)
+        return;
+
+    state->mspVersion = state->batchVersion;
+    mspBatching = true;
+    while (state->batchNext < state->batchCount) {
+        empty = isSerialTransmitBufferEmpty(state->port);
+        mspBatchFull = false;
+        state->cmdMSP = state->batch[state->batchNext];
+        evaluateCommand();
+        if (mspBatchFull && !empty)
+            break;
+        // a reply that doesn't fit even an empty TX buffer is skipped, it would hold up the rest for good
+        if (!mspBatchFull)
+            state->batchSent++;
+        state->batchNext++;
+    }
+    mspBatching = false;
+
+    if (state->batchNext == state->batchCount) {
+        state->cmdMSP = MSP_BATCH;
+        headSerialReply(1);
+        serialize8(state->batchSent);
+        tailSerialReply();
+        if (mspLastFrameLen)
+            state->batchPending = false;
+    }
+    state->cmdMSP = cmd;
+    state->mspVersion = version;
+}
+
 static void evaluateCommand(void)
 {
     uint32_t i, j, tmp, junk;
@@ -416,7 +642,7 @@ static void evaluateCommand(void)
         serialize32(CAP_PLATFORM_32BIT | CAP_BASEFLIGHT_CONFIG | CAP_DYNBALANCE | (mcfg.flaps_speed ? CAP_FLAPS : 0));        // "capability"
         break;
     case MSP_STATUS:
-        headSerialReply(11);
+        headSerialReply(13);
         serialize16(cycleTime);
         serialize16(i2cGetErrorCounter());
         serialize16(sensors(SENSOR_ACC) | sensors(SENSOR_BARO) << 1 | sensors(SENSOR_MAG) << 2 | sensors(SENSOR_GPS) << 3 | sensors(SENSOR_SONAR) << 4);
@@ -445,6 +671,7 @@ static void evaluateCommand(void)
         }
         serialize32(junk);
         serialize8(mcfg.current_profile);
+        serialize16(motorLatency);
         break;
     case MSP_RAW_IMU:
         headSerialReply(18);
@@ -742,6 +969,228 @@ static void evaluateCommand(void)
         serialize32(0); // future exp
         break;
 
+    case MSP_TASKS:
+        headSerialReply(1 + TASK_COUNT * 8);
+        serialize8(TASK_COUNT);
+        for (i = 0; i < TASK_COUNT; i++) {
+            serialize16(schedulerTaskRate(&tasks[i]));
+            serialize16(tasks[i].averageExecutionTime >> 4);
+            serialize16(min(tasks[i].maxExecutionTime, 0xFFFF));
+            serialize16(tasks[i].lateCount);
+        }
+        break;
+
+    case MSP_BUS_STATS:
+        {
+            i2cStats_t i2c;
+#ifndef CJMCU
+            spiStats_t spi;
+
+            spiGetStats(&spi);
+#endif
+            i2cGetStats(&i2c);
+            headSerialReply(27);
+            serialize32(i2c.transactions);
+            serialize16(i2cGetErrorCounter());
+            serialize16(i2c.busErrors);
+            serialize16(i2c.averageTime);
+            serialize8(i2c.queueDepth);
+            serialize8(i2c.maxQueueDepth);
+#ifndef CJMCU
+            serialize32(spi.transfers);
+            serialize32(spi.dmaTransfers);
+            serialize32(spi.bytes);
+            serialize16(spi.dmaRejected);
+            serialize8(spiDmaActive());
+#else
+            // no SPI bus
+            for (i = 0; i < 15; i++)
+                serialize8(0);
+#endif
+        }
+        break;
+    case MSP_SUBSCRIBE:
+        // u16 budget in bytes/s (0 = half the link) followed by (message, rate in Hz) pairs
+        currentPortState->subscriptionCount = 0;
+        currentPortState->subscriptionVersion = currentPortState->mspVersion;
+        currentPortState->bandwidth = currentPortState->dataSize >= 2 ? read16() : 0;
+        if (!currentPortState->bandwidth)
+            currentPortState->bandwidth = serialGetBaudRate(currentPortState->port) / 20;
+        currentPortState->budget = 0;
+        currentPortState->budgetUpdatedAt = micros();
+        for (i = 2; i + 1 < currentPortState->dataSize && currentPortState->subscriptionCount < MSP_MAX_SUBSCRIPTIONS; i += 2) {
+            j = read8();
+            tmp = read8();
+            if (tmp && mspSubscribable(j)) {
+                mspSubscription_t *sub = &currentPortState->subscriptions[currentPortState->subscriptionCount++];
+                sub->cmd = j;
+                sub->lastSize = 0;
+                sub->period = 1000000 / tmp;
+                sub->lastSentAt = currentPortState->budgetUpdatedAt;
+            }
+        }
+        headSerialReply(1);
+        serialize8(currentPortState->subscriptionCount);
+        break;
+    case MSP_BATCH:
+        // what doesn't fit in the TX buffer now goes out from serialCom() as it drains, a new list replaces
+        // one still being sent
+        currentPortState->batchCount = 0;
+        for (i = 0; i < currentPortState->dataSize && currentPortState->batchCount < MSP_BATCH_MAX; i++) {
+            j = currentPortState->inBuf[i];
+            if (mspListed(batchableMessages, sizeof(batchableMessages), j))
+                currentPortState->batch[currentPortState->batchCount++] = j;
+        }
+        currentPortState->batchNext = 0;
+        currentPortState->batchSent = 0;
+        currentPortState->batchVersion = currentPortState->mspVersion;
+        currentPortState->batchPending = true;
+        mspBatchResume();
+        break;
+    case MSP2_CONFIG_READ:
+        // chunks straight out of the live config, the host pieces them together by offset and asks for the next
+        // one at offset + chunk length. The chunk is cut to what fits in the TX ring right now next to the 9 bytes
+        // of v2 framing and the 4 byte header, an empty one means the port is busy and the host asks again
+        tmp = currentPortState->dataSize >= 2 ? read16() : 0;
+        junk = serialTxBytesFree(currentPortState->port);
+        junk = junk > 9 + 4 ? min(junk - 9 - 4, INBUF_SIZE - 4) : 0;
+        headSerialReply(0);
+        serialize16(sizeof(master_t));
+        serialize16(tmp);
+        for (i = tmp; i < sizeof(master_t) && i < tmp + junk; i++)
+            serialize8(((uint8_t *)&mcfg)[i]);
+        break;
+    case MSP2_CONFIG_WRITE:
+        tmp = read16();
+        j = currentPortState->dataSize - 2;
+        // only while disarmed, in order, and the first chunk must carry a header matching this firmware. No new
+        // upload while a save is still being written, it would be taking mcfg from under it
+        if (f.ARMED || currentPortState->dataSize < 2 || tmp + j > sizeof(master_t) || tmp != configWriteOffset ||
+            (tmp == 0 && (j < 5 || configStoreBusy() || currentPortState->inBuf[2] != mcfg.version || (currentPortState->inBuf[4] | currentPortState->inBuf[5] << 8) != sizeof(master_t) || currentPortState->inBuf[6] != 0xBE))) {
+            configWriteAbort();
+            headSerialError(0);
+            break;
+        }
+        for (i = 0; i < j; i++)
+            ((uint8_t *)&mcfg)[tmp + i] = read8();
+        configWriteOffset = tmp + j;
+        configWriteAt = millis();
+        if (configWriteOffset == sizeof(master_t)) {
+            configWriteOffset = 0;
+            writeEEPROM(0, false);
+        }
+        headSerialReply(2);
+        serialize16(configWriteOffset);
+        break;
+    case MSP_BOOT_TIME:
+        headSerialReply(2 + BOOT_PHASE_COUNT * 4);
+        serialize8(bootSensorCacheHit);
+        serialize8(BOOT_PHASE_COUNT);
+        for (i = 0; i < BOOT_PHASE_COUNT; i++)
+            serialize32(bootTime[i]);
+        break;
+    case MSP_FLASH_INFO:
+        {
+            blackboxStatus_t status;
+            blackboxGetStatus(&status);
+            headSerialReply(17);
+            serialize8(status.present | status.logging << 1 | status.erasing << 2 | status.streaming << 3);
+            serialize32(status.size);
+            serialize32(status.used);
+            serialize32(status.frames);
+            serialize32(status.dropped);
+        }
+        break;
+    case MSP_FLASH_ERASE:
+        if (!blackboxErase()) {
+            headSerialError(0);
+            break;
+        }
+        headSerialReply(0);
+        break;
+    case MSP_FLASH_READ:
+        {
+            uint8_t chunk[16], n;
+            tmp = read32();
+            j = currentPortState->dataSize >= 6 ? read16() : MSP_FLASH_READ_MAX;
+            j = min(j, MSP_FLASH_READ_MAX);
+            headSerialReply(0);
+            serialize32(tmp);
+            // comes back short (down to nothing) while logging, erasing or a page is being programmed
+            for (i = 0; i < j; i += n) {
+                n = min(j - i, sizeof(chunk));
+                if (!blackboxRead(tmp + i, chunk, n))
+                    break;
+                for (junk = 0; junk < n; junk++)
+                    serialize8(chunk[junk]);
+            }
+        }
+        break;
+    case MSP_CRASH_DUMP:
+        {
+            crashLogInfo_t info;
+            crashSample_t sample;
+            crashLogGetInfo(&info);
+            tmp = currentPortState->dataSize >= 1 ? read8() : 0;
+            headSerialReply(0);
+            serialize8(info.reason);
+            serialize8(info.count);
+            serialize8(tmp);
+            serialize16(info.crashes);
+            serialize32(info.frozenAt);
+            serialize32(info.faultPC);
+            serialize32(info.faultLR);
+            serialize32(info.faultCFSR);
+            serialize32(info.faultHFSR);
+            // oldest first, the host keeps asking from the next index until it has count samples
+            for (i = tmp; i < tmp + MSP_CRASH_SAMPLES_MAX && crashLogGetSample(i, &sample); i++) {
+                serialize16(sample.time);
+                serialize16(sample.angle[ROLL]);
+                serialize16(sample.angle[PITCH]);
+                serialize16(sample.heading);
+                for (j = 0; j < 3; j++)
+                    serialize16(sample.gyro[j]);
+                for (j = 0; j < CRASHLOG_CHANNELS; j++)
+                    serialize8(sample.rcData[j]);
+                for (j = 0; j < CRASHLOG_MOTORS; j++)
+                    serialize8(sample.motor[j]);
+                serialize16(sample.cycleTime);
+                serialize8(sample.i2cErrors);
+                serialize8(sample.failsafeCnt);
+                serialize8(sample.flags);
+            }
+        }
+        break;
+    case MSP_CRASH_CLEAR:
+        if (f.ARMED) {
+            headSerialError(0);
+            break;
+        }
+        crashLogClear();
+        headSerialReply(0);
+        break;
+    case MSP_GYRO_FIFO:
+        headSerialReply(8);
+        serialize8(mcfg.gyro_fifo);
+        serialize32(gyroFifoStats.overflowCount);
+        serialize16(gyroFifoStats.sampleRate);
+        serialize8(min(gyroFifoStats.samples, 0xFF));
+        break;
+
+#ifdef PROFILING
+    case MSP_PERF:
+        headSerialReply(1 + PERF_SECTION_COUNT * 16);
+        serialize8(PERF_SECTION_COUNT);
+        for (i = 0; i < PERF_SECTION_COUNT; i++) {
+            serialize32(perfSections[i].min);
+            serialize32(perfAverage(i));
+            serialize32(perfSections[i].max);
+            serialize32(perfSections[i].count);
+        }
+        perfReset();
+        break;
+#endif
+
     default:                   // we do not know how to handle the (valid) message, indicate error MSP $M!
         headSerialError(0);
         break;
@@ -754,8 +1203,10 @@ static void evaluateOtherData(uint8_t sr)
 {
     if (sr == '#')
         cliProcess();
-    else if (sr == mcfg.reboot_character)
+    else if (sr == mcfg.reboot_character) {
+        configStoreFlush();
         systemReset(true);      // reboot to bootloader
+    }
 }
 
 void serialCom(void)
@@ -763,17 +1214,27 @@ void serialCom(void)
     uint8_t c;
     int i;
 
+    // a host that went away half way through an upload
+    if (configWriteOffset && millis() - configWriteAt > MSP_CONFIG_WRITE_TIMEOUT)
+        configWriteAbort();
+
     for (i = 0; i < numTelemetryPorts; i++) {
         currentPortState = &ports[i];
 
+        // the port is streaming blackbox data until disarmed
+        if (blackboxOwnsPort(currentPortState->port))
+            continue;
+
         // in cli mode, all serial stuff goes to here. enter cli mode by sending #
         if (cliMode) {
             cliProcess();
             return;
         }
 
-        if (pendReboot)
+        if (pendReboot) {
+            configStoreFlush();
             systemReset(false); // noreturn
+        }
 
         while (serialTotalBytesWaiting(currentPortState->port)) {
             c = serialRead(currentPortState->port);
@@ -783,14 +1244,28 @@ void serialCom(void)
                 if (currentPortState->c_state == IDLE && !f.ARMED)
                     evaluateOtherData(c); // if not armed evaluate all other incoming serial data
             } else if (currentPortState->c_state == HEADER_START) {
-                currentPortState->c_state = (c == 'M') ? HEADER_M : IDLE;
+                currentPortState->c_state = (c == 'M') ? HEADER_M : (c == 'X') ? HEADER_X : IDLE;
             } else if (currentPortState->c_state == HEADER_M) {
                 currentPortState->c_state = (c == '<') ? HEADER_ARROW : IDLE;
-            } else if (currentPortState->c_state == HEADER_ARROW) {
-                if (c > INBUF_SIZE) {       // now we are expecting the payload size
-                    currentPortState->c_state = IDLE;
-                    continue;
+                currentPortState->mspVersion = 1;
+            } else if (currentPortState->c_state == HEADER_X) {
+                // MSP v2: flags, 16 bit command and 16 bit size follow, all covered by a crc8
+                currentPortState->c_state = (c == '<') ? HEADER_V2 : IDLE;
+                currentPortState->mspVersion = 2;
+                currentPortState->offset = 0;
+                currentPortState->checksum = 0;
+            } else if (currentPortState->c_state == HEADER_V2) {
+                mspChecksum(c);
+                currentPortState->inBuf[currentPortState->offset++] = c;
+                if (currentPortState->offset == 5) {
+                    currentPortState->cmdMSP = currentPortState->inBuf[1] | currentPortState->inBuf[2] << 8;
+                    currentPortState->dataSize = currentPortState->inBuf[3] | currentPortState->inBuf[4] << 8;
+                    currentPortState->offset = 0;
+                    currentPortState->indRX = 0;
+                    currentPortState->c_state = currentPortState->dataSize > INBUF_SIZE ? IDLE : HEADER_CMD;
                 }
+            } else if (currentPortState->c_state == HEADER_ARROW) {
+                // now we are expecting the payload size, any v1 size fits in inBuf
                 currentPortState->dataSize = c;
                 currentPortState->offset = 0;
                 currentPortState->checksum = 0;
@@ -802,14 +1277,19 @@ void serialCom(void)
                 currentPortState->checksum ^= c;
                 currentPortState->c_state = HEADER_CMD;
             } else if (currentPortState->c_state == HEADER_CMD && currentPortState->offset < currentPortState->dataSize) {
-                currentPortState->checksum ^= c;
+                mspChecksum(c);
                 currentPortState->inBuf[currentPortState->offset++] = c;
             } else if (currentPortState->c_state == HEADER_CMD && currentPortState->offset >= currentPortState->dataSize) {
                 if (currentPortState->checksum == c) {        // compare calculated and transferred checksum
+                    PERF_BEGIN(PERF_MSP);
                     evaluateCommand();      // we got a valid packet, evaluate it
+                    PERF_END(PERF_MSP);
                 }
                 currentPortState->c_state = IDLE;
             }
         }
+
+        mspBatchResume();
+        mspPushSubscriptions();
     }
 }
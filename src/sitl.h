@@ -0,0 +1,124 @@
+#pragma once
+
+// SITL build: stand-ins for the chip definitions (stm32f10x_conf.h, core_cm3.h) that the flight core and the
+// driver headers refer to. Only what is used outside the drv_*.c files is here, the drivers themselves are
+// replaced by drv_sitl.c, drv_sitl_uart.c and sitl_model.c
+
+typedef struct {
+    volatile uint32_t CRL;
+    volatile uint32_t CRH;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    volatile uint32_t BSRR;
+    volatile uint32_t BRR;
+    volatile uint32_t LCKR;
+} GPIO_TypeDef;
+
+typedef struct {
+    uint8_t index;
+} USART_TypeDef;
+
+typedef struct {
+    uint32_t unused;
+} TIM_TypeDef;
+
+typedef struct {
+    uint32_t unused;
+} DMA_Channel_TypeDef;
+
+typedef struct {
+    volatile uint32_t CFSR;
+    volatile uint32_t HFSR;
+} SCB_Type;
+
+typedef enum {
+    EXTI_Trigger_Rising = 0x08,
+    EXTI_Trigger_Falling = 0x0C,
+    EXTI_Trigger_Rising_Falling = 0x10
+} EXTITrigger_TypeDef;
+
+typedef enum {
+    FLASH_BUSY = 1,
+    FLASH_ERROR_PG,
+    FLASH_ERROR_WRP,
+    FLASH_COMPLETE,
+    FLASH_TIMEOUT
+} FLASH_Status;
+
+#define FLASH_FLAG_EOP          ((uint32_t)0x00000020)
+#define FLASH_FLAG_PGERR        ((uint32_t)0x00000004)
+#define FLASH_FLAG_WRPRTERR     ((uint32_t)0x00000010)
+
+#define GPIO_PortSourceGPIOA    ((uint8_t)0x00)
+#define GPIO_PortSourceGPIOB    ((uint8_t)0x01)
+#define GPIO_PortSourceGPIOC    ((uint8_t)0x02)
+#define GPIO_PinSource13        ((uint8_t)0x0D)
+
+extern GPIO_TypeDef sitlGpio[3];
+#define GPIOA                   (&sitlGpio[0])
+#define GPIOB                   (&sitlGpio[1])
+#define GPIOC                   (&sitlGpio[2])
+
+extern USART_TypeDef sitlUsart[3];
+#define USART1                  (&sitlUsart[0])
+#define USART2                  (&sitlUsart[1])
+#define USART3                  (&sitlUsart[2])
+
+extern SCB_Type sitlScb;
+#define SCB                     (&sitlScb)
+
+// nothing runs behind the main loop's back on the host
+#define __disable_irq()
+#define __enable_irq()
+
+extern uint32_t SystemCoreClock;
+
+void FLASH_Unlock(void);
+void FLASH_Lock(void);
+void FLASH_ClearFlag(uint32_t flags);
+FLASH_Status FLASH_ErasePage(uint32_t address);
+FLASH_Status FLASH_ProgramHalfWord(uint32_t address, uint16_t data);
+
+// drv_sitl.c
+#define SITL_POLL_US            1000        // sockets and the run time limit are checked this often
+
+void sitlInit(int argc, char *argv[]);
+uint64_t sitlTime(void);
+uint32_t sitlCycleCount(void);
+void sitlIdle(uint32_t until);
+
+// drv_sitl_flash.c
+void sitlFlashInit(const char *path, bool private);
+void sitlFlashSync(void);
+
+// drv_sitl_uart.c
+void sitlUartPoll(void);
+void sitlUartClose(void);
+void sitlUartSetBasePort(uint16_t port);
+
+// sitl_model.c
+void sitlModelInit(void);
+void sitlModelUpdate(uint64_t now);
+void sitlModelSetMotor(uint8_t index, uint16_t value);
+uint32_t sitlModelGyroReads(void);
+void sitlModelPrintState(void);
+
+// sitl_replay.c
+typedef enum {
+    SITL_REPLAY_GYRO = 0,
+    SITL_REPLAY_ACC,
+    SITL_REPLAY_MAG,
+    SITL_REPLAY_BARO,
+    SITL_REPLAY_RC,
+    SITL_REPLAY_COUNT
+} sitlReplayType_e;
+
+void sitlReplayOpen(const char *path);
+void sitlRecordOpen(const char *path);
+void sitlReplayClose(void);
+bool sitlReplayActive(void);
+bool sitlReplayFinished(void);
+bool sitlReplayGet(int type, int32_t *values);
+void sitlRecordPut(int type, const int32_t *values);
+void sitlRecordPutAt(uint64_t time, int type, const int32_t *values);
+void sitlReplayLoop(void);
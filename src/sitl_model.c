@@ -0,0 +1,422 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+
+// SITL airframe: a rigid body quad X and the simulated sensor chips sitting on it, detected by sensors.c as an
+// MPU6050, an MS5611 and a HMC5883L. The motors answer the PWM with a first order lag and a thrust that goes
+// with the square of the command. The ground is a floor at zero altitude that stops the craft level.
+//
+// Body axes are the ones the IMU works in: X forward, Y left, Z up, so a positive rate rolls right, pitches
+// the nose down and yaws left. The earth frame is X north, Y west, Z up. Everything is stepped at a fixed
+// MODEL_STEP_US of simulated time, sensor noise comes from a fixed seed, so a lockstep run repeats exactly.
+//
+// Every chip reading goes through sitl_replay.c: recorded with -R, or taken from the log instead of the
+// model with -r.
+
+#define MODEL_STEP_US           250
+#define MODEL_GRAVITY           9.80665f
+#define MODEL_MASS              1.0f        // kg
+#define MODEL_ARM               0.16f       // m, motor offset along X and Y from the center
+#define MODEL_IXX               0.008f      // kg m^2
+#define MODEL_IYY               0.008f
+#define MODEL_IZZ               0.014f
+#define MODEL_THRUST_MAX        9.80665f    // N per motor at full command, hovers at half command
+#define MODEL_MOTOR_TAU         0.03f       // s
+#define MODEL_YAW_TORQUE        0.015f      // Nm of reaction torque per N of thrust
+#define MODEL_DRAG              0.25f       // N per m/s
+#define MODEL_ROT_DRAG          0.002f      // Nm per rad/s
+#define MODEL_MOTORS            4
+
+#define MODEL_GYRO_LSB          (16.4f / 4) // per deg/s, as the MPU6050 driver hands it over
+#define MODEL_ACC_1G            (512 * 8)
+#define MODEL_MAG_LSB           660.0f      // per gauss, HMC5883L at 2.5Ga
+#define MODEL_GYRO_NOISE        2           // +- LSB
+#define MODEL_ACC_NOISE         8
+#define MODEL_BARO_NOISE        3           // +- Pa
+
+typedef struct modelMotor_t {
+    float x, y;                             // position
+    float yaw;                              // reaction torque direction
+} modelMotor_t;
+
+// same order as mixerQuadX: REAR_R, FRONT_R, REAR_L, FRONT_L
+static const modelMotor_t modelMotors[MODEL_MOTORS] = {
+    { -MODEL_ARM, -MODEL_ARM,  1.0f },
+    {  MODEL_ARM, -MODEL_ARM, -1.0f },
+    { -MODEL_ARM,  MODEL_ARM, -1.0f },
+    {  MODEL_ARM,  MODEL_ARM,  1.0f },
+};
+
+// earth field, pointing north and down
+static const float magField[3] = { 0.2f, 0.0f, -0.45f };
+
+static float position[3];                   // m, earth frame
+static float velocity[3];
+static float accel[3];
+static float q[4];                          // body to earth, w x y z
+static float rate[3];                       // rad/s, body frame
+static float motorCommand[MODEL_MOTORS];    // 0..1
+static float motorOutput[MODEL_MOTORS];
+static uint16_t motorPwm[MODEL_MOTORS];
+static uint64_t modelTime;
+static uint32_t noiseState = 0x12345678;
+static uint32_t gyroReads;
+
+static sensor_align_e gyroAlign = CW0_DEG;
+static sensor_align_e accAlign = CW0_DEG;
+static sensor_align_e magAlign = CW0_DEG;
+
+extern uint16_t acc_1G;
+
+static int16_t noise(int16_t amplitude)
+{
+    // xorshift32
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 17;
+    noiseState ^= noiseState << 5;
+    return (int16_t)(noiseState % (2 * amplitude + 1)) - amplitude;
+}
+
+// v in the earth frame, out in the body frame
+static void earthToBody(const float *v, float *out)
+{
+    float w = q[0], x = q[1], y = q[2], z = q[3];
+
+    out[0] = (1 - 2 * (y * y + z * z)) * v[0] + 2 * (x * y + w * z) * v[1] + 2 * (x * z - w * y) * v[2];
+    out[1] = 2 * (x * y - w * z) * v[0] + (1 - 2 * (x * x + z * z)) * v[1] + 2 * (y * z + w * x) * v[2];
+    out[2] = 2 * (x * z + w * y) * v[0] + 2 * (y * z - w * x) * v[1] + (1 - 2 * (x * x + y * y)) * v[2];
+}
+
+static void bodyToEarth(const float *v, float *out)
+{
+    float w = q[0], x = q[1], y = q[2], z = q[3];
+
+    out[0] = (1 - 2 * (y * y + z * z)) * v[0] + 2 * (x * y - w * z) * v[1] + 2 * (x * z + w * y) * v[2];
+    out[1] = 2 * (x * y + w * z) * v[0] + (1 - 2 * (x * x + z * z)) * v[1] + 2 * (y * z - w * x) * v[2];
+    out[2] = 2 * (x * z - w * y) * v[0] + 2 * (y * z + w * x) * v[1] + (1 - 2 * (x * x + y * y)) * v[2];
+}
+
+static void modelStep(float dt)
+{
+    float force[3] = { 0, 0, 0 };
+    float torque[3] = { 0, 0, 0 };
+    float earthForce[3];
+    float dq[4], norm, thrust, yaw;
+    int i;
+
+    for (i = 0; i < MODEL_MOTORS; i++) {
+        motorOutput[i] += (motorCommand[i] - motorOutput[i]) * dt / (MODEL_MOTOR_TAU + dt);
+        thrust = MODEL_THRUST_MAX * motorOutput[i] * motorOutput[i];
+        force[Z] += thrust;
+        torque[X] += modelMotors[i].y * thrust;
+        torque[Y] -= modelMotors[i].x * thrust;
+        torque[Z] += modelMotors[i].yaw * MODEL_YAW_TORQUE * thrust;
+    }
+
+    // rotation, with the gyroscopic term of the frame
+    torque[X] -= MODEL_ROT_DRAG * rate[X] + (MODEL_IZZ - MODEL_IYY) * rate[Y] * rate[Z];
+    torque[Y] -= MODEL_ROT_DRAG * rate[Y] + (MODEL_IXX - MODEL_IZZ) * rate[Z] * rate[X];
+    torque[Z] -= MODEL_ROT_DRAG * rate[Z] + (MODEL_IYY - MODEL_IXX) * rate[X] * rate[Y];
+    rate[X] += torque[X] / MODEL_IXX * dt;
+    rate[Y] += torque[Y] / MODEL_IYY * dt;
+    rate[Z] += torque[Z] / MODEL_IZZ * dt;
+
+    dq[0] = -q[1] * rate[X] - q[2] * rate[Y] - q[3] * rate[Z];
+    dq[1] = q[0] * rate[X] + q[2] * rate[Z] - q[3] * rate[Y];
+    dq[2] = q[0] * rate[Y] - q[1] * rate[Z] + q[3] * rate[X];
+    dq[3] = q[0] * rate[Z] + q[1] * rate[Y] - q[2] * rate[X];
+    norm = 0;
+    for (i = 0; i < 4; i++) {
+        q[i] += dq[i] * 0.5f * dt;
+        norm += q[i] * q[i];
+    }
+    norm = sqrtf(norm);
+    for (i = 0; i < 4; i++)
+        q[i] /= norm;
+
+    // translation
+    bodyToEarth(force, earthForce);
+    for (i = 0; i < 3; i++) {
+        accel[i] = (earthForce[i] - MODEL_DRAG * velocity[i]) / MODEL_MASS;
+        if (i == Z)
+            accel[i] -= MODEL_GRAVITY;
+        velocity[i] += accel[i] * dt;
+        position[i] += velocity[i] * dt;
+    }
+
+    // on the floor: stopped and level, keeping the heading
+    if (position[Z] <= 0 && velocity[Z] <= 0) {
+        yaw = atan2f(2 * (q[0] * q[3] + q[1] * q[2]), 1 - 2 * (q[2] * q[2] + q[3] * q[3]));
+        q[0] = cosf(yaw / 2);
+        q[1] = 0;
+        q[2] = 0;
+        q[3] = sinf(yaw / 2);
+        for (i = 0; i < 3; i++) {
+            velocity[i] = 0;
+            accel[i] = 0;
+            rate[i] = 0;
+        }
+        position[Z] = 0;
+    }
+}
+
+void sitlModelInit(void)
+{
+    memset(position, 0, sizeof(position));
+    memset(velocity, 0, sizeof(velocity));
+    memset(accel, 0, sizeof(accel));
+    memset(rate, 0, sizeof(rate));
+    q[0] = 1;
+    q[1] = q[2] = q[3] = 0;
+    modelTime = 0;
+}
+
+void sitlModelUpdate(uint64_t now)
+{
+    while (now - modelTime >= MODEL_STEP_US) {
+        modelStep(MODEL_STEP_US * 1e-6f);
+        modelTime += MODEL_STEP_US;
+    }
+}
+
+void sitlModelSetMotor(uint8_t index, uint16_t value)
+{
+    if (index >= MODEL_MOTORS || sitlReplayActive())
+        return;
+
+    // the old command applies up to now
+    sitlModelUpdate(sitlTime());
+    motorPwm[index] = value;
+    motorCommand[index] = constrain(value - 1000, 0, 1000) / 1000.0f;
+}
+
+uint32_t sitlModelGyroReads(void)
+{
+    return gyroReads;
+}
+
+void sitlModelPrintState(void)
+{
+    float roll, pitch, yaw, sinPitch;
+
+    sinPitch = 2 * (q[0] * q[2] - q[3] * q[1]);
+    roll = atan2f(2 * (q[0] * q[1] + q[2] * q[3]), 1 - 2 * (q[1] * q[1] + q[2] * q[2]));
+    pitch = asinf(sinPitch > 1 ? 1 : sinPitch < -1 ? -1 : sinPitch);
+    yaw = atan2f(2 * (q[0] * q[3] + q[1] * q[2]), 1 - 2 * (q[2] * q[2] + q[3] * q[3]));
+    if (yaw > 0)
+        yaw -= 2 * M_PI;
+
+    // same signs as angle[] and heading
+    fprintf(stderr, "sitl: altitude %.2fm, position %.2fm north %.2fm east, roll %.1f pitch %.1f heading %.1f, motors %d %d %d %d\n",
+        position[Z], position[X], -position[Y], roll / RAD, pitch / RAD, -yaw / RAD, motorPwm[0], motorPwm[1], motorPwm[2], motorPwm[3]);
+}
+
+// replay hands the logged reading over instead of the model's, zeros until the log has one
+static bool modelReplay(int type, int16_t *data)
+{
+    int32_t values[3];
+    int i;
+
+    if (!sitlReplayActive())
+        return false;
+    if (!sitlReplayGet(type, values))
+        memset(values, 0, sizeof(values));
+    for (i = 0; i < 3; i++)
+        data[i] = values[i];
+    return true;
+}
+
+static void modelRecord(int type, const int16_t *data)
+{
+    int32_t values[3];
+    int i;
+
+    for (i = 0; i < 3; i++)
+        values[i] = data[i];
+    sitlRecordPut(type, values);
+}
+
+// MPU6050
+
+static void modelGyroInit(sensor_align_e align)
+{
+    if (align > 0)
+        gyroAlign = align;
+}
+
+static void modelGyroRead(int16_t *gyroData)
+{
+    int16_t data[3];
+    int i;
+
+    gyroReads++;
+    if (modelReplay(SITL_REPLAY_GYRO, gyroData))
+        return;
+
+    sitlModelUpdate(sitlTime());
+    for (i = 0; i < 3; i++)
+        data[i] = constrain(lrintf(rate[i] / RAD * MODEL_GYRO_LSB), -8192, 8191) + noise(MODEL_GYRO_NOISE);
+    alignSensors(data, gyroData, gyroAlign);
+    modelRecord(SITL_REPLAY_GYRO, gyroData);
+}
+
+static void modelAccInit(sensor_align_e align)
+{
+    acc_1G = MODEL_ACC_1G;
+    if (align > 0)
+        accAlign = align;
+}
+
+static void modelAccRead(int16_t *accData)
+{
+    float specific[3], body[3];
+    int16_t data[3];
+    int i;
+
+    if (modelReplay(SITL_REPLAY_ACC, accData))
+        return;
+
+    sitlModelUpdate(sitlTime());
+    // what the accelerometer feels is the acceleration minus gravity
+    specific[X] = accel[X];
+    specific[Y] = accel[Y];
+    specific[Z] = accel[Z] + MODEL_GRAVITY;
+    earthToBody(specific, body);
+    for (i = 0; i < 3; i++)
+        data[i] = constrain(lrintf(body[i] / MODEL_GRAVITY * MODEL_ACC_1G), -32768, 32767) + noise(MODEL_ACC_NOISE);
+    alignSensors(data, accData, accAlign);
+    modelRecord(SITL_REPLAY_ACC, accData);
+}
+
+bool mpu6050Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf, bool fifo, uint8_t *scale)
+{
+    (void)lpf;
+    (void)fifo;
+
+    acc->init = modelAccInit;
+    acc->read = modelAccRead;
+    gyro->init = modelGyroInit;
+    gyro->read = modelGyroRead;
+    gyro->readAll = NULL;
+    gyro->temperature = NULL;
+    gyro->prefetch = NULL;
+    // 16.4 dps/lsb scalefactor, same as the real driver
+    gyro->scale = (4.0f / 16.4f) * (M_PI / 180.0f) * 0.000001f;
+    if (scale)
+        *scale = 0;
+    return true;
+}
+
+// MS5611
+
+static void modelBaroNothing(void)
+{
+}
+
+static void modelBaroCalculate(int32_t *pressure, int32_t *temperature)
+{
+    int32_t values[2] = { 101325, 2500 };
+
+    if (sitlReplayActive()) {
+        sitlReplayGet(SITL_REPLAY_BARO, values);
+    } else {
+        sitlModelUpdate(sitlTime());
+        // standard atmosphere
+        values[0] = lrintf(101325.0f * powf(1.0f - 2.25577e-5f * position[Z], 5.25588f)) + noise(MODEL_BARO_NOISE);
+        sitlRecordPut(SITL_REPLAY_BARO, values);
+    }
+    if (pressure)
+        *pressure = values[0];
+    if (temperature)
+        *temperature = values[1];
+}
+
+bool ms5611Detect(baro_t *baro)
+{
+    baro->ut_delay = 10000;
+    baro->up_delay = 10000;
+    baro->start_ut = modelBaroNothing;
+    baro->get_ut = modelBaroNothing;
+    baro->start_up = modelBaroNothing;
+    baro->get_up = modelBaroNothing;
+    baro->calculate = modelBaroCalculate;
+    return true;
+}
+
+// HMC5883L
+
+void hmc5883lInit(sensor_align_e align)
+{
+    if (align > 0)
+        magAlign = align;
+}
+
+void hmc5883lRead(int16_t *magData)
+{
+    float body[3];
+    int16_t data[3];
+    int i;
+
+    if (modelReplay(SITL_REPLAY_MAG, magData))
+        return;
+
+    sitlModelUpdate(sitlTime());
+    earthToBody(magField, body);
+    for (i = 0; i < 3; i++)
+        data[i] = lrintf(body[i] * MODEL_MAG_LSB);
+    alignSensors(data, magData, magAlign);
+    modelRecord(SITL_REPLAY_MAG, magData);
+}
+
+bool hmc5883lDetect(sensor_t *mag)
+{
+    mag->init = hmc5883lInit;
+    mag->read = hmc5883lRead;
+    return true;
+}
+
+// chips that aren't on the simulated board
+
+bool mpu6500Detect(sensor_t *acc, sensor_t *gyro, uint16_t lpf, bool fifo)
+{
+    (void)acc;
+    (void)gyro;
+    (void)lpf;
+    (void)fifo;
+    return false;
+}
+
+bool mpu3050Detect(sensor_t *gyro, uint16_t lpf)
+{
+    (void)gyro;
+    (void)lpf;
+    return false;
+}
+
+bool l3g4200dDetect(sensor_t *gyro, uint16_t lpf)
+{
+    (void)gyro;
+    (void)lpf;
+    return false;
+}
+
+bool adxl345Detect(drv_adxl345_config_t *init, sensor_t *acc)
+{
+    (void)init;
+    (void)acc;
+    return false;
+}
+
+bool bmp085Detect(baro_t *baro)
+{
+    (void)baro;
+    return false;
+}
+
+bool ak8975detect(sensor_t *mag)
+{
+    (void)mag;
+    return false;
+}
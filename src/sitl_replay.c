@@ -0,0 +1,190 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ */
+#include "board.h"
+#include "mw.h"
+
+// SITL sensor recording and replay. With -R the simulated chips log what they hand to sensors.c, with -r a log
+// is played back in their place and the model stays out of it: the unmodified flight core (IMU, altitude
+// estimator, RC shaping, PID and mixer) runs on the recorded data and every control loop prints what came
+// out of it. Replay always runs in lockstep, the same log gives the same output on any host.
+//
+// The log is text, one sample per line in time order, times in microseconds since power up:
+//   <us> G <x> <y> <z>                 gyro, as the driver hands it over (board axes, after sensor alignment)
+//   <us> A <x> <y> <z>                 accelerometer, same
+//   <us> M <x> <y> <z>                 magnetometer, same
+//   <us> B <pressure> <temperature>    baro, Pa and 0.01 degC
+//   <us> R <roll> <pitch> <yaw> <throttle> <aux1> <aux2> <aux3> <aux4>    rcData, us
+// Lines starting with # are comments. A read returns the last sample at or before the simulated time, like
+// a chip register holds the last conversion. The config comes from the flash file (-f) as usual.
+//
+// A real flight is replayed from its blackbox log, with blackbox_raw set the board logs the raw readings and
+// their sample times too. support/blackbox/blackbox_decode -r turns a session of it into a log for this.
+//
+// Replay output, one line per control loop, written to stdout:
+//   <us> <roll angle> <pitch angle> <heading> <EstAlt> <vario> <motor>...
+
+#define REPLAY_MAX_VALUES       8
+#define REPLAY_LINE_SIZE        128
+
+typedef struct replaySample_t {
+    bool valid;
+    int32_t values[REPLAY_MAX_VALUES];
+} replaySample_t;
+
+static const char replayTypes[SITL_REPLAY_COUNT] = { 'G', 'A', 'M', 'B', 'R' };
+static const uint8_t replayCounts[SITL_REPLAY_COUNT] = { 3, 3, 3, 2, 8 };
+
+static FILE *replayFile;
+static FILE *recordFile;
+static replaySample_t held[SITL_REPLAY_COUNT];
+static replaySample_t next;                 // read ahead, applied once the clock gets there
+static int nextType = -1;
+static uint64_t nextTime;
+static uint32_t lineNumber;
+static bool finished = false;
+static uint64_t lastLoopTime;
+static int16_t lastRcData[REPLAY_MAX_VALUES];
+static uint32_t outputLines;
+
+static void replayReadNext(void)
+{
+    char line[REPLAY_LINE_SIZE];
+    char *p, *end;
+    int type, i;
+
+    nextType = -1;
+    while (fgets(line, sizeof(line), replayFile)) {
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+            continue;
+
+        nextTime = strtoull(line, &p, 10);
+        while (*p == ' ' || *p == '\t')
+            p++;
+        for (type = 0; type < SITL_REPLAY_COUNT; type++) {
+            if (*p == replayTypes[type])
+                break;
+        }
+        if (p == line || type == SITL_REPLAY_COUNT) {
+            fprintf(stderr, "sitl: replay line %u: unknown sample\n", lineNumber);
+            continue;
+        }
+        p++;
+        for (i = 0; i < replayCounts[type]; i++) {
+            next.values[i] = strtol(p, &end, 10);
+            if (end == p)
+                break;
+            p = end;
+        }
+        if (i < replayCounts[type]) {
+            fprintf(stderr, "sitl: replay line %u: %c needs %d values\n", lineNumber, replayTypes[type], replayCounts[type]);
+            continue;
+        }
+        nextType = type;
+        return;
+    }
+    finished = true;
+}
+
+void sitlReplayOpen(const char *path)
+{
+    replayFile = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (!replayFile) {
+        perror(path);
+        exit(1);
+    }
+    replayReadNext();
+}
+
+void sitlRecordOpen(const char *path)
+{
+    recordFile = fopen(path, "w");
+    if (!recordFile) {
+        perror(path);
+        exit(1);
+    }
+    fprintf(recordFile, "# baseflight SITL sensor log\n");
+}
+
+void sitlReplayClose(void)
+{
+    if (recordFile)
+        fclose(recordFile);
+    if (replayFile) {
+        fflush(stdout);
+        fprintf(stderr, "sitl: replayed %u lines, %u loops\n", lineNumber, outputLines);
+    }
+    recordFile = replayFile = NULL;
+}
+
+bool sitlReplayActive(void)
+{
+    return replayFile != NULL;
+}
+
+bool sitlReplayFinished(void)
+{
+    return replayFile && finished;
+}
+
+bool sitlReplayGet(int type, int32_t *values)
+{
+    uint64_t now = sitlTime();
+
+    while (nextType >= 0 && nextTime <= now) {
+        held[nextType] = next;
+        held[nextType].valid = true;
+        replayReadNext();
+    }
+    if (!held[type].valid)
+        return false;
+    memcpy(values, held[type].values, replayCounts[type] * sizeof(int32_t));
+    return true;
+}
+
+void sitlRecordPut(int type, const int32_t *values)
+{
+    sitlRecordPutAt(sitlTime(), type, values);
+}
+
+void sitlRecordPutAt(uint64_t time, int type, const int32_t *values)
+{
+    int i;
+
+    if (!recordFile)
+        return;
+    fprintf(recordFile, "%llu %c", (unsigned long long)time, replayTypes[type]);
+    for (i = 0; i < replayCounts[type]; i++)
+        fprintf(recordFile, " %d", values[i]);
+    fputc('\n', recordFile);
+}
+
+// end of a control loop, the motors have just been written
+void sitlReplayLoop(void)
+{
+    int32_t rc[REPLAY_MAX_VALUES];
+    uint64_t now = sitlTime();
+    int i, count;
+
+    if (recordFile && memcmp(lastRcData, rcData, sizeof(lastRcData))) {
+        // rcData changed somewhere in this loop, after the last one ended. Stamped just after that so a
+        // replay with the same timing hands it to the same computeRC()
+        memcpy(lastRcData, rcData, sizeof(lastRcData));
+        for (i = 0; i < REPLAY_MAX_VALUES; i++)
+            rc[i] = rcData[i];
+        sitlRecordPutAt(lastLoopTime + 1, SITL_REPLAY_RC, rc);
+    }
+    lastLoopTime = now;
+
+    if (replayFile) {
+        count = mixerMotorCount();
+        // fprintf, printf is the firmware's own
+        fprintf(stdout, "%llu %d %d %d %d %d", (unsigned long long)now, angle[ROLL], angle[PITCH], heading, EstAlt, vario);
+        for (i = 0; i < count; i++)
+            fprintf(stdout, " %d", motor[i]);
+        fputc('\n', stdout);
+        outputLines++;
+    }
+}
@@ -11,7 +11,7 @@ static bool rcFrameComplete = false;
 static bool spekHiRes = false;
 static bool spekDataIncoming = false;
 volatile uint8_t spekFrame[SPEK_FRAME_SIZE];
-static void spektrumDataReceive(uint16_t c);
+static void spektrumDataReceive(const uint8_t *data, uint16_t len);
 static uint16_t spektrumReadRawRC(uint8_t chan);
 
 // external vars (ugh)
@@ -40,26 +40,20 @@ void spektrumInit(rcReadRawDataPtr *callback)
     core.numRCChannels = SPEK_MAX_CHANNEL;
 }
 
-// Receive ISR callback
-static void spektrumDataReceive(uint16_t c)
+// Receive ISR callback, called with whatever arrived before the line went idle
+static void spektrumDataReceive(const uint8_t *data, uint16_t len)
 {
-    uint32_t spekTime;
-    static uint32_t spekTimeLast, spekTimeInterval;
-    static uint8_t spekFramePosition;
+    uint8_t b;
 
     spekDataIncoming = true;
-    spekTime = micros();
-    spekTimeInterval = spekTime - spekTimeLast;
-    spekTimeLast = spekTime;
-    if (spekTimeInterval > 5000)
-        spekFramePosition = 0;
-    spekFrame[spekFramePosition] = (uint8_t)c;
-    if (spekFramePosition == SPEK_FRAME_SIZE - 1) {
-        rcFrameComplete = true;
-        failsafeCnt = 0;   // clear FailSafe counter
-    } else {
-        spekFramePosition++;
-    }
+    // keep the last whole frame if several came in back to back, drop partial ones
+    if (len < SPEK_FRAME_SIZE)
+        return;
+    data += len - SPEK_FRAME_SIZE;
+    for (b = 0; b < SPEK_FRAME_SIZE; b++)
+        spekFrame[b] = data[b];
+    rcFrameComplete = true;
+    failsafeCnt = 0;   // clear FailSafe counter
 }
 
 bool spektrumFrameComplete(void)
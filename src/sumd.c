@@ -8,7 +8,7 @@
 #define SUMD_BUFFSIZE (SUMD_MAX_CHANNEL * 2 + 5) // 6 channels + 5 -> 17 bytes for 6 channels
 
 static bool sumdFrameDone = false;
-static void sumdDataReceive(uint16_t c);
+static void sumdDataReceive(const uint8_t *data, uint16_t len);
 static uint16_t sumdReadRawRC(uint8_t chan);
 
 static uint32_t sumdChannelData[SUMD_MAX_CHANNEL];
@@ -23,33 +23,16 @@ void sumdInit(rcReadRawDataPtr *callback)
 static uint8_t sumd[SUMD_BUFFSIZE] = { 0, };
 static uint8_t sumdSize;
 
-// Receive ISR callback
-static void sumdDataReceive(uint16_t c)
+// Receive ISR callback, called with whatever arrived before the line went idle
+static void sumdDataReceive(const uint8_t *data, uint16_t len)
 {
-    uint32_t sumdTime;
-    static uint32_t sumdTimeLast;
-    static uint8_t sumdIndex;
+    // sync, status, channel count, 2 bytes per channel and a 2 byte crc
+    if (len < 5 || data[0] != SUMD_SYNCBYTE || len != data[2] * 2 + 5)
+        return;
 
-    sumdTime = micros();
-    if ((sumdTime - sumdTimeLast) > 4000)
-        sumdIndex = 0;
-    sumdTimeLast = sumdTime;
-
-    if (sumdIndex == 0) {
-        if (c != SUMD_SYNCBYTE)
-            return;
-        else
-            sumdFrameDone = false; // lazy main loop didnt fetch the stuff
-    }
-    if (sumdIndex == 2)
-        sumdSize = (uint8_t)c;
-    if (sumdIndex < SUMD_BUFFSIZE)
-        sumd[sumdIndex] = (uint8_t)c;
-    sumdIndex++;
-    if (sumdIndex == sumdSize * 2 + 5) {
-        sumdIndex = 0;
-        sumdFrameDone = true;
-    }
+    sumdSize = data[2];
+    memcpy(sumd, data, min(len, SUMD_BUFFSIZE));
+    sumdFrameDone = true;
 }
 
 bool sumdFrameComplete(void)
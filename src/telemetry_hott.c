@@ -52,9 +52,17 @@ const uint8_t kHoTTv4TextPacketSize = 173;
 static HoTTV4GPSModule_t HoTTV4GPSModule;
 static HoTTV4ElectricAirModule_t HoTTV4ElectricAirModule;
 
+// response in progress, sent one byte per call once HOTTV4_TX_DELAY has passed
+static uint8_t *hottMsg = NULL;
+static uint8_t hottMsgRemaining;
+static uint16_t hottMsgCrc;
+static uint8_t hottRequest;
+static uint32_t lastHoTTEventAt;
+
 static void hottV4SerialWrite(uint8_t c);
 
 static void hottV4Respond(uint8_t *data, uint8_t size);
+static void hottV4SendNextByte(void);
 static void hottV4FormatAndSendGPSResponse(void);
 static void hottV4GPSUpdate(void);
 static void hottV4FormatAndSendEAMResponse(void);
@@ -219,22 +227,31 @@ static void hottV4Respond(uint8_t *data, uint8_t size)
 {
     serialSetMode(core.telemport, MODE_TX);
 
-    uint16_t crc = 0;
-    uint8_t i;
+    // the last byte of the frame is replaced by the checksum
+    hottMsg = data;
+    hottMsgRemaining = size;
+    hottMsgCrc = 0;
+    hottV4SendNextByte();
+}
 
-    for (i = 0; i < size - 1; i++) {
-        crc += data[i];
-        hottV4SerialWrite(data[i]);
+static void hottV4SendNextByte(void)
+{
+    lastHoTTEventAt = micros();
 
-        // Protocol specific delay between each transmitted byte
-        delayMicroseconds(HOTTV4_TX_DELAY);
+    if (hottMsgRemaining == 0) {
+        // Protocol specific delay after the checksum has passed, switch back to listening
+        hottMsg = NULL;
+        serialSetMode(core.telemport, MODE_RX);
+        return;
     }
 
-    hottV4SerialWrite(crc & 0xFF);
-
-    delayMicroseconds(HOTTV4_TX_DELAY);
+    if (--hottMsgRemaining == 0) {
+        hottV4SerialWrite(hottMsgCrc & 0xFF);
+        return;
+    }
 
-    serialSetMode(core.telemport, MODE_RX);
+    hottMsgCrc += *hottMsg;
+    hottV4SerialWrite(*hottMsg++);
 }
 
 static void hottV4SerialWrite(uint8_t c)
@@ -250,28 +267,51 @@ void configureHoTTTelemetryPort(void)
 
 void freeHoTTTelemetryPort(void)
 {
+    // drop any half sent response
+    hottMsg = NULL;
+    hottRequest = 0;
     serialSetMode(core.telemport, MODE_RXTX);
 }
 
+// Called from the telemetry task, never waits. Each call sends at most one byte of a response once the protocol
+// specific delay has passed, or answers a pending request once the receiver has had time to release the line.
 void handleHoTTTelemetry(void)
 {
+    uint32_t now = micros();
     uint8_t c;
 
-    while (serialTotalBytesWaiting(core.telemport) > 0) {
-        c = serialRead(core.telemport);
+    if (hottMsg) {
+        // Protocol specific delay between each transmitted byte
+        if (now - lastHoTTEventAt >= HOTTV4_TX_DELAY)
+            hottV4SendNextByte();
+        return;
+    }
 
+    if (hottRequest) {
         // Protocol specific waiting time to avoid collisions
-        delay(5);
+        if (now - lastHoTTEventAt < HOTTV4_RX_DELAY)
+            return;
 
-        switch (c) {
-        case 0x8A:
-                if (sensors(SENSOR_GPS))
-                    hottV4FormatAndSendGPSResponse();
+        switch (hottRequest) {
+        case HOTTV4_GPS_SENSOR_ID:
+            if (sensors(SENSOR_GPS))
+                hottV4FormatAndSendGPSResponse();
             break;
-        case 0x8E:
+        case HOTTV4_ELECTRICAL_AIR_SENSOR_ID:
             hottV4FormatAndSendEAMResponse();
             break;
         }
+        hottRequest = 0;
+        return;
+    }
+
+    while (serialTotalBytesWaiting(core.telemport) > 0) {
+        c = serialRead(core.telemport);
+        if (c == HOTTV4_GPS_SENSOR_ID || c == HOTTV4_ELECTRICAL_AIR_SENSOR_ID) {
+            hottRequest = c;
+            lastHoTTEventAt = now;
+            break;
+        }
     }
 }
 
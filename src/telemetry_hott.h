@@ -19,7 +19,8 @@
 #define HOTTV4_GPS_SENSOR_TEXT_ID             0xA0 // GPS Module ID
 
 #define HOTTV4_RXTX 4
-#define HOTTV4_TX_DELAY 1000
+#define HOTTV4_TX_DELAY 1000    // us between response bytes
+#define HOTTV4_RX_DELAY 5000    // us from a request to the start of the response
 
 #define HOTTV4_BUTTON_DEC    0xEB
 #define HOTTV4_BUTTON_INC    0xED
@@ -0,0 +1,749 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ *
+ * Converts a blackbox log (see src/blackbox.c for the format) to CSV on stdout. The log is either a raw
+ * dump of the flash, or downloaded from the board with MSP_FLASH_INFO/MSP_FLASH_READ when a port is given.
+ * With -s it is a capture of the serial stream instead, from a file or recorded from the port until ^C.
+ *
+ * With -r a session logged with blackbox_raw set is written out as a SITL sensor log instead, see
+ * src/sitl_replay.c, so a real flight can be replayed with baseflight_SITL -r. The flight is moved to start
+ * REPLAY_START_US after power up. Before that the first readings are held for the calibrations at boot, and
+ * the sticks arm the board: yaw right with the throttle low, and the logged aux channels for an ARM box. Give
+ * the replay a flash file with the board's config (-f), the accelerometer trims and arming setup come from it.
+ * Logged every loop (blackbox_rate 1) the samples land on the loops that read them.
+ *
+ *   blackbox_decode [-s] [-p port] [-b baud] [-o raw.bin] [-r session] [log.bin]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/select.h>
+
+#define DEFAULT_BAUD        115200
+#define PAGE_SIZE           256
+#define ERASED_CHECK        8
+#define MAX_FIELDS          64
+#define FIXED_FIELDS        17
+#define RAW_FIELDS          22
+#define FIELDS_RAW          (1 << 0)
+
+#define REPLAY_START_US     10000000    // where the logged flight starts in the replay
+#define REPLAY_ARM_US       1500000     // arming sticks until this long before it
+#define REPLAY_CENTER_US    500000      // then centered sticks
+#define REPLAY_LINES        5           // R, M, B, G, A, written per frame
+#define REPLAY_GYRO_FRAMES  32          // averaged for the gyro calibration at boot
+
+#define MSP_FLASH_INFO      77
+#define MSP_FLASH_READ      79
+#define MSP_FLASH_READ_MAX  240
+#define MSP_TIMEOUT_US      500000
+#define MSP_RETRIES         100
+
+#define STREAM_SYNC1        0xA5
+#define STREAM_SYNC2        0x5A
+#define STREAM_HEAD         4
+
+static const uint8_t *logData;
+static size_t logSize;
+static size_t logPos;
+
+static int readUnsigned(uint32_t *value)
+{
+    int shift = 0;
+    uint8_t b;
+
+    *value = 0;
+    do {
+        if (logPos >= logSize || shift > 28)
+            return 0;
+        b = logData[logPos++];
+        *value |= (uint32_t)(b & 0x7F) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return 1;
+}
+
+static int readSigned(int32_t *value)
+{
+    uint32_t zigzag;
+
+    if (!readUnsigned(&zigzag))
+        return 0;
+    *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+    return 1;
+}
+
+static uint32_t fieldCount, motorCount, rate = 1, looptime, fieldSets, iteration;
+static int32_t values[MAX_FIELDS];
+static int session, valid, frames, skipped, printedLayout = -1;
+
+typedef struct replayLine_t {
+    uint64_t time;
+    char type;
+    const int32_t *values;
+    int count;
+} replayLine_t;
+
+static int replaySession;               // -r, written out as a SITL sensor log instead of CSV
+static int replayStarted;
+static uint64_t replayGyroAt, replayLast;
+static uint32_t replayGyroRaw, replayMagAt, replayBaroAt;
+static int32_t replayRc[8];
+static int32_t replayPending[REPLAY_GYRO_FRAMES][RAW_FIELDS];
+static int replayPendingCount;
+
+static void printHeader(void)
+{
+    uint32_t i;
+
+    // only when the column layout changes, the session column tells flights apart
+    if ((int)(motorCount | fieldSets << 8) == printedLayout)
+        return;
+    printedLayout = motorCount | fieldSets << 8;
+
+    printf("session,loopIteration,gyroADC[0],gyroADC[1],gyroADC[2],accSmooth[0],accSmooth[1],accSmooth[2],"
+           "rcCommand[0],rcCommand[1],rcCommand[2],rcCommand[3],axisPID[0],axisPID[1],axisPID[2]");
+    for (i = 0; i < motorCount; i++)
+        printf(",motor[%u]", i);
+    printf(",angle[0],angle[1],vbat,cycleTime");
+    if (fieldSets & FIELDS_RAW) {
+        printf(",gyroAt,gyroRaw[0],gyroRaw[1],gyroRaw[2],accRaw[0],accRaw[1],accRaw[2],magAt,magRaw[0],magRaw[1],"
+               "magRaw[2],baroAt,baroPressure,baroTemperature");
+        for (i = 0; i < 8; i++)
+            printf(",rcData[%u]", i);
+    }
+    printf("\n");
+}
+
+// the replay reads the log in time order, a line can't go before the one written last
+static void replayPrint(uint64_t time, char type, const int32_t *data, int count)
+{
+    int i;
+
+    if (time < replayLast)
+        time = replayLast;
+    replayLast = time;
+    printf("%llu %c", (unsigned long long)time, type);
+    for (i = 0; i < count; i++)
+        printf(" %d", data[i]);
+    printf("\n");
+}
+
+static void replayAdd(replayLine_t *lines, int *count, uint64_t time, char type, const int32_t *data, int n)
+{
+    int i = (*count)++;
+
+    // few lines, insertion sort by time
+    while (i > 0 && lines[i - 1].time > time) {
+        lines[i] = lines[i - 1];
+        i--;
+    }
+    lines[i].time = time;
+    lines[i].type = type;
+    lines[i].values = data;
+    lines[i].count = n;
+}
+
+// one frame of the raw field set, gyroAt gyro[3] acc[3] magAt mag[3] baroAt baro[2] rcData[8]
+static void replayWrite(const int32_t *raw, int first)
+{
+    replayLine_t lines[REPLAY_LINES];
+    uint32_t gyroAt = raw[0], magAt = raw[7], baroAt = raw[11];
+    int i, count = 0;
+
+    if (first) {
+        replayGyroAt = REPLAY_START_US;
+        replayMagAt = magAt;
+        replayBaroAt = baroAt;
+    } else {
+        replayGyroAt += (uint32_t)(gyroAt - replayGyroRaw);
+    }
+    replayGyroRaw = gyroAt;
+
+    // rcData changed at the start of this frame's loop, before the gyro was read
+    if (first || memcmp(replayRc, raw + 14, sizeof(replayRc))) {
+        memcpy(replayRc, raw + 14, sizeof(replayRc));
+        replayAdd(lines, &count, replayGyroAt - 1, 'R', replayRc, 8);
+    }
+    if (magAt != replayMagAt) {
+        replayMagAt = magAt;
+        replayAdd(lines, &count, replayGyroAt + (int32_t)(magAt - gyroAt), 'M', raw + 8, 3);
+    }
+    if (baroAt != replayBaroAt) {
+        replayBaroAt = baroAt;
+        replayAdd(lines, &count, replayGyroAt + (int32_t)(baroAt - gyroAt), 'B', raw + 12, 2);
+    }
+    replayAdd(lines, &count, replayGyroAt, 'G', raw + 1, 3);
+    replayAdd(lines, &count, replayGyroAt, 'A', raw + 4, 3);
+
+    for (i = 0; i < count; i++)
+        replayPrint(lines[i].time, lines[i].type, lines[i].values, lines[i].count);
+}
+
+// The board from power up on as it sat at the start of the flight, then the sticks that arm it. The gyro and
+// baro calibrations at boot get the average of the first frames, the board is still on the ground right after arming.
+static void replayBegin(void)
+{
+    static const int32_t idle[8] = { 1500, 1500, 1500, 1000, 1000, 1000, 1000, 1000 };
+    const int32_t *raw = replayPending[0];
+    int32_t gyro[3] = { 0, 0, 0 }, baro[2] = { 0, 0 }, sticks[8];
+    int i, axis;
+
+    for (i = 0; i < replayPendingCount; i++) {
+        for (axis = 0; axis < 3; axis++)
+            gyro[axis] += replayPending[i][1 + axis];
+        for (axis = 0; axis < 2; axis++)
+            baro[axis] += replayPending[i][12 + axis];
+    }
+    for (axis = 0; axis < 3; axis++)
+        gyro[axis] /= replayPendingCount;
+    for (axis = 0; axis < 2; axis++)
+        baro[axis] /= replayPendingCount;
+
+    replayPrint(0, 'G', gyro, 3);
+    replayPrint(0, 'A', raw + 4, 3);
+    replayPrint(0, 'M', raw + 8, 3);
+    replayPrint(0, 'B', baro, 2);
+    replayPrint(0, 'R', idle, 8);
+    memcpy(sticks, idle, sizeof(sticks));
+    for (i = 4; i < 8; i++)
+        sticks[i] = raw[14 + i];
+    sticks[2] = 2000;
+    replayPrint(REPLAY_START_US - REPLAY_ARM_US, 'R', sticks, 8);
+    sticks[2] = 1500;
+    replayPrint(REPLAY_START_US - REPLAY_CENTER_US, 'R', sticks, 8);
+    if (rate != 1)
+        fprintf(stderr, "logged every %u loops, the replay holds each sample that long\n", rate);
+
+    replayStarted = 1;
+    for (i = 0; i < replayPendingCount; i++)
+        replayWrite(replayPending[i], i == 0);
+}
+
+static void replayFrame(const int32_t *raw)
+{
+    if (replayStarted) {
+        replayWrite(raw, 0);
+        return;
+    }
+    // held back until there are enough for the gyro calibration
+    memcpy(replayPending[replayPendingCount++], raw, sizeof(replayPending[0]));
+    if (replayPendingCount == REPLAY_GYRO_FRAMES)
+        replayBegin();
+}
+
+// returns 1 when a header was read, 0 when the log ends in it, -1 when it can't be decoded
+static int decodeHeader(void)
+{
+    uint32_t version, fields, motors, frameRate, loop, sets = 0;
+
+    if (!readUnsigned(&version) || !readUnsigned(&fields) || !readUnsigned(&motors) ||
+        !readUnsigned(&frameRate) || !readUnsigned(&loop))
+        return 0;
+    // version 1 has no optional field sets
+    if (version == 2 && !readUnsigned(&sets))
+        return 0;
+    if (version < 1 || version > 2 || fields > MAX_FIELDS || frameRate == 0 ||
+        fields != FIXED_FIELDS + motors + (sets & FIELDS_RAW ? RAW_FIELDS : 0)) {
+        fprintf(stderr, "unsupported header, version %u fields %u\n", version, fields);
+        return -1;
+    }
+    if (fields != fieldCount || motors != motorCount || frameRate != rate || loop != looptime || sets != fieldSets)
+        fprintf(stderr, "%u fields%s, %u motors, every %u loops at %uus\n", fields, sets & FIELDS_RAW ? " with the raw set" : "",
+                motors, frameRate, loop);
+    fieldCount = fields;
+    motorCount = motors;
+    rate = frameRate;
+    looptime = loop;
+    fieldSets = sets;
+    return 1;
+}
+
+// returns 0 when the log ends in the middle of the frame
+static int decodeFrame(uint8_t marker, int newSessionOnRestart)
+{
+    uint32_t i, frameIteration = iteration;
+    int32_t value;
+
+    if (!fieldCount) {
+        skipped++;
+        return 1;
+    }
+    if (marker == 'I' && !readUnsigned(&frameIteration))
+        return 0;
+    for (i = 0; i < fieldCount; i++) {
+        if (!readSigned(&value))
+            return 0;
+        values[i] = marker == 'I' ? value : (int32_t)((uint32_t)values[i] + value);     // the sample times wrap
+    }
+
+    if (marker == 'I') {
+        // a stream doesn't mark sessions, the loop counter starting over does
+        if (newSessionOnRestart && (session == 0 || frameIteration < iteration))
+            session++;
+        iteration = frameIteration;
+        valid = 1;
+    } else {
+        iteration += rate;
+        if (!valid) {
+            skipped++;
+            return 1;
+        }
+    }
+
+    frames++;
+    if (replaySession) {
+        if (session == replaySession && (fieldSets & FIELDS_RAW))
+            replayFrame(values + FIXED_FIELDS + motorCount);
+        return 1;
+    }
+
+    printHeader();
+    printf("%d,%u", session, iteration);
+    for (i = 0; i < fieldCount; i++)
+        printf(",%d", values[i]);
+    printf("\n");
+    return 1;
+}
+
+static int pageErased(size_t pos)
+{
+    size_t i;
+
+    for (i = 0; i < ERASED_CHECK && pos + i < logSize; i++)
+        if (logData[pos + i] != 0xFF)
+            return 0;
+    return 1;
+}
+
+// raw flash dump, sessions back to back with page padding in between
+static void decodeFlash(void)
+{
+    uint8_t marker;
+    int result;
+
+    logPos = 0;
+    while (logPos < logSize) {
+        if (logPos % PAGE_SIZE == 0 && pageErased(logPos))
+            break;
+
+        marker = logData[logPos++];
+        switch (marker) {
+        case 0xFF:
+            // end of a session, the next one starts on a new page
+            logPos = (logPos + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+            valid = 0;
+            break;
+
+        case 'H':
+            result = decodeHeader();
+            if (result < 0)
+                return;
+            if (!result)
+                goto truncated;
+            session++;
+            valid = 0;
+            break;
+
+        case 'I':
+        case 'P':
+            if (!decodeFrame(marker, 0))
+                goto truncated;
+            break;
+
+        default:
+            // corrupt byte, resync on the next keyframe
+            valid = 0;
+            skipped++;
+            break;
+        }
+    }
+
+    fprintf(stderr, "%d sessions, %d frames, %d skipped\n", session, frames, skipped);
+    return;
+
+truncated:
+    fprintf(stderr, "log ends in the middle of a frame at %zu, %d sessions, %d frames\n", logPos, session, frames);
+}
+
+// serial capture, packets of 0xA5 0x5A sequence length payload checksum
+static void decodeStream(void)
+{
+    const uint8_t *stream = logData;
+    size_t streamSize = logSize, pos = 0;
+    uint8_t checksum, expected = 0, marker;
+    int synced = 0, gaps = 0, lost = 0, bad = 0;
+    uint32_t i, len;
+
+    while (pos + STREAM_HEAD + 1 <= streamSize) {
+        if (stream[pos] != STREAM_SYNC1 || stream[pos + 1] != STREAM_SYNC2) {
+            pos++;
+            continue;
+        }
+        len = stream[pos + 3];
+        if (pos + STREAM_HEAD + len + 1 > streamSize)
+            break;
+        checksum = stream[pos + 2] ^ stream[pos + 3];
+        for (i = 0; i < len; i++)
+            checksum ^= stream[pos + STREAM_HEAD + i];
+        if (checksum != stream[pos + STREAM_HEAD + len]) {
+            // not a packet after all, or a damaged one, look for the next sync
+            bad++;
+            pos++;
+            continue;
+        }
+
+        // frames dropped on the board or lost on the wire, the deltas that follow are useless until the next keyframe
+        if (synced && stream[pos + 2] != expected) {
+            gaps++;
+            lost += (uint8_t)(stream[pos + 2] - expected);
+            valid = 0;
+        }
+        expected = stream[pos + 2] + 1;
+        synced = 1;
+
+        logData = stream + pos + STREAM_HEAD;
+        logSize = len;
+        logPos = 0;
+        while (logPos < logSize) {
+            marker = logData[logPos++];
+            if (marker == 'H') {
+                if (decodeHeader() <= 0)
+                    break;
+            } else if (marker == 'I' || marker == 'P') {
+                if (!decodeFrame(marker, 1))
+                    break;
+            } else {
+                valid = 0;
+                skipped++;
+                break;
+            }
+        }
+
+        pos += STREAM_HEAD + len + 1;
+    }
+
+    logData = stream;
+    logSize = streamSize;
+    fprintf(stderr, "%d sessions, %d frames, %d skipped, %d gaps with %d frames missing, %d bad packets\n",
+            session, frames, skipped, gaps, lost, bad);
+}
+
+static speed_t baudConstant(int baud)
+{
+    switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 230400: return B230400;
+#ifdef B460800
+    case 460800: return B460800;
+#endif
+#ifdef B500000
+    case 500000: return B500000;
+#endif
+#ifdef B921600
+    case 921600: return B921600;
+#endif
+#ifdef B1000000
+    case 1000000: return B1000000;
+#endif
+    default: return B115200;
+    }
+}
+
+static int serialOpen(const char *port, int baud)
+{
+    struct termios options;
+    int fd;
+
+    fd = open(port, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+        return -1;
+
+    tcgetattr(fd, &options);
+    cfmakeraw(&options);
+    cfsetispeed(&options, baudConstant(baud));
+    cfsetospeed(&options, baudConstant(baud));
+    options.c_cflag |= CLOCAL | CREAD;
+    options.c_cc[VMIN] = 0;
+    options.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &options);
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
+
+static int serialRead(int fd, uint8_t *c)
+{
+    struct timeval timeout = { 0, MSP_TIMEOUT_US };
+    fd_set set;
+
+    FD_ZERO(&set);
+    FD_SET(fd, &set);
+    if (select(fd + 1, &set, NULL, NULL, &timeout) <= 0)
+        return 0;
+    return read(fd, c, 1) == 1;
+}
+
+// sends an MSP v1 request and waits for its reply, returns the payload size or -1
+static int mspRequest(int fd, uint8_t cmd, const uint8_t *payload, uint8_t len, uint8_t *reply)
+{
+    uint8_t frame[6 + 255], c, size, checksum;
+    int i, state = 0;
+
+    frame[0] = '$';
+    frame[1] = 'M';
+    frame[2] = '<';
+    frame[3] = len;
+    frame[4] = cmd;
+    checksum = len ^ cmd;
+    for (i = 0; i < len; i++) {
+        frame[5 + i] = payload[i];
+        checksum ^= payload[i];
+    }
+    frame[5 + len] = checksum;
+    if (write(fd, frame, 6 + len) != 6 + len)
+        return -1;
+
+    while (serialRead(fd, &c)) {
+        if (state == 0) {
+            state = c == '$';
+        } else if (state == 1) {
+            state = c == 'M' ? 2 : 0;
+        } else if (state == 2) {
+            if (c == '!')
+                return -1;
+            state = c == '>' ? 3 : 0;
+        } else {
+            size = c;
+            if (!serialRead(fd, &c))
+                return -1;
+            checksum = size ^ c;
+            if (c != cmd) {
+                state = 0;
+                continue;
+            }
+            for (i = 0; i < size; i++) {
+                if (!serialRead(fd, &reply[i]))
+                    return -1;
+                checksum ^= reply[i];
+            }
+            if (!serialRead(fd, &c) || c != checksum)
+                return -1;
+            return size;
+        }
+    }
+    return -1;
+}
+
+static uint8_t *download(const char *port, int baud, size_t *size)
+{
+    uint8_t request[6], reply[255], *data;
+    uint32_t used, address = 0;
+    int fd, len, retries = 0;
+
+    fd = serialOpen(port, baud);
+    if (fd < 0) {
+        perror(port);
+        return NULL;
+    }
+
+    len = mspRequest(fd, MSP_FLASH_INFO, NULL, 0, reply);
+    if (len < 9 || !(reply[0] & 1)) {
+        fprintf(stderr, "no blackbox flash on this board\n");
+        close(fd);
+        return NULL;
+    }
+    if (reply[0] & 6) {
+        fprintf(stderr, "flash is busy logging or erasing, disarm and try again\n");
+        close(fd);
+        return NULL;
+    }
+    used = reply[5] | reply[6] << 8 | reply[7] << 16 | (uint32_t)reply[8] << 24;
+    data = malloc(used ? used : 1);
+
+    while (address < used) {
+        request[0] = address;
+        request[1] = address >> 8;
+        request[2] = address >> 16;
+        request[3] = address >> 24;
+        request[4] = MSP_FLASH_READ_MAX;
+        request[5] = 0;
+        len = mspRequest(fd, MSP_FLASH_READ, request, sizeof(request), reply);
+        // a short reply means the board was busy, ask again
+        if (len <= 4) {
+            if (++retries > MSP_RETRIES) {
+                fprintf(stderr, "\ndownload failed at %u\n", address);
+                break;
+            }
+            usleep(10000);
+            continue;
+        }
+        retries = 0;
+        len = len - 4;
+        if (address + len > used)
+            len = used - address;
+        memcpy(data + address, reply + 4, len);
+        address += len;
+        fprintf(stderr, "\r%u/%u bytes", address, used);
+    }
+    fprintf(stderr, "\n");
+    close(fd);
+
+    *size = address;
+    return data;
+}
+
+static volatile sig_atomic_t stopCapture = 0;
+
+static void captureInterrupted(int sig)
+{
+    (void)sig;
+    stopCapture = 1;
+}
+
+// records the serial stream until ^C, the board streams on its own while armed
+static uint8_t *capture(const char *port, int baud, size_t *size)
+{
+    uint8_t *data = NULL;
+    size_t capacity = 0;
+    ssize_t n;
+    int fd;
+
+    fd = serialOpen(port, baud);
+    if (fd < 0) {
+        perror(port);
+        return NULL;
+    }
+
+    signal(SIGINT, captureInterrupted);
+    fprintf(stderr, "recording, ^C to stop\n");
+    *size = 0;
+    while (!stopCapture) {
+        if (*size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            data = realloc(data, capacity);
+        }
+        n = read(fd, data + *size, capacity - *size);
+        if (n > 0) {
+            *size += n;
+            fprintf(stderr, "\r%zu bytes", *size);
+        } else {
+            usleep(1000);
+        }
+    }
+    fprintf(stderr, "\n");
+    signal(SIGINT, SIG_DFL);
+    close(fd);
+    return data;
+}
+
+static uint8_t *readFile(const char *name, size_t *size)
+{
+    uint8_t *data = NULL;
+    size_t capacity = 0, n;
+    FILE *f = name ? fopen(name, "rb") : stdin;
+
+    if (!f) {
+        perror(name);
+        return NULL;
+    }
+
+    *size = 0;
+    do {
+        if (*size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            data = realloc(data, capacity);
+        }
+        n = fread(data + *size, 1, capacity - *size, f);
+        *size += n;
+    } while (n > 0);
+
+    if (f != stdin)
+        fclose(f);
+    return data;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-s] [-p port] [-b baud] [-o raw.bin] [-r session] [log.bin]\n", name);
+    fprintf(stderr, "decodes a blackbox log to CSV on stdout, from a file, stdin, or downloaded from the board\n");
+    fprintf(stderr, "  -s  the log is a serial stream capture (blackbox_device 1 or 2), recorded from the port if one is given\n");
+    fprintf(stderr, "  -r  write the session (1 is the first) as a SITL sensor log for baseflight_SITL -r, needs blackbox_raw 1\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *port = NULL, *rawName = NULL;
+    int baud = DEFAULT_BAUD, stream = 0, opt;
+    uint8_t *data;
+    size_t size = 0;
+    FILE *raw;
+
+    while ((opt = getopt(argc, argv, "sp:b:o:r:h")) != -1) {
+        switch (opt) {
+        case 's':
+            stream = 1;
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        case 'b':
+            baud = atoi(optarg);
+            break;
+        case 'o':
+            rawName = optarg;
+            break;
+        case 'r':
+            replaySession = atoi(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (port && stream)
+        data = capture(port, baud, &size);
+    else if (port)
+        data = download(port, baud, &size);
+    else
+        data = readFile(optind < argc ? argv[optind] : NULL, &size);
+    if (!data)
+        return 1;
+
+    if (rawName) {
+        raw = fopen(rawName, "wb");
+        if (!raw || fwrite(data, 1, size, raw) != size) {
+            perror(rawName);
+            return 1;
+        }
+        fclose(raw);
+    }
+
+    logData = data;
+    logSize = size;
+    if (stream)
+        decodeStream();
+    else
+        decodeFlash();
+    free(data);
+
+    if (replaySession && !replayPendingCount) {
+        fprintf(stderr, "session %d has no raw field set to replay\n", replaySession);
+        return 1;
+    }
+    // a flight shorter than the calibration
+    if (replaySession && !replayStarted)
+        replayBegin();
+    return 0;
+}
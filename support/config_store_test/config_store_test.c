@@ -0,0 +1,256 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ *
+ * Host power loss test for src/config_store.c, run on the SITL flash (src/drv_sitl_flash.c). A scripted series
+ * of saves, enough of them to compact several times, is replayed with the power cut at every flash operation
+ * of every save in turn. The operation that gets cut is either not done, half programmed (low byte only) or
+ * half erased. After each cut the store must come up with exactly the config before or after that save, and
+ * a save after that must work again. Also checks that a config changing while it is saved ends up in flash.
+ *
+ *   config_store_test [-q]
+ */
+
+#include "board.h"
+#include "mw.h"
+
+// the firmware's printf.h renames it, this one runs on the host
+#undef printf
+
+#include <assert.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#define SAVES               160
+#define CONFIG_STORE_SIZE   (4 * 1024)              // both banks, the last 4 pages of the 128K part
+#define CONFIG_STORE_ADDR   (0x08000000 + 128 * 1024 - CONFIG_STORE_SIZE)
+
+typedef enum {
+    CUT_SKIP = 0,                                   // the operation the power went during didn't happen
+    CUT_PARTIAL,                                    // and half of it did
+    CUT_COUNT
+} cut_e;
+
+master_t mcfg;
+flags_t f;
+
+FLASH_Status __real_FLASH_ProgramHalfWord(uint32_t address, uint16_t data);
+FLASH_Status __real_FLASH_ErasePage(uint32_t address);
+
+static int quiet;
+static uint32_t flashOps;
+static uint32_t cutAt;                              // flash operation the power goes at, 0 for never
+static cut_e cutMode;
+static jmp_buf powerLoss;
+static int failures;
+
+static uint8_t *store = (uint8_t *)CONFIG_STORE_ADDR;
+static uint8_t flashBefore[CONFIG_STORE_SIZE];
+static master_t states[SAVES + 1];
+static uint32_t saveOps[SAVES + 1];
+static uint32_t rngState = 1;
+
+void failureMode(uint8_t mode)
+{
+    (void)mode;
+    failures++;
+}
+
+FLASH_Status __wrap_FLASH_ProgramHalfWord(uint32_t address, uint16_t data)
+{
+    if (++flashOps != cutAt || !cutAt)
+        return __real_FLASH_ProgramHalfWord(address, data);
+
+    // programming clears the bits one byte at a time, the high byte never got there
+    if (cutMode == CUT_PARTIAL)
+        __real_FLASH_ProgramHalfWord(address, data | 0xFF00);
+    longjmp(powerLoss, 1);
+}
+
+FLASH_Status __wrap_FLASH_ErasePage(uint32_t address)
+{
+    if (++flashOps != cutAt || !cutAt)
+        return __real_FLASH_ErasePage(address);
+
+    if (cutMode == CUT_PARTIAL)
+        memset((void *)(uintptr_t)(address & ~0x3FF), 0xFF, 0x200);
+    longjmp(powerLoss, 1);
+}
+
+static uint32_t rng(void)
+{
+    rngState = rngState * 1103515245 + 12345;
+    return rngState >> 8;
+}
+
+// a few settings change, a few bytes apart or spread out, now and then a profile worth
+static void changeConfig(master_t *m)
+{
+    uint8_t *p = (uint8_t *)m;
+    int count = rng() % 8 == 0 ? 200 : 1 + rng() % 12;
+    int at = rng() % sizeof(master_t);
+
+    while (count--) {
+        p[at] += 1 + rng() % 255;
+        at = (at + 1 + rng() % (rng() % 4 ? 4 : 64)) % sizeof(master_t);
+    }
+}
+
+static bool xorClean(const master_t *m)
+{
+    const uint8_t *p = (const uint8_t *)m;
+    uint8_t chk = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(master_t); i++)
+        chk ^= p[i];
+    return chk == 0;
+}
+
+// what the next boot finds
+static bool reboot(master_t *loaded)
+{
+    memset(loaded, 0xA5, sizeof(master_t));
+    configStoreInit();
+    return configStoreLoad(loaded);
+}
+
+static void save(const master_t *m)
+{
+    mcfg = *m;
+    configStoreSave();
+    configStoreFlush();
+}
+
+// builds the series of configs, each one saved cleanly on top of the last
+static void script(void)
+{
+    master_t loaded;
+    int i;
+
+    memset(&states[0], 0, sizeof(master_t));
+    memset(store, 0xFF, CONFIG_STORE_SIZE);
+    assert(!reboot(&loaded));
+
+    for (i = 1; i <= SAVES; i++) {
+        states[i] = states[i - 1];
+        changeConfig(&states[i]);
+        flashOps = 0;
+        save(&states[i]);
+        // the store seals the checksum into mcfg
+        states[i] = mcfg;
+        saveOps[i] = flashOps;
+        assert(reboot(&loaded) && !memcmp(&loaded, &states[i], sizeof(master_t)) && xorClean(&loaded));
+    }
+}
+
+// every flash operation of every save gets cut in turn, on the flash the saves before it left
+static void cutEverywhere(void)
+{
+    master_t loaded;
+    uint32_t cuts = 0, older = 0, compactions = 0, cut;
+    int i, mode;
+    bool found;
+
+    memset(store, 0xFF, CONFIG_STORE_SIZE);
+    configStoreInit();
+
+    for (i = 1; i <= SAVES; i++) {
+        memcpy(flashBefore, store, CONFIG_STORE_SIZE);
+        // a compaction erases two pages and writes a snapshot, an append is a few records
+        if (saveOps[i] > sizeof(master_t) / 2)
+            compactions++;
+
+        for (mode = 0; mode < CUT_COUNT; mode++) {
+            for (cut = 1; cut <= saveOps[i]; cut++) {
+                memcpy(store, flashBefore, CONFIG_STORE_SIZE);
+                reboot(&loaded);
+                cutAt = cut;
+                cutMode = mode;
+                flashOps = 0;
+                if (!setjmp(powerLoss)) {
+                    save(&states[i]);
+                    assert(0);
+                }
+                cutAt = 0;
+                cuts++;
+
+                // the config before the save or the one after, nothing in between
+                found = reboot(&loaded);
+                if (found || i > 1) {
+                    assert(found && xorClean(&loaded));
+                    if (memcmp(&loaded, &states[i], sizeof(master_t))) {
+                        assert(!memcmp(&loaded, &states[i - 1], sizeof(master_t)));
+                        older++;
+                    }
+                }
+
+                // power back, and whatever the cut left in flash takes the save again
+                save(&states[i]);
+                assert(reboot(&loaded) && !memcmp(&loaded, &states[i], sizeof(master_t)));
+            }
+        }
+
+        // carry on from the clean save
+        memcpy(store, flashBefore, CONFIG_STORE_SIZE);
+        reboot(&loaded);
+        save(&states[i]);
+    }
+
+    assert(failures == 0);
+    if (!quiet)
+        printf("%u power cuts over %d saves (%u compactions), %u came up with the config before the save, all saved again after\n", cuts, SAVES, compactions, older);
+}
+
+// the GUI keeps sending settings while the last ones are still being written. What gets committed is the
+// config at the time of the commit, never records from before a change mixed with records from after it
+static void changeWhileSaving(void)
+{
+    master_t loaded;
+    int i, changes, steps;
+    bool busy;
+
+    memset(store, 0xFF, CONFIG_STORE_SIZE);
+    configStoreInit();
+    mcfg = states[SAVES];
+
+    for (i = 0; i < 2000; i++) {
+        configStoreSave();
+        // now and then so fast that the records of one save fill the bank
+        busy = rng() % 16 == 0;
+        for (changes = busy ? 200 : 1 + rng() % 4; changes--; ) {
+            for (steps = rng() % (busy ? 4 : 300); steps && configStoreBusy(); steps--)
+                configStoreUpdate();
+            if (configStoreBusy())
+                changeConfig(&mcfg);
+        }
+        while (configStoreBusy())
+            configStoreUpdate();
+        assert(reboot(&loaded) && !memcmp(&loaded, &mcfg, sizeof(master_t)) && xorClean(&loaded));
+    }
+
+    assert(failures == 0);
+    if (!quiet)
+        printf("2000 saves changed while being written, each committed the config as it was at the end\n");
+}
+
+int main(int argc, char *argv[])
+{
+    char path[] = "/tmp/config_store_test.XXXXXX";
+    int fd;
+
+    quiet = argc > 1 && !strcmp(argv[1], "-q");
+
+    // a fresh file, mapped privately so nothing is written back to it
+    fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    sitlFlashInit(path, true);
+    unlink(path);
+
+    script();
+    cutEverywhere();
+    changeWhileSaving();
+    printf("config store: survived every power cut\n");
+    return 0;
+}
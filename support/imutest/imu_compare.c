@@ -0,0 +1,192 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ *
+ * Float against fixed point IMU check. "log" writes a SITL sensor log (see src/sitl_replay.c) of a scripted
+ * flight: a still start for the calibrations, then rolling, pitching and yawing while climbing and sinking,
+ * with the noise the SITL model puts on its chips. The Makefile replays it through a SITL build with the float
+ * estimators and one with OPTIONS=FIXED_IMU, and "compare" checks the two outputs loop by loop against the
+ * bounds the fixed point code is held to:
+ *
+ *   angles within 0.1 deg, heading within 1 deg, EstAlt within 2 cm, vario within 2 cm/s
+ *
+ *   imu_compare log <seconds>
+ *   imu_compare compare <float output> <fixed output>
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GYRO_PERIOD         1000                    // us, gyro and acc samples
+#define MAG_PERIOD          13333                   // 75Hz
+#define BARO_PERIOD         20000                   // both conversions of the MS5611
+#define STILL_US            10000000                // on the bench, covers the gyro and baro calibration
+#define SETTLE_US           15000000                // outputs are compared from here on
+
+// chip scales of the SITL model, src/sitl_model.c
+#define GYRO_LSB            (16.4 / 4)              // per deg/s
+#define ACC_1G              (512 * 8)
+#define MAG_LSB             660.0                   // per gauss
+#define GRAVITY             9.80665
+#define RAD                 (M_PI / 180.0)
+
+#define LINE_SIZE           256
+#define MAX(a, b)           ((a) > (b) ? (a) : (b))
+
+static const double magField[3] = { 0.2, 0.0, -0.45 };
+
+static double q[4] = { 1, 0, 0, 0 };
+static uint32_t noiseState = 0x12345678;
+
+static int noise(int amplitude)
+{
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 17;
+    noiseState ^= noiseState << 5;
+    return (int)(noiseState % (2 * amplitude + 1)) - amplitude;
+}
+
+// same conventions as the model: body rates in rad/s, earth Z up
+static void earthToBody(const double *v, double *out)
+{
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+
+    out[0] = (1 - 2 * (y * y + z * z)) * v[0] + 2 * (x * y + w * z) * v[1] + 2 * (x * z - w * y) * v[2];
+    out[1] = 2 * (x * y - w * z) * v[0] + (1 - 2 * (x * x + z * z)) * v[1] + 2 * (y * z + w * x) * v[2];
+    out[2] = 2 * (x * z + w * y) * v[0] + 2 * (y * z - w * x) * v[1] + (1 - 2 * (x * x + y * y)) * v[2];
+}
+
+static void rotate(const double *rate, double dt)
+{
+    double dq[4], norm = 0;
+    int i;
+
+    dq[0] = -q[1] * rate[0] - q[2] * rate[1] - q[3] * rate[2];
+    dq[1] = q[0] * rate[0] + q[2] * rate[2] - q[3] * rate[1];
+    dq[2] = q[0] * rate[1] - q[1] * rate[2] + q[3] * rate[0];
+    dq[3] = q[0] * rate[2] + q[1] * rate[1] - q[2] * rate[0];
+    for (i = 0; i < 4; i++) {
+        q[i] += dq[i] * 0.5 * dt;
+        norm += q[i] * q[i];
+    }
+    for (i = 0; i < 4; i++)
+        q[i] /= sqrt(norm);
+}
+
+// the flight: swinging roll and pitch rates that, with the turning, tip the craft up to ~80 deg, and a climb to
+// 4m and back
+static void flight(double t, double *rate, double *altitude, double *climbAcc)
+{
+    double w;
+
+    rate[0] = rate[1] = rate[2] = 0;
+    *altitude = *climbAcc = 0;
+    if (t < STILL_US / 1e6)
+        return;
+
+    t -= STILL_US / 1e6;
+    rate[0] = 30 * RAD * 2 * M_PI * 0.2 * sin(2 * M_PI * 0.2 * t);
+    rate[1] = 25 * RAD * 2 * M_PI * 0.13 * sin(2 * M_PI * 0.13 * t);
+    rate[2] = 20 * RAD * sin(2 * M_PI * 0.03 * t);
+    w = 2 * M_PI * 0.05;
+    *altitude = 2 * (1 - cos(w * t));
+    *climbAcc = 2 * w * w * cos(w * t);
+}
+
+static int writeLog(double seconds)
+{
+    double rate[3], specific[3], body[3], altitude, climbAcc;
+    uint64_t t, end = (uint64_t)(seconds * 1e6);
+    int i;
+
+    printf("# baseflight SITL sensor log, scripted flight for the float/fixed IMU check\n");
+    for (t = GYRO_PERIOD; t <= end; t += GYRO_PERIOD) {
+        flight(t / 1e6, rate, &altitude, &climbAcc);
+        rotate(rate, GYRO_PERIOD / 1e6);
+
+        printf("%llu G", (unsigned long long)t);
+        for (i = 0; i < 3; i++)
+            printf(" %d", (int)lrint(rate[i] / RAD * GYRO_LSB) + noise(2));
+        specific[0] = specific[1] = 0;
+        specific[2] = climbAcc + GRAVITY;
+        earthToBody(specific, body);
+        printf("\n%llu A", (unsigned long long)t);
+        for (i = 0; i < 3; i++)
+            printf(" %d", (int)lrint(body[i] / GRAVITY * ACC_1G) + noise(8));
+        putchar('\n');
+
+        if (t % MAG_PERIOD < GYRO_PERIOD) {
+            earthToBody(magField, body);
+            printf("%llu M", (unsigned long long)t);
+            for (i = 0; i < 3; i++)
+                printf(" %d", (int)lrint(body[i] * MAG_LSB));
+            putchar('\n');
+        }
+        if (t % BARO_PERIOD < GYRO_PERIOD)
+            printf("%llu B %d 2500\n", (unsigned long long)t, (int)lrint(101325.0 * pow(1.0 - 2.25577e-5 * altitude, 5.25588)) + noise(3));
+    }
+    return 0;
+}
+
+typedef struct replayLine_t {
+    unsigned long long time;
+    int roll, pitch, heading, alt, vario;
+} replayLine_t;
+
+static int readLine(FILE *file, replayLine_t *line)
+{
+    char buf[LINE_SIZE];
+
+    if (!fgets(buf, sizeof(buf), file))
+        return 0;
+    return sscanf(buf, "%llu %d %d %d %d %d", &line->time, &line->roll, &line->pitch, &line->heading, &line->alt, &line->vario) == 6;
+}
+
+static int compare(const char *floatPath, const char *fixedPath)
+{
+    FILE *floatFile = fopen(floatPath, "r"), *fixedFile = fopen(fixedPath, "r");
+    replayLine_t a, b;
+    int roll = 0, pitch = 0, heading = 0, alt = 0, vario = 0, d;
+    unsigned long loops = 0;
+    int ok;
+
+    if (!floatFile || !fixedFile) {
+        perror(floatFile ? fixedPath : floatPath);
+        return 1;
+    }
+
+    while (readLine(floatFile, &a)) {
+        if (!readLine(fixedFile, &b) || a.time != b.time) {
+            fprintf(stderr, "imu_compare: the replays ran different loops\n");
+            return 1;
+        }
+        if (a.time < SETTLE_US)
+            continue;
+        loops++;
+        roll = MAX(roll, abs(a.roll - b.roll));
+        pitch = MAX(pitch, abs(a.pitch - b.pitch));
+        d = abs(a.heading - b.heading);
+        heading = MAX(heading, d > 180 ? 360 - d : d);
+        alt = MAX(alt, abs(a.alt - b.alt));
+        vario = MAX(vario, abs(a.vario - b.vario));
+    }
+
+    ok = loops > 0 && roll <= 1 && pitch <= 1 && heading <= 1 && alt <= 2 && vario <= 2;
+    printf("%lu loops, largest float/fixed difference: roll %.1f deg, pitch %.1f deg, heading %d deg, EstAlt %d cm, vario %d cm/s: %s\n",
+           loops, roll / 10.0, pitch / 10.0, heading, alt, vario, ok ? "within bounds" : "OUT OF BOUNDS");
+    return !ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && !strcmp(argv[1], "log"))
+        return writeLog(atof(argv[2]));
+    if (argc == 4 && !strcmp(argv[1], "compare"))
+        return compare(argv[2], argv[3]);
+
+    fprintf(stderr, "usage: %s log <seconds> | compare <float output> <fixed output>\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,202 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ *
+ * Host accuracy and speed sweep for src/fastmath.c. Every approximation is compared against libm in double
+ * over its input range, and the error bounds documented in fastmath.c are asserted. The speed numbers are
+ * host nanoseconds per call next to the libm float call, only a rough guide for the F103 where libm is
+ * soft-float.
+ *
+ *   fastmath_test [-q]
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "fastmath.h"
+
+#define SWEEP_STEPS         2000000
+#define SPEED_CALLS         10000000
+#define Q28                 268435456.0
+#define Q30                 1073741824.0
+
+static int quiet;
+static volatile float sink;
+
+static double nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void report(const char *name, double err, double bound, const char *unit)
+{
+    if (!quiet)
+        printf("%-28s max error %.3g %s (bound %.3g)\n", name, err, unit, bound);
+    assert(err <= bound);
+}
+
+static void sweepSinCos(void)
+{
+    double errSin = 0, errCos = 0, errFixSin = 0, errFixCos = 0, x;
+    int32_t fs, fc;
+    float s, c;
+    int i;
+
+    // flight angles stay within a few turns
+    for (i = 0; i <= SWEEP_STEPS; i++) {
+        x = -4 * M_PI + 8 * M_PI * i / SWEEP_STEPS;
+        errSin = fmax(errSin, fabs(fastSin((float)x) - sin((float)x)));
+        errCos = fmax(errCos, fabs(fastCos((float)x) - cos((float)x)));
+        fastSinCos((float)x, &s, &c);
+        assert(s == fastSin((float)x) && c == fastCos((float)x));
+    }
+    report("fastSin", errSin, 4e-6, "");
+    report("fastCos", errCos, 4e-6, "");
+
+    // Q28 holds +/- 8 rad, the reduction takes +/- 3 pi
+    for (i = 0; i <= SWEEP_STEPS; i++) {
+        x = -3 * M_PI + 6 * M_PI * i / SWEEP_STEPS;
+        fixSinCos((int32_t)(x * Q28), &fs, &fc);
+        x = (int32_t)(x * Q28) / Q28;
+        errFixSin = fmax(errFixSin, fabs(fs / Q30 - sin(x)));
+        errFixCos = fmax(errFixCos, fabs(fc / Q30 - cos(x)));
+        assert(fs == fixSin((int32_t)(x * Q28)) && fc == fixCos((int32_t)(x * Q28)));
+    }
+    report("fixSin", errFixSin, 4e-6, "");
+    report("fixCos", errFixCos, 4e-6, "");
+}
+
+static void sweepAtan2(void)
+{
+    double err = 0, errFix = 0, a, r;
+    float y, x;
+    int i, j;
+
+    // all directions, and magnitudes from sensor noise to full scale
+    for (j = 0; j < 6; j++) {
+        r = pow(10, j - 1);
+        for (i = 0; i <= SWEEP_STEPS / 6; i++) {
+            a = -M_PI + 2 * M_PI * i / (SWEEP_STEPS / 6);
+            y = (float)(r * sin(a));
+            x = (float)(r * cos(a));
+            err = fmax(err, fabs(fastAtan2(y, x) - atan2(y, x)));
+            if (r >= 10)
+                errFix = fmax(errFix, fabs(fixAtan2((int32_t)y * 1000, (int32_t)x * 1000) / Q28 - atan2((int32_t)y, (int32_t)x)));
+        }
+    }
+    assert(fastAtan2(0, 0) == 0 && fixAtan2(0, 0) == 0);
+    report("fastAtan2", err, 1.2e-5, "rad");
+    report("fixAtan2", errFix, 7e-5, "rad");
+}
+
+static void sweepAcos(void)
+{
+    double err = 0, x;
+    int i;
+
+    for (i = 0; i <= SWEEP_STEPS; i++) {
+        x = -1 + 2.0 * i / SWEEP_STEPS;
+        err = fmax(err, fabs(fastAcos((float)x) - acos((float)x)));
+    }
+    // clamped outside [-1, 1], like the rounding of a normalized vector can ask for
+    assert(fastAcos(1.0001f) == fastAcos(1.0f) && fastAcos(-1.0001f) == fastAcos(-1.0f));
+    report("fastAcos", err, 7e-5, "rad");
+}
+
+static void sweepInvSqrt(void)
+{
+    double err = 0, x;
+    int i;
+
+    // squared vector lengths, from a nearly zero acc vector to full scale
+    for (i = 0; i <= SWEEP_STEPS; i++) {
+        x = pow(10, -6 + 14.0 * i / SWEEP_STEPS);
+        err = fmax(err, fabs(fastInvSqrt((float)x) * sqrt((float)x) - 1));
+    }
+    report("fastInvSqrt", err, 5e-6, "relative");
+}
+
+static void sweepSqrt64(void)
+{
+    uint64_t x, r;
+    int i;
+
+    for (i = 0; i < SWEEP_STEPS; i++) {
+        x = (uint64_t)i * i * 2654435761u + i;
+        r = fixSqrt64(x);
+        assert(r * r <= x && (r + 1) * (r + 1) > x);
+    }
+    assert(fixSqrt64(0) == 0 && fixSqrt64(UINT64_MAX) == 0xFFFFFFFF);
+    if (!quiet)
+        printf("%-28s exact\n", "fixSqrt64");
+}
+
+static void sweepAltitude(void)
+{
+    double err = 0, errFix = 0, ref;
+    int32_t p;
+
+    for (p = 50000; p <= 111000; p++) {
+        ref = (1 - pow(p / 101325.0, 0.190295)) * 4433000;
+        err = fmax(err, fabs(fastPressureToAltitude(p) - ref));
+        if (p <= 110000)
+            errFix = fmax(errFix, fabs(fixPressureToAltitude(p) - ref));
+    }
+    report("fastPressureToAltitude", err, 0.5, "cm");
+    report("fixPressureToAltitude", errFix, 1, "cm");
+}
+
+#define SPEED(name, expr)                                       \
+    do {                                                        \
+        double start = nowNs();                                 \
+        for (i = 0; i < SPEED_CALLS; i++) {                     \
+            x = 0.1f + i * 1e-7f;                               \
+            sink = (expr);                                      \
+        }                                                       \
+        if (!quiet)                                             \
+            printf("  %-26s %5.1f ns\n", name, (nowNs() - start) / SPEED_CALLS); \
+    } while (0)
+
+static void speed(void)
+{
+    float x;
+    int i;
+
+    if (!quiet)
+        printf("host time per call:\n");
+    SPEED("sinf", sinf(x));
+    SPEED("fastSin", fastSin(x));
+    SPEED("fixSin", (float)fixSin((int32_t)(x * Q28)));
+    SPEED("atan2f", atan2f(x, 0.5f));
+    SPEED("fastAtan2", fastAtan2(x, 0.5f));
+    SPEED("fixAtan2", (float)fixAtan2((int32_t)(x * 1000), 500));
+    SPEED("acosf", acosf(x));
+    SPEED("fastAcos", fastAcos(x));
+    SPEED("1 / sqrtf", 1.0f / sqrtf(x));
+    SPEED("fastInvSqrt", fastInvSqrt(x));
+    SPEED("powf altitude", (1.0f - powf((50000.0f + x * 5e4f) / 101325.0f, 0.190295f)) * 4433000.0f);
+    SPEED("fastPressureToAltitude", fastPressureToAltitude(50000.0f + x * 5e4f));
+    SPEED("fixPressureToAltitude", (float)fixPressureToAltitude((int32_t)(50000.0f + x * 5e4f)));
+}
+
+int main(int argc, char *argv[])
+{
+    quiet = argc > 1 && !strcmp(argv[1], "-q");
+
+    sweepSinCos();
+    sweepAtan2();
+    sweepAcos();
+    sweepInvSqrt();
+    sweepSqrt64();
+    sweepAltitude();
+    speed();
+    printf("fastmath: all within bounds\n");
+    return 0;
+}
@@ -0,0 +1,184 @@
+/*
+ * This file is part of baseflight
+ * Licensed under GPL V3 or modified DCL - see https://github.com/multiwii/baseflight/blob/master/README.md
+ *
+ * Host frequency response test for src/filter.c. Sines are run through the fixed point chains the way the gyro
+ * and the PID feed them, and the gain after the transient is checked against the response of the same RBJ
+ * design in double: unity at DC, -3dB at a low pass cutoff, a deep null at a notch center. Also checks that the
+ * chains follow the sample period the gyro measures.
+ *
+ *   filter_test [-q]
+ */
+
+#include "board.h"
+#include "mw.h"
+
+// the firmware's printf.h renames it, this one runs on the host
+#undef printf
+
+#include <assert.h>
+
+#define SETTLE_SAMPLES      4000
+#define MEASURE_SAMPLES     20000
+#define AMPLITUDE           4000.0          // LSB, about 250 deg/s of gyro
+
+master_t mcfg;
+config_t cfg;
+bool gyroSyncActive;
+
+static int quiet;
+
+static void configure(uint16_t lpf, uint16_t notchHz, uint16_t notchBw, uint32_t period)
+{
+    memset(&mcfg, 0, sizeof(mcfg));
+    memset(&cfg, 0, sizeof(cfg));
+    mcfg.gyro_soft_lpf = lpf;
+    mcfg.gyro_notch1_hz = notchHz;
+    mcfg.gyro_notch1_bw = notchBw;
+    cfg.dterm_lpf = lpf;
+    cfg.dterm_notch_hz = notchHz;
+    cfg.dterm_notch_bw = notchBw;
+    mcfg.looptime = period;
+    filterInit();
+}
+
+// steady state gain in dB for a sine of hz sampled every period us, on every axis of the chain
+static double gainDb(filterChain_t *chain, double hz, uint32_t period)
+{
+    double in = 0, out = 0, x, gain = 0, axisGain;
+    int32_t y;
+    int axis, i;
+
+    for (axis = 0; axis < 3; axis++) {
+        memset(chain->state, 0, sizeof(chain->state));
+        in = out = 0;
+        for (i = 0; i < SETTLE_SAMPLES + MEASURE_SAMPLES; i++) {
+            x = hz ? AMPLITUDE * sin(2 * M_PI * hz * i * period / 1e6) : AMPLITUDE;
+            y = filterApply(chain, axis, lrint(x));
+            if (i >= SETTLE_SAMPLES) {
+                in += x * x;
+                out += (double)y * y;
+            }
+        }
+        axisGain = 10 * log10(out / in);
+        // the axes have separate state, not separate coefficients
+        assert(axis == 0 || axisGain == gain);
+        gain = axisGain;
+    }
+    return gain;
+}
+
+// |H| in dB of a biquad at hz, sampled every period us
+static double biquadDb(double b0, double b1, double b2, double a0, double a1, double a2, double hz, uint32_t period)
+{
+    double w = 2 * M_PI * hz * period / 1e6;
+    double nr = b0 + b1 * cos(w) + b2 * cos(2 * w), ni = -b1 * sin(w) - b2 * sin(2 * w);
+    double dr = a0 + a1 * cos(w) + a2 * cos(2 * w), di = -a1 * sin(w) - a2 * sin(2 * w);
+
+    return 10 * log10((nr * nr + ni * ni) / (dr * dr + di * di));
+}
+
+static double lowpassDb(double cutoff, double hz, uint32_t period)
+{
+    double w0 = 2 * M_PI * cutoff * period / 1e6, alpha = sin(w0) / (2 * M_SQRT1_2), cs = cos(w0);
+
+    return biquadDb((1 - cs) / 2, 1 - cs, (1 - cs) / 2, 1 + alpha, -2 * cs, 1 - alpha, hz, period);
+}
+
+static double notchDb(double center, double bandwidth, double hz, uint32_t period)
+{
+    double w0 = 2 * M_PI * center * period / 1e6, alpha = sin(w0) * bandwidth / (2 * center), cs = cos(w0);
+
+    return biquadDb(1, -2 * cs, 1, 1 + alpha, -2 * cs, 1 - alpha, hz, period);
+}
+
+static void check(const char *name, filterChain_t *chain, double hz, uint32_t period, double expect, double tolerance)
+{
+    double gain = gainDb(chain, hz, period);
+
+    if (!quiet)
+        printf("%-34s %7.1fHz %8.2fdB (expected %.2f +/- %.2f)\n", name, hz, gain, expect, tolerance);
+    assert(fabs(gain - expect) <= tolerance);
+}
+
+static void checkBelow(const char *name, filterChain_t *chain, double hz, uint32_t period, double limit)
+{
+    double gain = gainDb(chain, hz, period);
+
+    if (!quiet)
+        printf("%-34s %7.1fHz %8.2fdB (below %.1f)\n", name, hz, gain, limit);
+    assert(gain < limit);
+}
+
+static void lowpass(void)
+{
+    configure(100, 0, 0, 1000);
+    assert(gyroFilter.count == 1 && dtermFilter.count == 1);
+    check("gyro low pass 100Hz at 1kHz", &gyroFilter, 0, 1000, 0, 0.01);
+    check("gyro low pass 100Hz at 1kHz", &gyroFilter, 20, 1000, 0, 0.1);
+    check("gyro low pass 100Hz at 1kHz", &gyroFilter, 100, 1000, -3.01, 0.1);
+    check("gyro low pass 100Hz at 1kHz", &gyroFilter, 200, 1000, lowpassDb(100, 200, 1000), 0.1);
+    check("gyro low pass 100Hz at 1kHz", &gyroFilter, 400, 1000, lowpassDb(100, 400, 1000), 0.3);
+    check("dterm low pass 100Hz at 1kHz", &dtermFilter, 100, 1000, -3.01, 0.1);
+}
+
+static void notch(void)
+{
+    // Q = 200 / 40 = 5, the -3dB points are bandwidth apart around the center
+    configure(0, 200, 40, 1000);
+    assert(gyroFilter.count == 1 && dtermFilter.count == 1);
+    check("gyro notch 200Hz/40 at 1kHz", &gyroFilter, 0, 1000, 0, 0.01);
+    check("gyro notch 200Hz/40 at 1kHz", &gyroFilter, 50, 1000, notchDb(200, 40, 50, 1000), 0.05);
+    check("gyro notch 200Hz/40 at 1kHz", &gyroFilter, 180, 1000, notchDb(200, 40, 180, 1000), 0.1);
+    checkBelow("gyro notch 200Hz/40 at 1kHz", &gyroFilter, 200, 1000, -40);
+    check("gyro notch 200Hz/40 at 1kHz", &gyroFilter, 400, 1000, notchDb(200, 40, 400, 1000), 0.05);
+    checkBelow("dterm notch 200Hz/40 at 1kHz", &dtermFilter, 200, 1000, -40);
+
+    // and both in one chain
+    configure(150, 60, 20, 1000);
+    assert(gyroFilter.count == 2);
+    check("low pass 150Hz + notch 60Hz", &gyroFilter, 0, 1000, 0, 0.01);
+    checkBelow("low pass 150Hz + notch 60Hz", &gyroFilter, 60, 1000, -40);
+}
+
+static void samplePeriod(void)
+{
+    biquad_t designed;
+
+    // looptime is only the first guess, the chain follows what the gyro measures
+    configure(100, 0, 0, 3500);
+    check("low pass 100Hz, looptime 3500", &gyroFilter, 100, 3500, -3.01, 0.1);
+    filterSetSamplePeriod(125);
+    check("low pass 100Hz, gyro at 8kHz", &gyroFilter, 100, 125, -3.01, 0.1);
+    check("low pass 100Hz, gyro at 8kHz", &gyroFilter, 200, 125, lowpassDb(100, 200, 125), 0.1);
+    filterSetSamplePeriod(1000);
+    check("low pass 100Hz, gyro at 1kHz", &gyroFilter, 100, 1000, -3.01, 0.1);
+
+    // jitter within 1/32 keeps the design, a real change doesn't
+    designed = gyroFilter.sections[0];
+    filterSetSamplePeriod(1020);
+    assert(!memcmp(&designed, &gyroFilter.sections[0], sizeof(designed)));
+    filterSetSamplePeriod(1040);
+    assert(memcmp(&designed, &gyroFilter.sections[0], sizeof(designed)));
+
+    // the measured period outlives a config change
+    configure(100, 0, 0, 3500);
+    check("low pass 100Hz after filterInit", &gyroFilter, 100, 1040, -3.01, 0.1);
+
+    // a cutoff at or above nyquist drops the section, and its state with it
+    filterSetSamplePeriod(5000);
+    assert(gyroFilter.count == 0 && dtermFilter.count == 0);
+    check("low pass 100Hz at 200Hz, skipped", &gyroFilter, 20, 5000, 0, 0.01);
+    filterSetSamplePeriod(0);
+}
+
+int main(int argc, char *argv[])
+{
+    quiet = argc > 1 && !strcmp(argv[1], "-q");
+
+    lowpass();
+    notch();
+    samplePeriod();
+    printf("filter: all within bounds\n");
+    return 0;
+}